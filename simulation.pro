@@ -21,7 +21,16 @@ win32 {
 
 SOURCES += \
     libs/glew-1.10.0/src/glew.c \
+    src/bodycontacts.cpp \
+    src/broadphase.cpp \
+    src/colliderset.cpp \
     src/collisionobject.cpp \
+    src/collisionsdf.cpp \
+    src/collisiontrimesh.cpp \
+    src/scene.cpp \
+    src/selfcollision.cpp \
+    src/settings.cpp \
+    src/sleepislands.cpp \
     src/main.cpp \
     src/mainwindow.cpp \
     src/solver.cpp \
@@ -34,16 +43,34 @@ SOURCES += \
     src/simulation.cpp \
     src/graphics/shape.cpp \
     src/graphics/camera.cpp \
-    src/graphics/MeshLoader.cpp
+    src/graphics/BinaryMesh.cpp \
+    src/graphics/MeshLoader.cpp \
+    src/graphics/MeshParser.cpp \
+    src/meshcache.cpp \
+    src/meshconverter.cpp \
+    src/meshreorder.cpp \
+    src/parallel.cpp \
+    src/surfacebvh.cpp \
+    src/surfaceextractor.cpp
 
 HEADERS += \
     libs/glew-1.10.0/include/GL/glew.h \
+    src/bodycontacts.h \
+    src/broadphase.h \
+    src/colliderset.h \
     src/collisionobject.h \
+    src/collisionsdf.h \
+    src/collisiontrimesh.h \
+    src/scene.h \
+    src/selfcollision.h \
+    src/settings.h \
+    src/sleepislands.h \
     src/main.h \
     src/mainwindow.h \
     src/solver.h \
     src/system.h \
     src/tet.h \
+    src/triplebuffer.h \
     src/view.h \
     src/viewformat.h \
     src/graphics/Shader.h \
@@ -188,7 +215,15 @@ HEADERS += \
     libs/Eigen/Dense \
     libs/unsupported/Eigen/OpenGLSupport \
     ui_mainwindow.h \
-    src/graphics/MeshLoader.h
+    src/graphics/BinaryMesh.h \
+    src/graphics/MeshLoader.h \
+    src/graphics/MeshParser.h \
+    src/meshcache.h \
+    src/meshconverter.h \
+    src/meshreorder.h \
+    src/parallel.h \
+    src/surfacebvh.h \
+    src/surfaceextractor.h
 
 FORMS += src/mainwindow.ui
 
@@ -205,6 +240,8 @@ DEPENDPATH += src libs glm libs/glew-1.10.0/include
 # Don't add the -pg flag unless you know what you are doing. It makes QThreadPool freeze on Mac OS X
 QMAKE_CXXFLAGS_RELEASE -= -O2
 QMAKE_CXXFLAGS_RELEASE += -O3
+# Nothing reads errno, and without this sqrtf keeps collider loops from vectorizing.
+QMAKE_CXXFLAGS += -fno-math-errno
 QMAKE_CXXFLAGS_WARN_ON -= -Wall
 QMAKE_CXXFLAGS_WARN_ON += -Waddress -Warray-bounds -Wc++0x-compat -Wchar-subscripts -Wformat\
                           -Wmain -Wmissing-braces -Wparentheses -Wreorder -Wreturn-type \
@@ -0,0 +1,338 @@
+#include "bodycontacts.h"
+
+#include <algorithm>
+#include <atomic>
+
+#include "parallel.h"
+#include "system.h"
+
+namespace {
+
+/**
+ * Calls func(index, thread) for every index in [0, count), with threads
+ * taking the next index as they finish the last, for work of uneven size.
+ */
+template <typename Func>
+void forEachIndex(int count, Func func)
+{
+    unsigned int numThreads = min(Parallel::threadCount(), static_cast<unsigned int>(max(count, 1)));
+    atomic<int> next(0);
+    Parallel::forEachThread(numThreads, [&](unsigned int t) {
+        for (int i = next++; i < count; i = next++) {
+            func(i, t);
+        }
+    });
+}
+
+}
+
+BodyContacts::BodyContacts():
+    m_edgeSum(0),
+    m_numEdges(0),
+    m_margin(0.5f),
+    m_thickness(0.25f)
+{
+}
+
+void BodyContacts::addBody(const vector<Vector3i> &faces, const vector<Vector3f> &restPositions)
+{
+    m_bodies.push_back(Body());
+    Body &body = m_bodies.back();
+    body.refitAsleep = false;
+
+    // Renumber the body's surface particles densely, in system order.
+    for (const Vector3i &face : faces) {
+        for (int k = 0; k < 3; k++) {
+            body.particles.push_back(face[k]);
+        }
+    }
+    sort(body.particles.begin(), body.particles.end());
+    body.particles.erase(unique(body.particles.begin(), body.particles.end()), body.particles.end());
+    body.faces.reserve(faces.size());
+    for (const Vector3i &face : faces) {
+        Vector3i local;
+        for (int k = 0; k < 3; k++) {
+            local[k] = lower_bound(body.particles.begin(), body.particles.end(), face[k]) - body.particles.begin();
+            m_edgeSum += (restPositions[face[(k + 1) % 3]] - restPositions[face[k]]).norm();
+        }
+        body.faces.push_back(local);
+    }
+    m_numEdges += faces.size() * 3;
+    if (m_numEdges > 0 && m_edgeSum > 0) {
+        m_margin = 0.5f * m_edgeSum / m_numEdges;
+        m_thickness = 0.25f * m_edgeSum / m_numEdges;
+    }
+
+    body.particlePointers.resize(body.particles.size());
+    body.positions.resize(body.particles.size());
+    body.normals.resize(body.particles.size());
+    for (unsigned int i = 0; i < body.particles.size(); i++) {
+        body.positions[i] = restPositions[body.particles[i]];
+    }
+    body.bvh.build(body.faces, body.positions);
+    body.bounds = body.bvh.bounds();
+
+    // Testing each vertex only from the block that owns it tests it once
+    // per body pair, and since its block's box holds it, that block comes
+    // within the margin of another body whenever the vertex does.
+    vector<int> owner(body.particles.size(), -1);
+    for (int b = 0; b < body.bvh.numBlocks(); b++) {
+        const SurfaceBVH::TriangleBlock &block = body.bvh.block(b);
+        for (int lane = 0; lane < SurfaceBVH::BLOCK_SIZE && block.faces[lane] >= 0; lane++) {
+            for (int k = 0; k < 3; k++) {
+                int &o = owner[body.faces[block.faces[lane]][k]];
+                if (o < 0) {
+                    o = b;
+                }
+            }
+        }
+    }
+    body.ownedOffsets.assign(body.bvh.numBlocks() + 1, 0);
+    for (int o : owner) {
+        body.ownedOffsets[o + 1]++;
+    }
+    for (int b = 0; b < body.bvh.numBlocks(); b++) {
+        body.ownedOffsets[b + 1] += body.ownedOffsets[b];
+    }
+    body.ownedVertices.resize(body.particles.size());
+    vector<int> filled(body.ownedOffsets.begin(), body.ownedOffsets.end() - 1);
+    for (unsigned int i = 0; i < owner.size(); i++) {
+        body.ownedVertices[filled[owner[i]]++] = i;
+    }
+}
+
+int BodyContacts::numBodies() const
+{
+    return m_bodies.size();
+}
+
+void BodyContacts::touchingPairs(vector<pair<int, int>> &pairs) const
+{
+    for (unsigned int p = 0; p < m_bodyPairs.size(); p++) {
+        if (!m_pairContacts[p].empty()) {
+            pairs.push_back(m_bodyPairs[p]);
+        }
+    }
+}
+
+float BodyContacts::margin() const
+{
+    return m_margin;
+}
+
+float BodyContacts::thickness() const
+{
+    return m_thickness;
+}
+
+void BodyContacts::findBodyPairs()
+{
+    m_bodyPairs.clear();
+    m_sortedBodies.clear();
+    for (unsigned int i = 0; i < m_bodies.size(); i++) {
+        if (m_bodies[i].bvh.numBlocks() > 0) {
+            m_sortedBodies.push_back(i);
+        }
+    }
+    if (m_sortedBodies.size() < 2) {
+        return;
+    }
+
+    // Sweep along the axis the bodies are spread out most on, so the fewest
+    // boxes overlap on it.
+    AlignedBox3f centers;
+    centers.setEmpty();
+    for (int i : m_sortedBodies) {
+        centers.extend(m_bodies[i].bounds.center());
+    }
+    int axis;
+    centers.sizes().maxCoeff(&axis);
+    sort(m_sortedBodies.begin(), m_sortedBodies.end(), [this, axis](int a, int b) {
+        return m_bodies[a].bounds.min()[axis] < m_bodies[b].bounds.min()[axis];
+    });
+
+    for (unsigned int s = 0; s < m_sortedBodies.size(); s++) {
+        const int a = m_sortedBodies[s];
+        const AlignedBox3f &box = m_bodies[a].bounds;
+        for (unsigned int t = s + 1; t < m_sortedBodies.size(); t++) {
+            const int b = m_sortedBodies[t];
+            const AlignedBox3f &other = m_bodies[b].bounds;
+            if (other.min()[axis] > box.max()[axis] + m_margin) {
+                break;
+            }
+            if (((box.min().array() - m_margin) <= other.max().array()).all()
+                    && ((other.min().array() - m_margin) <= box.max().array()).all()) {
+                m_bodyPairs.push_back(make_pair(min(a, b), max(a, b)));
+            }
+        }
+    }
+
+    // Ties in the sort can come out in any order; sorting the pairs keeps
+    // the order forces are added in, and so the simulation, the same.
+    sort(m_bodyPairs.begin(), m_bodyPairs.end());
+}
+
+void BodyContacts::findContacts(const Body &a, const Body &b, const vector<int> &blocks, float penalty, float damping,
+                                vector<Contact> &contacts) const
+{
+    AlignedBox3f reach = b.bounds;
+    reach.min().array() -= m_margin;
+    reach.max().array() += m_margin;
+
+    for (int block : blocks) {
+        for (int slot = a.ownedOffsets[block]; slot < a.ownedOffsets[block + 1]; slot++) {
+            const int i = a.ownedVertices[slot];
+            const Vector3f &p = a.positions[i];
+            if (!reach.contains(p) || a.normals[i] == Vector3f::Zero()) {
+                continue;
+            }
+            Vector3f closest;
+            int face;
+            float dist;
+            if (!b.bvh.closestPoint(p, m_margin, closest, face, dist)) {
+                continue;
+            }
+
+            // Faces point out of their body, so the distance along the
+            // normal is negative once the vertex has gone inside.
+            const Vector3i &corners = b.faces[face];
+            const Vector3f &v0 = b.positions[corners[0]];
+            Vector3f ab = b.positions[corners[1]] - v0;
+            Vector3f ac = b.positions[corners[2]] - v0;
+            Vector3f normal = ab.cross(ac);
+            float length = normal.norm();
+            if (length == 0) {
+                continue;
+            }
+            normal /= length;
+            if (a.normals[i].dot(normal) >= 0) {
+                continue;
+            }
+            float depth = m_thickness - (p - closest).dot(normal);
+            if (depth <= 0) {
+                continue;
+            }
+
+            // Barycentric coordinates of the closest point share the
+            // reaction between the triangle's corners.
+            Vector3f aq = closest - v0;
+            float d00 = ab.dot(ab);
+            float d01 = ab.dot(ac);
+            float d11 = ac.dot(ac);
+            float d20 = aq.dot(ab);
+            float d21 = aq.dot(ac);
+            float denom = d00 * d11 - d01 * d01;
+            float v = denom != 0 ? (d11 * d20 - d01 * d21) / denom : 1.f / 3;
+            float w = denom != 0 ? (d00 * d21 - d01 * d20) / denom : 1.f / 3;
+
+            Contact contact;
+            contact.vertex = a.particlePointers[i];
+            for (int k = 0; k < 3; k++) {
+                contact.corners[k] = b.particlePointers[corners[k]];
+            }
+            contact.weights = Vector3f(1 - v - w, v, w);
+
+            // Without damping penalty contacts between soft bodies keep
+            // ringing, and stacks never come to rest.
+            Vector3f velocity = contact.vertex->getVelocity();
+            for (int k = 0; k < 3; k++) {
+                velocity -= contact.weights[k] * contact.corners[k]->getVelocity();
+            }
+            float push = penalty * depth - damping * velocity.dot(normal);
+            if (push <= 0) {
+                continue;
+            }
+            contact.force = push * normal;
+            contacts.push_back(contact);
+        }
+    }
+}
+
+void BodyContacts::apply(System &system, float penalty, float damping)
+{
+    if (m_bodies.size() < 2) {
+        return;
+    }
+    for (Body &body : m_bodies) {
+        for (unsigned int i = 0; i < body.particles.size(); i++) {
+            body.particlePointers[i] = system.getParticle(body.particles[i]).get();
+            body.positions[i] = body.particlePointers[i]->getWorldPosition();
+        }
+    }
+
+    // A sleeping body is refit once more at the position it fell asleep at.
+    shared_ptr<SleepIslands> sleep = system.getSleepIslands();
+    forEachIndex(m_bodies.size(), [&](int b, unsigned int) {
+        Body &body = m_bodies[b];
+        if (sleep && sleep->isAsleep(b)) {
+            if (body.refitAsleep) {
+                return;
+            }
+            body.refitAsleep = true;
+        } else {
+            body.refitAsleep = false;
+        }
+        body.bvh.refit(body.positions);
+        body.bounds = body.bvh.bounds();
+        fill(body.normals.begin(), body.normals.end(), Vector3f::Zero());
+        for (const Vector3i &face : body.faces) {
+            Vector3f normal = (body.positions[face[1]] - body.positions[face[0]])
+                    .cross(body.positions[face[2]] - body.positions[face[0]]);
+            for (int k = 0; k < 3; k++) {
+                body.normals[face[k]] += normal;
+            }
+        }
+    });
+
+    findBodyPairs();
+
+    // Each pair is tested both ways, vertices of either body against the
+    // triangles of the other.
+    m_pairContacts.resize(m_bodyPairs.size());
+    m_threadBlockPairs.resize(Parallel::threadCount());
+    m_threadBlocks.resize(Parallel::threadCount());
+    forEachIndex(m_bodyPairs.size(), [&](int p, unsigned int t) {
+        vector<Contact> &contacts = m_pairContacts[p];
+        vector<pair<int, int>> &blockPairs = m_threadBlockPairs[t];
+        vector<int> &blocks = m_threadBlocks[t];
+        contacts.clear();
+        blockPairs.clear();
+        if (sleep && sleep->isAsleep(m_bodyPairs[p].first) && sleep->isAsleep(m_bodyPairs[p].second)) {
+            return;
+        }
+        const Body &a = m_bodies[m_bodyPairs[p].first];
+        const Body &b = m_bodies[m_bodyPairs[p].second];
+        a.bvh.overlappingBlocks(b.bvh, m_margin, blockPairs);
+        if (blockPairs.empty()) {
+            return;
+        }
+
+        // Only vertices owned by blocks near the other body can touch it.
+        blocks.clear();
+        for (const pair<int, int> &blockPair : blockPairs) {
+            blocks.push_back(blockPair.first);
+        }
+        sort(blocks.begin(), blocks.end());
+        blocks.erase(unique(blocks.begin(), blocks.end()), blocks.end());
+        findContacts(a, b, blocks, penalty, damping, contacts);
+
+        blocks.clear();
+        for (const pair<int, int> &blockPair : blockPairs) {
+            blocks.push_back(blockPair.second);
+        }
+        sort(blocks.begin(), blocks.end());
+        blocks.erase(unique(blocks.begin(), blocks.end()), blocks.end());
+        findContacts(b, a, blocks, penalty, damping, contacts);
+    });
+
+    // A particle can touch several bodies, so the forces are added here, in
+    // pair order.
+    for (unsigned int p = 0; p < m_bodyPairs.size(); p++) {
+        for (const Contact &contact : m_pairContacts[p]) {
+            contact.vertex->addForce(contact.force);
+            for (int k = 0; k < 3; k++) {
+                contact.corners[k]->addForce(-contact.weights[k] * contact.force);
+            }
+        }
+    }
+}
@@ -0,0 +1,123 @@
+#ifndef BODYCONTACTS_H
+#define BODYCONTACTS_H
+
+#include <utility>
+#include <vector>
+#include <Eigen/Dense>
+#include <Eigen/Geometry>
+#include <Eigen/StdVector>
+#include "surfacebvh.h"
+
+using namespace Eigen;
+using namespace std;
+
+class Particle;
+class System;
+
+/**
+ * Keeps separate deformable bodies in one system from passing through each
+ * other. Each evaluation every body's surface BVH is refit to its particles,
+ * pairs of bodies whose boxes come within the margin are found by sorting
+ * the boxes along one axis (sweep and prune), and the two BVHs of every
+ * such pair are descended together for the pairs of leaves that may touch.
+ * The vertices of those leaves then look up their closest triangle of the
+ * other body. Surface vertices of one body closer than the thickness to, or
+ * less than the margin inside, a triangle of the other are pushed out along the
+ * triangle's normal, and the opposite force is spread over its corners.
+ * Only surfaces facing each other touch: a vertex whose normal points the
+ * same way as the triangle's has gone through a thin part of the other body,
+ * and pushing it out along the triangle would push it further through.
+ * Body pairs are handed out to threads one at a time, so a few crowded
+ * pairs don't hold up the rest. Pairs of bodies that are both asleep in
+ * the system's SleepIslands, numbered the same, are skipped.
+ */
+class BodyContacts
+{
+public:
+    BodyContacts();
+
+    /**
+     * Adds a body whose outward facing surface is faces, indexing the
+     * system's particles, and restPositions the particles' rest positions.
+     * The margin is half the mean surface edge over all bodies added so far
+     * and the thickness a quarter of it.
+     */
+    void addBody(const vector<Vector3i> &faces, const vector<Vector3f> &restPositions);
+
+    int numBodies() const;
+
+    /**
+     * Adds penalty times penetration of the thickness to every surface
+     * particle too close to another body's surface, and the reaction to
+     * that surface. Damping times the speed the two approach at is added
+     * to the push, and taken off it as they separate, though never so far
+     * as to pull them together.
+     */
+    void apply(System &system, float penalty, float damping);
+
+    /** Pairs of bodies that pushed on each other in the last apply. */
+    void touchingPairs(vector<pair<int, int>> &pairs) const;
+
+    float margin() const;
+    float thickness() const;
+
+private:
+    struct Body
+    {
+        /** System indices of the surface particles, and the faces renumbered into them. */
+        vector<int> particles;
+        vector<Vector3i> faces;
+
+        vector<Particle *> particlePointers;
+        vector<Vector3f> positions;
+
+        /** Area weighted vertex normals, pointing out of the body. */
+        vector<Vector3f> normals;
+        SurfaceBVH bvh;
+        AlignedBox3f bounds;
+
+        /** Whether the BVH was refit since the body fell asleep, after which it can't move. */
+        bool refitAsleep;
+
+        /**
+         * Every vertex belongs to the first block holding one of its faces.
+         * Vertices of block b are ownedVertices[ownedOffsets[b], ownedOffsets[b + 1]).
+         */
+        vector<int> ownedOffsets;
+        vector<int> ownedVertices;
+    };
+
+    struct Contact
+    {
+        Particle *vertex;
+        Particle *corners[3];
+        Vector3f force;
+        Vector3f weights;
+    };
+
+    void findBodyPairs();
+
+    /**
+     * Appends contacts of the vertices owned by blocks of body a against the
+     * closest triangle of body b.
+     */
+    void findContacts(const Body &a, const Body &b, const vector<int> &blocks, float penalty, float damping,
+                      vector<Contact> &contacts) const;
+
+    vector<Body> m_bodies;
+    double m_edgeSum;
+    int m_numEdges;
+    float m_margin;
+    float m_thickness;
+
+    /** Bodies whose boxes came within the margin, as of the last apply. */
+    vector<pair<int, int>> m_bodyPairs;
+    vector<int> m_sortedBodies;
+
+    /** Contacts of each body pair, applied in pair order. */
+    vector<vector<Contact>> m_pairContacts;
+    vector<vector<pair<int, int>>> m_threadBlockPairs;
+    vector<vector<int>> m_threadBlocks;
+};
+
+#endif // BODYCONTACTS_H
@@ -0,0 +1,71 @@
+#include "broadphase.h"
+
+#include <algorithm>
+
+BroadPhase::BroadPhase():
+    m_numPoints(0)
+{
+}
+
+void BroadPhase::update(const vector<Vector3f> &points, const vector<shared_ptr<CollisionObject>> &colliders)
+{
+    m_numPoints = points.size();
+    int clusters = (m_numPoints + CLUSTER_SIZE - 1) / CLUSTER_SIZE;
+    m_clusterBounds.resize(clusters);
+    m_colliderClusters.resize(colliders.size());
+
+    m_bodyBounds.setEmpty();
+    for (int c = 0; c < clusters; c++) {
+        AlignedBox3f &box = m_clusterBounds[c];
+        box.setEmpty();
+        for (int i = clusterBegin(c); i < clusterEnd(c); i++) {
+            box.extend(points[i]);
+        }
+        m_bodyBounds.extend(box);
+    }
+
+    // Colliders nowhere near the body are dropped once rather than tested
+    // against every cluster.
+    for (unsigned int k = 0; k < colliders.size(); k++) {
+        vector<int> &list = m_colliderClusters[k];
+        list.clear();
+        if (clusters == 0 || !colliders[k]->mayIntersect(m_bodyBounds)) {
+            continue;
+        }
+        for (int c = 0; c < clusters; c++) {
+            if (colliders[k]->mayIntersect(m_clusterBounds[c])) {
+                list.push_back(c);
+            }
+        }
+    }
+}
+
+int BroadPhase::numClusters() const
+{
+    return m_clusterBounds.size();
+}
+
+int BroadPhase::clusterBegin(int cluster) const
+{
+    return cluster * CLUSTER_SIZE;
+}
+
+int BroadPhase::clusterEnd(int cluster) const
+{
+    return min(m_numPoints, (cluster + 1) * CLUSTER_SIZE);
+}
+
+const AlignedBox3f &BroadPhase::clusterBounds(int cluster) const
+{
+    return m_clusterBounds[cluster];
+}
+
+const vector<int> &BroadPhase::clusters(int collider) const
+{
+    return m_colliderClusters[collider];
+}
+
+const AlignedBox3f &BroadPhase::bodyBounds() const
+{
+    return m_bodyBounds;
+}
@@ -0,0 +1,53 @@
+#ifndef BROADPHASE_H
+#define BROADPHASE_H
+
+#include <memory>
+#include <vector>
+#include "collisionobject.h"
+
+/**
+ * Culls colliders that can't touch the body before the per point tests.
+ * Points are grouped into clusters of CLUSTER_SIZE consecutive points,
+ * which are spatially coherent for meshes in file or reordered order. Each
+ * update boxes every cluster and the whole body, drops colliders that miss
+ * the body's box, then lists for each remaining collider the clusters whose
+ * boxes it reaches.
+ */
+class BroadPhase
+{
+public:
+    static const int CLUSTER_SIZE = 64;
+
+    BroadPhase();
+
+    /**
+     * Reboxes the points and recomputes the clusters each collider reaches.
+     */
+    void update(const vector<Vector3f> &points, const vector<shared_ptr<CollisionObject>> &colliders);
+
+    int numClusters() const;
+
+    /** Points [clusterBegin(c), clusterEnd(c)) make up cluster c. */
+    int clusterBegin(int cluster) const;
+    int clusterEnd(int cluster) const;
+
+    /** Box around cluster c as of the last update. */
+    const AlignedBox3f &clusterBounds(int cluster) const;
+
+    /**
+     * Clusters whose points may touch colliders[collider] of the last
+     * update, in increasing order.
+     */
+    const vector<int> &clusters(int collider) const;
+
+    /** Box around the whole body as of the last update. */
+    const AlignedBox3f &bodyBounds() const;
+
+private:
+    int m_numPoints;
+    AlignedBox3f m_bodyBounds;
+    vector<AlignedBox3f> m_clusterBounds;
+    vector<vector<int>> m_colliderClusters;
+};
+
+#endif // BROADPHASE_H
@@ -0,0 +1,59 @@
+#include "colliderset.h"
+
+#include <typeinfo>
+
+namespace {
+
+/**
+ * Runs each collider's batch loop over the clusters it may reach. Calls are
+ * qualified with the collider type so none of them is virtual.
+ */
+template <typename Collider>
+void addTypePenalties(const vector<Collider> &colliders, const BroadPhase &broadPhase,
+                      const float *x, const float *y, const float *z, float penalty,
+                      float *forceX, float *forceY, float *forceZ)
+{
+    for (const Collider &collider : colliders) {
+        if (!collider.Collider::mayIntersect(broadPhase.bodyBounds())) {
+            continue;
+        }
+        for (int c = 0; c < broadPhase.numClusters(); c++) {
+            if (collider.Collider::mayIntersect(broadPhase.clusterBounds(c))) {
+                collider.addPenalties(x, y, z, broadPhase.clusterBegin(c), broadPhase.clusterEnd(c), penalty,
+                                      forceX, forceY, forceZ);
+            }
+        }
+    }
+}
+
+}
+
+void ColliderSet::add(shared_ptr<CollisionObject> collider)
+{
+    m_all.push_back(collider);
+    const CollisionObject &object = *collider;
+    if (typeid(object) == typeid(CollisionPlane)) {
+        m_planes.push_back(static_cast<const CollisionPlane &>(object));
+    } else if (typeid(object) == typeid(CollisionSphere)) {
+        m_spheres.push_back(static_cast<const CollisionSphere &>(object));
+    } else {
+        m_others.push_back(collider);
+    }
+}
+
+const vector<shared_ptr<CollisionObject>> &ColliderSet::all() const
+{
+    return m_all;
+}
+
+const vector<shared_ptr<CollisionObject>> &ColliderSet::others() const
+{
+    return m_others;
+}
+
+void ColliderSet::addPenalties(const BroadPhase &broadPhase, const float *x, const float *y, const float *z,
+                               float penalty, float *forceX, float *forceY, float *forceZ) const
+{
+    addTypePenalties(m_planes, broadPhase, x, y, z, penalty, forceX, forceY, forceZ);
+    addTypePenalties(m_spheres, broadPhase, x, y, z, penalty, forceX, forceY, forceZ);
+}
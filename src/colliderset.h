@@ -0,0 +1,46 @@
+#ifndef COLLIDERSET_H
+#define COLLIDERSET_H
+
+#include <memory>
+#include <vector>
+#include "broadphase.h"
+#include "collisionobject.h"
+
+/**
+ * The colliders of a system, partitioned by type. Planes and spheres, the
+ * built in types, are kept by value in arrays of their own and evaluated by
+ * per type loops with no virtual calls. Colliders of any other type are
+ * kept apart and go through the virtual CollisionObject interface.
+ */
+class ColliderSet
+{
+public:
+    /**
+     * Adds collider to the partition of its exact type, so subclasses of
+     * the built in types keep their overrides.
+     */
+    void add(shared_ptr<CollisionObject> collider);
+
+    /** Every collider, in the order added. */
+    const vector<shared_ptr<CollisionObject>> &all() const;
+
+    /** Colliders of types without a loop of their own. */
+    const vector<shared_ptr<CollisionObject>> &others() const;
+
+    /**
+     * Adds penalty times penetration of every plane and sphere to the
+     * forces of the points broadPhase was last updated with, given as
+     * separate coordinate arrays. Only clusters a collider may reach are
+     * looped over.
+     */
+    void addPenalties(const BroadPhase &broadPhase, const float *x, const float *y, const float *z, float penalty,
+                      float *forceX, float *forceY, float *forceZ) const;
+
+private:
+    vector<shared_ptr<CollisionObject>> m_all;
+    vector<CollisionPlane> m_planes;
+    vector<CollisionSphere> m_spheres;
+    vector<shared_ptr<CollisionObject>> m_others;
+};
+
+#endif // COLLIDERSET_H
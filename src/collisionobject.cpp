@@ -1,7 +1,29 @@
 #include "collisionobject.h"
 
+#include <algorithm>
+#include <cmath>
+
 CollisionObject::CollisionObject(){}
 
+CollisionObject::~CollisionObject(){}
+
+void CollisionObject::pointIntersections(const Vector3f *points, int count, Vector3f *out)
+{
+    for (int i = 0; i < count; i++) {
+        out[i] = pointIntersection(points[i]);
+    }
+}
+
+bool CollisionObject::mayIntersect(const AlignedBox3f &) const
+{
+    return true;
+}
+
+bool CollisionObject::sweptIntersection(const Vector3f &, const Vector3f &, float &, Vector3f &)
+{
+    return false;
+}
+
 CollisionPlane::CollisionPlane(Vector3f point, Vector3f normal):
     m_point(point),
     m_normal(normal)
@@ -26,6 +48,52 @@ Vector3f CollisionPlane::pointIntersection(Vector3f point)
     }
 }
 
+void CollisionPlane::pointIntersections(const Vector3f *points, int count, Vector3f *out)
+{
+    // Qualified calls are resolved statically and can be inlined.
+    for (int i = 0; i < count; i++) {
+        out[i] = CollisionPlane::pointIntersection(points[i]);
+    }
+}
+
+bool CollisionPlane::mayIntersect(const AlignedBox3f &box) const
+{
+    // The corner furthest along -normal is the lowest point of the box.
+    Vector3f lowest = (m_normal.array() > 0).select(box.min(), box.max());
+    return lowest.dot(m_normal) <= m_point.dot(m_normal);
+}
+
+void CollisionPlane::addPenalties(const float *x, const float *y, const float *z, int begin, int end, float penalty,
+                                  float *__restrict forceX, float *__restrict forceY, float *__restrict forceZ) const
+{
+    // The same projection as pointIntersection: points below the plane are
+    // pushed (d - p.n) / (n.n) along n.
+    const float nx = m_normal[0];
+    const float ny = m_normal[1];
+    const float nz = m_normal[2];
+    const float d = m_point.dot(m_normal);
+    const float scale = penalty / m_normal.dot(m_normal);
+    for (int i = begin; i < end; i++) {
+        float depth = max(d - (nx * x[i] + ny * y[i] + nz * z[i]), 0.f) * scale;
+        forceX[i] += depth * nx;
+        forceY[i] += depth * ny;
+        forceZ[i] += depth * nz;
+    }
+}
+
+bool CollisionPlane::sweptIntersection(const Vector3f &start, const Vector3f &end, float &t, Vector3f &normal)
+{
+    // Signed heights above the plane, in units of the normal's length.
+    float startHeight = (start - m_point).dot(m_normal);
+    float endHeight = (end - m_point).dot(m_normal);
+    if (startHeight <= 0 || endHeight >= 0) {
+        return false;
+    }
+    t = startHeight / (startHeight - endHeight);
+    normal = m_normal.normalized();
+    return true;
+}
+
 
 CollisionSphere::CollisionSphere(Vector3f center, float radius):
     m_center(center),
@@ -45,3 +113,62 @@ Vector3f CollisionSphere::pointIntersection(Vector3f point)
         return centerToPoint.normalized() * distToEdge;
     }
 }
+
+void CollisionSphere::pointIntersections(const Vector3f *points, int count, Vector3f *out)
+{
+    for (int i = 0; i < count; i++) {
+        out[i] = CollisionSphere::pointIntersection(points[i]);
+    }
+}
+
+bool CollisionSphere::mayIntersect(const AlignedBox3f &box) const
+{
+    return box.squaredExteriorDistance(m_center) <= m_radius * m_radius;
+}
+
+void CollisionSphere::addPenalties(const float *x, const float *y, const float *z, int begin, int end, float penalty,
+                                   float *__restrict forceX, float *__restrict forceY, float *__restrict forceZ) const
+{
+    // Every point computes the push, which comes out negative for points
+    // outside and is clamped to zero, so the loop has no branches. The
+    // distance is kept off zero so a point at the center gets no push
+    // rather than a NaN.
+    const float cx = m_center[0];
+    const float cy = m_center[1];
+    const float cz = m_center[2];
+    const float radius = m_radius;
+    for (int i = begin; i < end; i++) {
+        float dx = x[i] - cx;
+        float dy = y[i] - cy;
+        float dz = z[i] - cz;
+        float dist = sqrtf(max(dx * dx + dy * dy + dz * dz, 1e-30f));
+        float scale = max(penalty * (radius - dist) / dist, 0.f);
+        forceX[i] += scale * dx;
+        forceY[i] += scale * dy;
+        forceZ[i] += scale * dz;
+    }
+}
+
+bool CollisionSphere::sweptIntersection(const Vector3f &start, const Vector3f &end, float &t, Vector3f &normal)
+{
+    // Smaller root of |start + t * (end - start) - center|^2 = radius^2.
+    Vector3f d = end - start;
+    Vector3f m = start - m_center;
+    float c = m.squaredNorm() - m_radius * m_radius;
+    float a = d.squaredNorm();
+    if (c <= 0 || a == 0) {
+        return false;
+    }
+    float b = m.dot(d);
+    float discriminant = b * b - a * c;
+    if (b >= 0 || discriminant < 0) {
+        return false;
+    }
+    float root = (-b - sqrtf(discriminant)) / a;
+    if (root > 1) {
+        return false;
+    }
+    t = root;
+    normal = (m + t * d) / m_radius;
+    return true;
+}
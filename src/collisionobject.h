@@ -1,7 +1,9 @@
 #ifndef COLLIDERSHAPE_H
 #define COLLIDERSHAPE_H
 
-#include "graphics/shape.h"
+#include <vector>
+#include <Eigen/Dense>
+#include <Eigen/Geometry>
 #include <Eigen/StdVector>
 #include <iostream>
 
@@ -13,7 +15,31 @@ class CollisionObject
 public:
     CollisionObject();
 
+    virtual ~CollisionObject();
+
     virtual Vector3f pointIntersection(Vector3f point) = 0;
+
+    /**
+     * Calls pointIntersection for count points, writing the results to out.
+     * Colliders override this with a loop that makes no virtual calls.
+     */
+    virtual void pointIntersections(const Vector3f *points, int count, Vector3f *out);
+
+    /**
+     * False only if no point in box can intersect the collider, so the
+     * points in it can be skipped. The default never rules anything out.
+     */
+    virtual bool mayIntersect(const AlignedBox3f &box) const;
+
+    /**
+     * Sweeps a point moving in a straight line from start to end. If it
+     * enters the collider on the way, returns true and sets t to the
+     * earliest fraction of the way at which it touches the surface and
+     * normal to the outward unit normal there. Points that start inside are
+     * left to pointIntersection. The default never reports a hit, leaving
+     * the collider to the end of step test.
+     */
+    virtual bool sweptIntersection(const Vector3f &start, const Vector3f &end, float &t, Vector3f &normal);
 };
 
 class CollisionPlane : public CollisionObject
@@ -27,6 +53,23 @@ public:
      */
     Vector3f pointIntersection(Vector3f point) override;
 
+    void pointIntersections(const Vector3f *points, int count, Vector3f *out) override;
+
+    /**
+     * True if any corner of the box is on or below the plane.
+     */
+    bool mayIntersect(const AlignedBox3f &box) const override;
+
+    bool sweptIntersection(const Vector3f &start, const Vector3f &end, float &t, Vector3f &normal) override;
+
+    /**
+     * Adds penalty times pointIntersection to the forces of points
+     * [begin, end), given as separate coordinate arrays. Not virtual, and
+     * written to vectorize, for colliders stored by type.
+     */
+    void addPenalties(const float *x, const float *y, const float *z, int begin, int end, float penalty,
+                      float *__restrict forceX, float *__restrict forceY, float *__restrict forceZ) const;
+
 private:
     Vector3f m_point;
     Vector3f m_normal;
@@ -43,6 +86,22 @@ public:
      */
     Vector3f pointIntersection(Vector3f point) override;
 
+    void pointIntersections(const Vector3f *points, int count, Vector3f *out) override;
+
+    /**
+     * True if the box comes within the radius of the center.
+     */
+    bool mayIntersect(const AlignedBox3f &box) const override;
+
+    bool sweptIntersection(const Vector3f &start, const Vector3f &end, float &t, Vector3f &normal) override;
+
+    /**
+     * Adds penalty times pointIntersection to the forces of points
+     * [begin, end), like CollisionPlane::addPenalties.
+     */
+    void addPenalties(const float *x, const float *y, const float *z, int begin, int end, float penalty,
+                      float *__restrict forceX, float *__restrict forceY, float *__restrict forceZ) const;
+
 private:
     Vector3f m_center;
     float m_radius;
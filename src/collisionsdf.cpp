@@ -0,0 +1,511 @@
+#include "collisionsdf.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <limits>
+
+#include <QByteArray>
+#include <QFile>
+#include <QSaveFile>
+
+#include "graphics/MeshLoader.h"
+#include "meshcache.h"
+#include "parallel.h"
+#include "surfacebvh.h"
+
+using namespace Eigen;
+using namespace std;
+
+namespace {
+
+const int BRICK_SAMPLES = CollisionSDF::BRICK_SIZE + 1;
+const int SAMPLES_PER_BRICK = BRICK_SAMPLES * BRICK_SAMPLES * BRICK_SAMPLES;
+
+const char MAGIC[8] = { 'T', 'E', 'T', 'S', 'D', 'F', '\0', '\0' };
+const uint32_t VERSION = 1;
+
+struct FileHeader
+{
+    char magic[8];
+    uint32_t version;
+    int32_t resolution;
+    int32_t bandCells;
+    int32_t numVertices;
+    int32_t numFaces;
+    int32_t numRefined;
+    uint64_t sourceHash;
+    uint64_t sourceSize;
+    float origin[3];
+    float cellSize;
+    int32_t bricks[3];
+    int32_t pad;
+};
+
+/**
+ * Finds where rays along +x cross the surface, to tell inside from outside
+ * by parity. Triangles are binned by their extent in y and z so each row
+ * only tests the triangles that can cover it.
+ */
+class RowCrossings
+{
+public:
+    RowCrossings(const vector<Vector3f> &vertices, const vector<Vector3i> &faces,
+                 const Vector3f &origin, float binSize, int binsY, int binsZ):
+        m_vertices(vertices),
+        m_faces(faces),
+        m_origin(origin),
+        m_binSize(binSize),
+        m_binsY(binsY),
+        m_binsZ(binsZ),
+        m_bins(binsY * binsZ)
+    {
+        for (unsigned int f = 0; f < faces.size(); f++) {
+            Vector3f lo = vertices[faces[f][0]].cwiseMin(vertices[faces[f][1]]).cwiseMin(vertices[faces[f][2]]);
+            Vector3f hi = vertices[faces[f][0]].cwiseMax(vertices[faces[f][1]]).cwiseMax(vertices[faces[f][2]]);
+            for (int z = bin(lo.z(), m_origin.z(), m_binsZ); z <= bin(hi.z(), m_origin.z(), m_binsZ); z++) {
+                for (int y = bin(lo.y(), m_origin.y(), m_binsY); y <= bin(hi.y(), m_origin.y(), m_binsY); y++) {
+                    m_bins[z * m_binsY + y].push_back(f);
+                }
+            }
+        }
+    }
+
+    /**
+     * Sorted x of every crossing of the row through (y, z).
+     */
+    void row(float y, float z, vector<float> &crossings) const
+    {
+        // Nudge the row off the lattice so it doesn't run exactly through
+        // the shared edges and vertices of meshes built on the same grid.
+        const double qy = y + m_binSize * 1.2345e-5;
+        const double qz = z + m_binSize * 2.7183e-5;
+        crossings.clear();
+        for (int f : m_bins[bin(qz, m_origin.z(), m_binsZ) * m_binsY + bin(qy, m_origin.y(), m_binsY)]) {
+            const Vector3f &a = m_vertices[m_faces[f][0]];
+            const Vector3f &b = m_vertices[m_faces[f][1]];
+            const Vector3f &c = m_vertices[m_faces[f][2]];
+            double w0 = edge(b, c, qy, qz);
+            double w1 = edge(c, a, qy, qz);
+            double w2 = edge(a, b, qy, qz);
+            if ((w0 > 0 && w1 > 0 && w2 > 0) || (w0 < 0 && w1 < 0 && w2 < 0)) {
+                crossings.push_back((w0 * a.x() + w1 * b.x() + w2 * c.x()) / (w0 + w1 + w2));
+            }
+        }
+        sort(crossings.begin(), crossings.end());
+    }
+
+    static bool inside(const vector<float> &crossings, float x)
+    {
+        return (lower_bound(crossings.begin(), crossings.end(), x) - crossings.begin()) % 2 == 1;
+    }
+
+private:
+    int bin(double v, float origin, int bins) const
+    {
+        return max(0, min(bins - 1, static_cast<int>((v - origin) / m_binSize)));
+    }
+
+    static double edge(const Vector3f &a, const Vector3f &b, double qy, double qz)
+    {
+        return (double(b.y()) - a.y()) * (qz - a.z()) - (double(b.z()) - a.z()) * (qy - a.y());
+    }
+
+    const vector<Vector3f> &m_vertices;
+    const vector<Vector3i> &m_faces;
+    Vector3f m_origin;
+    float m_binSize;
+    int m_binsY;
+    int m_binsZ;
+    vector<vector<int>> m_bins;
+};
+
+}
+
+CollisionSDF::CollisionSDF():
+    m_origin(Vector3f::Zero()),
+    m_cellSize(1),
+    m_bricks(Vector3i::Zero())
+{
+}
+
+void CollisionSDF::build(const vector<Vector3f> &vertices, const vector<Vector3i> &faces, float cellSize, int bandCells)
+{
+    const int S = BRICK_SIZE;
+    m_vertices = vertices;
+    m_faces = faces;
+    m_bounds.setEmpty();
+    for (const Vector3f &v : vertices) {
+        m_bounds.extend(v);
+    }
+
+    const float band = bandCells * cellSize;
+    const float margin = band + cellSize;
+    m_cellSize = cellSize;
+    m_origin = m_bounds.min() - Vector3f::Constant(margin);
+    Vector3f extent = m_bounds.sizes() + Vector3f::Constant(2 * margin);
+    for (int c = 0; c < 3; c++) {
+        m_bricks[c] = max(1, static_cast<int>(ceil(extent[c] / (cellSize * S))));
+    }
+
+    SurfaceBVH bvh;
+    bvh.build(faces, vertices);
+    const float brickSize = cellSize * S;
+    RowCrossings rows(vertices, faces, m_origin, brickSize, m_bricks.y() + 1, m_bricks.z() + 1);
+    auto signedDistance = [&bvh](const Vector3f &p, const vector<float> &crossings) {
+        Vector3f closest;
+        int face;
+        float dist = numeric_limits<float>::max();
+        bvh.closestPoint(p, numeric_limits<float>::max(), closest, face, dist);
+        return RowCrossings::inside(crossings, p.x()) ? -dist : dist;
+    };
+
+    // Coarse level: every brick corner, one row of corners at a time.
+    const int cx = m_bricks.x() + 1;
+    const int cy = m_bricks.y() + 1;
+    const int cz = m_bricks.z() + 1;
+    m_coarse.assign(cx * cy * cz, 0);
+    Parallel::forRange(0, cy * cz, 1, [&](int begin, int end) {
+        vector<float> crossings;
+        for (int r = begin; r < end; r++) {
+            int y = r % cy;
+            int z = r / cy;
+            Vector3f p = m_origin + Vector3f(0, y, z) * brickSize;
+            rows.row(p.y(), p.z(), crossings);
+            for (int x = 0; x < cx; x++) {
+                p.x() = m_origin.x() + x * brickSize;
+                m_coarse[coarseIndex(x, y, z)] = signedDistance(p, crossings);
+            }
+        }
+    });
+
+    // Refine the bricks that can hold a point within the band.
+    const int numBricks = m_bricks.x() * m_bricks.y() * m_bricks.z();
+    const float halfDiagonal = 0.5f * sqrtf(3.f) * brickSize;
+    vector<char> refine(numBricks, 0);
+    Parallel::forRange(0, numBricks, 64, [&](int begin, int end) {
+        for (int b = begin; b < end; b++) {
+            Vector3i brick(b % m_bricks.x(), (b / m_bricks.x()) % m_bricks.y(), b / (m_bricks.x() * m_bricks.y()));
+            Vector3f center = m_origin + (brick.cast<float>() + Vector3f::Constant(0.5f)) * brickSize;
+            Vector3f closest;
+            int face;
+            float dist;
+            refine[b] = bvh.closestPoint(center, band + halfDiagonal, closest, face, dist);
+        }
+    });
+    m_brickIndex.assign(numBricks, -1);
+    vector<int> refined;
+    for (int b = 0; b < numBricks; b++) {
+        if (refine[b]) {
+            m_brickIndex[b] = refined.size();
+            refined.push_back(b);
+        }
+    }
+
+    m_fine.assign(refined.size() * SAMPLES_PER_BRICK, 0);
+    Parallel::forRange(0, refined.size(), 1, [&](int begin, int end) {
+        vector<float> crossings;
+        for (int i = begin; i < end; i++) {
+            int b = refined[i];
+            Vector3i brick(b % m_bricks.x(), (b / m_bricks.x()) % m_bricks.y(), b / (m_bricks.x() * m_bricks.y()));
+            Vector3f corner = m_origin + brick.cast<float>() * brickSize;
+            float *samples = &m_fine[i * SAMPLES_PER_BRICK];
+            for (int z = 0; z < BRICK_SAMPLES; z++) {
+                for (int y = 0; y < BRICK_SAMPLES; y++) {
+                    Vector3f p = corner + Vector3f(0, y, z) * cellSize;
+                    rows.row(p.y(), p.z(), crossings);
+                    for (int x = 0; x < BRICK_SAMPLES; x++) {
+                        p.x() = corner.x() + x * cellSize;
+                        samples[(z * BRICK_SAMPLES + y) * BRICK_SAMPLES + x] = signedDistance(p, crossings);
+                    }
+                }
+            }
+        }
+    });
+}
+
+bool CollisionSDF::load(const string &meshPath, int resolution, int bandCells)
+{
+    QFile file(QString::fromStdString(meshPath));
+    if (!file.open(QIODevice::ReadOnly)) {
+        cout << "Error opening file: " << meshPath << endl;
+        return false;
+    }
+    QByteArray contents = file.readAll();
+    file.close();
+    uint64_t hash = MeshCache::hashBytes(contents.constData(), contents.size());
+    uint64_t size = contents.size();
+
+    if (read(cachePath(meshPath), hash, size, resolution, bandCells)) {
+        return true;
+    }
+
+    vector<Vector3f> vertices;
+    vector<Vector3i> faces;
+    if (!MeshLoader::loadTriangleMesh(meshPath, vertices, faces) || faces.empty()) {
+        cout << "No surface to build a distance field from: " << meshPath << endl;
+        return false;
+    }
+    AlignedBox3f bounds;
+    bounds.setEmpty();
+    for (const Vector3f &v : vertices) {
+        bounds.extend(v);
+    }
+    float cellSize = max(bounds.sizes().maxCoeff(), 1e-6f) / max(1, resolution);
+    build(vertices, faces, cellSize, bandCells);
+    if (!write(cachePath(meshPath), hash, size, resolution, bandCells)) {
+        cout << "Could not write distance field cache: " << cachePath(meshPath) << endl;
+    }
+    return true;
+}
+
+string CollisionSDF::cachePath(const string &meshPath)
+{
+    return meshPath + ".sdf";
+}
+
+float CollisionSDF::distance(const Vector3f &point, Vector3f &gradient) const
+{
+    // A blown up body can reach here with NaNs, which the clamp below lets
+    // through into the sample indices.
+    if (!point.allFinite()) {
+        gradient.setZero();
+        return numeric_limits<float>::max();
+    }
+    const int S = BRICK_SIZE;
+    // Position in fine cells, clamped to just inside the grid.
+    Vector3f upper = (m_bricks * S).cast<float>() - Vector3f::Constant(1e-3f);
+    Vector3f f = ((point - m_origin) / m_cellSize).cwiseMax(Vector3f::Zero()).cwiseMin(upper);
+    Vector3i brick = (f / S).cast<int>().cwiseMin(m_bricks - Vector3i::Ones());
+    int fine = m_brickIndex[(brick.z() * m_bricks.y() + brick.y()) * m_bricks.x() + brick.x()];
+    Vector3f local = f - (brick * S).cast<float>();
+
+    // Pick the level. From here on the lookup is the same for both: a cell of
+    // a lattice with strides sy and sz and local coordinates t in [0, 1).
+    const bool refined = fine >= 0;
+    const Vector3i cell = refined ? Vector3i(local.cast<int>().cwiseMin(Vector3i::Constant(S - 1))) : brick;
+    const Vector3f t = refined ? Vector3f(local - cell.cast<float>()) : Vector3f(local / S);
+    const float *data = refined ? &m_fine[fine * SAMPLES_PER_BRICK] : m_coarse.data();
+    const int sy = refined ? BRICK_SAMPLES : m_bricks.x() + 1;
+    const int sz = refined ? BRICK_SAMPLES * BRICK_SAMPLES : (m_bricks.x() + 1) * (m_bricks.y() + 1);
+    const float spacing = refined ? m_cellSize : m_cellSize * S;
+
+    const float *c = data + cell.x() + cell.y() * sy + cell.z() * sz;
+    const float c000 = c[0], c100 = c[1], c010 = c[sy], c110 = c[sy + 1];
+    const float c001 = c[sz], c101 = c[sz + 1], c011 = c[sz + sy], c111 = c[sz + sy + 1];
+    const float tx = t.x(), ty = t.y(), tz = t.z();
+
+    const float dx00 = c100 - c000, dx10 = c110 - c010, dx01 = c101 - c001, dx11 = c111 - c011;
+    const float c00 = c000 + tx * dx00;
+    const float c10 = c010 + tx * dx10;
+    const float c01 = c001 + tx * dx01;
+    const float c11 = c011 + tx * dx11;
+    const float c0 = c00 + ty * (c10 - c00);
+    const float c1 = c01 + ty * (c11 - c01);
+
+    const float gx = (1 - tz) * ((1 - ty) * dx00 + ty * dx10) + tz * ((1 - ty) * dx01 + ty * dx11);
+    const float gy = (1 - tz) * (c10 - c00) + tz * (c11 - c01);
+    const float gz = c1 - c0;
+    gradient = Vector3f(gx, gy, gz) / spacing;
+    return c0 + tz * (c1 - c0);
+}
+
+Vector3f CollisionSDF::pointIntersection(Vector3f point)
+{
+    Vector3f gradient;
+    float d = distance(point, gradient);
+    float length = gradient.norm();
+    if (d >= 0 || length == 0) {
+        return Vector3f::Zero();
+    }
+    // The gradient points out of the obstacle.
+    return gradient * (-d / length);
+}
+
+void CollisionSDF::pointIntersections(const Vector3f *points, int count, Vector3f *out)
+{
+    for (int i = 0; i < count; i++) {
+        out[i] = CollisionSDF::pointIntersection(points[i]);
+    }
+}
+
+bool CollisionSDF::mayIntersect(const AlignedBox3f &box) const
+{
+    return !m_faces.empty() && m_bounds.intersects(box);
+}
+
+bool CollisionSDF::sweptIntersection(const Vector3f &start, const Vector3f &end, float &t, Vector3f &normal)
+{
+    const int MAX_STEPS = 256;
+    const int BISECTIONS = 16;
+    Vector3f segment = end - start;
+    float length = segment.norm();
+    Vector3f gradient;
+    float d = m_faces.empty() || length == 0 ? 0 : distance(start, gradient);
+    if (d <= 0) {
+        return false;
+    }
+
+    // The field can't rule out anything thinner than a cell, so a step of
+    // half a cell is the least that's worth taking.
+    float minStep = 0.5f * m_cellSize / length;
+    float outside = 0;
+    float inside = -1;
+    for (int step = 0; step < MAX_STEPS && outside < 1; step++) {
+        float next = min(1.f, outside + max(d / length, minStep));
+        d = distance(start + next * segment, gradient);
+        if (d <= 0) {
+            inside = next;
+            break;
+        }
+        outside = next;
+    }
+    if (inside < 0) {
+        return false;
+    }
+
+    for (int i = 0; i < BISECTIONS; i++) {
+        float middle = 0.5f * (outside + inside);
+        if (distance(start + middle * segment, gradient) > 0) {
+            outside = middle;
+        } else {
+            inside = middle;
+        }
+    }
+    t = outside;
+    distance(start + inside * segment, gradient);
+    float gradientLength = gradient.norm();
+    normal = gradientLength > 0 ? Vector3f(gradient / gradientLength) : Vector3f(-segment / length);
+    return true;
+}
+
+const vector<Vector3f> &CollisionSDF::vertices() const
+{
+    return m_vertices;
+}
+
+const vector<Vector3i> &CollisionSDF::faces() const
+{
+    return m_faces;
+}
+
+int CollisionSDF::coarseIndex(int x, int y, int z) const
+{
+    return (z * (m_bricks.y() + 1) + y) * (m_bricks.x() + 1) + x;
+}
+
+bool CollisionSDF::read(const string &path, uint64_t sourceHash, uint64_t sourceSize, int resolution, int bandCells)
+{
+    QFile file(QString::fromStdString(path));
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    QByteArray contents = file.readAll();
+    const char *data = contents.constData();
+    size_t size = contents.size();
+
+    FileHeader header;
+    if (size < sizeof(header)) {
+        return false;
+    }
+    memcpy(&header, data, sizeof(header));
+    if (memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION ||
+            header.sourceHash != sourceHash || header.sourceSize != sourceSize ||
+            header.resolution != resolution || header.bandCells != bandCells ||
+            header.bricks[0] <= 0 || header.bricks[1] <= 0 || header.bricks[2] <= 0 ||
+            header.numVertices < 0 || header.numFaces < 0 || header.numRefined < 0) {
+        return false;
+    }
+
+    size_t numBricks = size_t(header.bricks[0]) * header.bricks[1] * header.bricks[2];
+    size_t numCoarse = size_t(header.bricks[0] + 1) * (header.bricks[1] + 1) * (header.bricks[2] + 1);
+    size_t expected = sizeof(header) + 3 * sizeof(float) * header.numVertices + 3 * sizeof(int32_t) * header.numFaces +
+            sizeof(float) * numCoarse + sizeof(int32_t) * numBricks + sizeof(float) * SAMPLES_PER_BRICK * header.numRefined;
+    if (size != expected) {
+        return false;
+    }
+
+    m_origin = Vector3f(header.origin[0], header.origin[1], header.origin[2]);
+    m_cellSize = header.cellSize;
+    m_bricks = Vector3i(header.bricks[0], header.bricks[1], header.bricks[2]);
+    const char *p = data + sizeof(header);
+    m_vertices.resize(header.numVertices);
+    m_faces.resize(header.numFaces);
+    m_coarse.resize(numCoarse);
+    m_brickIndex.resize(numBricks);
+    m_fine.resize(size_t(SAMPLES_PER_BRICK) * header.numRefined);
+    for (Vector3f &v : m_vertices) {
+        memcpy(v.data(), p, 3 * sizeof(float));
+        p += 3 * sizeof(float);
+    }
+    for (Vector3i &f : m_faces) {
+        memcpy(f.data(), p, 3 * sizeof(int32_t));
+        p += 3 * sizeof(int32_t);
+    }
+    memcpy(m_coarse.data(), p, sizeof(float) * numCoarse);
+    p += sizeof(float) * numCoarse;
+    memcpy(m_brickIndex.data(), p, sizeof(int32_t) * numBricks);
+    p += sizeof(int32_t) * numBricks;
+    memcpy(m_fine.data(), p, sizeof(float) * m_fine.size());
+
+    m_bounds.setEmpty();
+    for (const Vector3f &v : m_vertices) {
+        m_bounds.extend(v);
+    }
+    for (int index : m_brickIndex) {
+        if (index < -1 || index >= header.numRefined) {
+            return false;
+        }
+    }
+    for (const Vector3i &f : m_faces) {
+        if ((f.array() < 0).any() || (f.array() >= header.numVertices).any()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool CollisionSDF::write(const string &path, uint64_t sourceHash, uint64_t sourceSize, int resolution, int bandCells) const
+{
+    FileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.resolution = resolution;
+    header.bandCells = bandCells;
+    header.numVertices = m_vertices.size();
+    header.numFaces = m_faces.size();
+    header.numRefined = m_fine.size() / SAMPLES_PER_BRICK;
+    header.sourceHash = sourceHash;
+    header.sourceSize = sourceSize;
+    for (int c = 0; c < 3; c++) {
+        header.origin[c] = m_origin[c];
+        header.bricks[c] = m_bricks[c];
+    }
+    header.cellSize = m_cellSize;
+
+    QSaveFile file(QString::fromStdString(path));
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+    bool ok = file.write(reinterpret_cast<const char *>(&header), sizeof(header)) == sizeof(header);
+    for (const Vector3f &v : m_vertices) {
+        ok = ok && file.write(reinterpret_cast<const char *>(v.data()), 3 * sizeof(float)) == 3 * sizeof(float);
+    }
+    for (const Vector3i &f : m_faces) {
+        ok = ok && file.write(reinterpret_cast<const char *>(f.data()), 3 * sizeof(int32_t)) == 3 * sizeof(int32_t);
+    }
+    qint64 coarseBytes = m_coarse.size() * sizeof(float);
+    qint64 indexBytes = m_brickIndex.size() * sizeof(int32_t);
+    qint64 fineBytes = m_fine.size() * sizeof(float);
+    ok = ok && file.write(reinterpret_cast<const char *>(m_coarse.data()), coarseBytes) == coarseBytes;
+    ok = ok && file.write(reinterpret_cast<const char *>(m_brickIndex.data()), indexBytes) == indexBytes;
+    ok = ok && file.write(reinterpret_cast<const char *>(m_fine.data()), fineBytes) == fineBytes;
+    if (!ok) {
+        file.cancelWriting();
+        file.commit();
+        return false;
+    }
+    return file.commit();
+}
@@ -0,0 +1,101 @@
+#ifndef COLLISIONSDF_H
+#define COLLISIONSDF_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "collisionobject.h"
+
+/**
+ * Static obstacle of any closed triangle surface, collided through a signed
+ * distance field sampled on a grid, negative inside.
+ *
+ * The grid has two levels. A dense coarse level stores the distance at the
+ * corners of bricks of BRICK_SIZE^3 cells. Bricks within the narrow band of
+ * the surface also store every fine sample, (BRICK_SIZE + 1)^3 of them so a
+ * cell never straddles two bricks. Queries interpolate trilinearly in a fine
+ * brick when there is one and in the coarse level otherwise.
+ */
+class CollisionSDF : public CollisionObject
+{
+public:
+    static const int BRICK_SIZE = 8;
+
+    CollisionSDF();
+
+    /**
+     * Samples the field of a closed, consistently oriented surface with fine
+     * cells of cellSize. Bricks are refined within bandCells fine cells of
+     * the surface.
+     */
+    void build(const vector<Vector3f> &vertices, const vector<Vector3i> &faces, float cellSize, int bandCells = 3);
+
+    /**
+     * Loads a field for the surface of meshPath (see
+     * MeshLoader::loadTriangleMesh) with resolution fine cells along its
+     * longest side. The field is cached in cachePath(meshPath) and rebuilt
+     * when the mesh or the parameters change.
+     */
+    bool load(const string &meshPath, int resolution = 64, int bandCells = 3);
+
+    static string cachePath(const string &meshPath);
+
+    /**
+     * Signed distance at point and its gradient. Points off the grid are
+     * clamped onto it.
+     */
+    float distance(const Vector3f &point, Vector3f &gradient) const;
+
+    /**
+     * Vector from point to the surface along the field's gradient if point
+     * is inside, otherwise zero.
+     */
+    Vector3f pointIntersection(Vector3f point) override;
+
+    void pointIntersections(const Vector3f *points, int count, Vector3f *out) override;
+
+    /**
+     * True if the box overlaps the bounds of the surface.
+     */
+    bool mayIntersect(const AlignedBox3f &box) const override;
+
+    /**
+     * Marches along the segment by the distance to the surface, in steps of
+     * at least half a fine cell, then bisects the first step that ends
+     * inside.
+     */
+    bool sweptIntersection(const Vector3f &start, const Vector3f &end, float &t, Vector3f &normal) override;
+
+    /** Vertices and faces of the surface, kept for drawing. */
+    const vector<Vector3f> &vertices() const;
+    const vector<Vector3i> &faces() const;
+
+private:
+    bool read(const string &path, uint64_t sourceHash, uint64_t sourceSize, int resolution, int bandCells);
+    bool write(const string &path, uint64_t sourceHash, uint64_t sourceSize, int resolution, int bandCells) const;
+
+    int coarseIndex(int x, int y, int z) const;
+
+    /** Grid origin and fine cell size. */
+    Vector3f m_origin;
+    float m_cellSize;
+
+    /** Number of bricks along each axis. */
+    Vector3i m_bricks;
+
+    AlignedBox3f m_bounds;
+
+    /** Distance at every brick corner. */
+    vector<float> m_coarse;
+
+    /** Index into m_fine of each brick's samples, or -1 if it has none. */
+    vector<int> m_brickIndex;
+
+    /** (BRICK_SIZE + 1)^3 samples per refined brick, x fastest. */
+    vector<float> m_fine;
+
+    vector<Vector3f> m_vertices;
+    vector<Vector3i> m_faces;
+};
+
+#endif // COLLISIONSDF_H
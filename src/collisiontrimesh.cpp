@@ -0,0 +1,191 @@
+#include "collisiontrimesh.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <unordered_map>
+
+#include "graphics/MeshLoader.h"
+#include "parallel.h"
+
+using namespace Eigen;
+using namespace std;
+
+namespace {
+
+inline uint64_t edgeKey(int a, int b)
+{
+    return (static_cast<uint64_t>(min(a, b)) << 32) | static_cast<uint32_t>(max(a, b));
+}
+
+}
+
+CollisionTriMesh::CollisionTriMesh()
+{
+    m_bounds.setEmpty();
+}
+
+void CollisionTriMesh::build(const vector<Vector3f> &vertices, const vector<Vector3i> &faces)
+{
+    m_vertices = vertices;
+    m_faces = faces;
+    m_bvh.build(faces, vertices);
+    m_bounds.setEmpty();
+    for (const Vector3f &v : vertices) {
+        m_bounds.extend(v);
+    }
+
+    // Pseudonormals (Baerentzen and Aanaes): faces use their own normal,
+    // edges the sum of the two faces' normals and vertices the sum of their
+    // faces' normals weighted by the angle at the vertex.
+    m_faceNormals.resize(faces.size());
+    m_vertexNormals.assign(vertices.size(), Vector3f::Zero());
+    unordered_map<uint64_t, Vector3f> edgeSums;
+    edgeSums.reserve(faces.size() * 2);
+    for (unsigned int f = 0; f < faces.size(); f++) {
+        const Vector3i &face = faces[f];
+        Vector3f normal = (vertices[face[1]] - vertices[face[0]]).cross(vertices[face[2]] - vertices[face[0]]);
+        normal = normal.norm() > 0 ? Vector3f(normal.normalized()) : Vector3f::Zero();
+        m_faceNormals[f] = normal;
+        for (int k = 0; k < 3; k++) {
+            Vector3f toNext = vertices[face[(k + 1) % 3]] - vertices[face[k]];
+            Vector3f toPrev = vertices[face[(k + 2) % 3]] - vertices[face[k]];
+            float denom = toNext.norm() * toPrev.norm();
+            float angle = denom > 0 ? acosf(max(-1.f, min(1.f, toNext.dot(toPrev) / denom))) : 0;
+            m_vertexNormals[face[k]] += angle * normal;
+
+            auto inserted = edgeSums.emplace(edgeKey(face[k], face[(k + 1) % 3]), normal);
+            if (!inserted.second) {
+                inserted.first->second += normal;
+            }
+        }
+    }
+    m_edgeNormals.resize(faces.size() * 3);
+    for (unsigned int f = 0; f < faces.size(); f++) {
+        for (int k = 0; k < 3; k++) {
+            m_edgeNormals[f * 3 + k] = edgeSums[edgeKey(faces[f][k], faces[f][(k + 1) % 3])];
+        }
+    }
+}
+
+bool CollisionTriMesh::load(const string &meshPath)
+{
+    vector<Vector3f> vertices;
+    vector<Vector3i> faces;
+    if (!MeshLoader::loadTriangleMesh(meshPath, vertices, faces) || faces.empty()) {
+        cout << "No surface to collide with in: " << meshPath << endl;
+        return false;
+    }
+    build(vertices, faces);
+    return true;
+}
+
+bool CollisionTriMesh::closestPoint(const Vector3f &point, Vector3f &closest, bool &inside) const
+{
+    int face;
+    float dist;
+    if (!m_bvh.closestPoint(point, numeric_limits<float>::max(), closest, face, dist)) {
+        return false;
+    }
+
+    // Barycentric coordinates of the closest point tell which feature it
+    // lies on: two zero coordinates is a vertex, one is an edge.
+    const Vector3i &f = m_faces[face];
+    const Vector3f &a = m_vertices[f[0]];
+    Vector3f ab = m_vertices[f[1]] - a;
+    Vector3f ac = m_vertices[f[2]] - a;
+    Vector3f aq = closest - a;
+    float d00 = ab.dot(ab);
+    float d01 = ab.dot(ac);
+    float d11 = ac.dot(ac);
+    float d20 = aq.dot(ab);
+    float d21 = aq.dot(ac);
+    float denom = d00 * d11 - d01 * d01;
+    float v = denom != 0 ? (d11 * d20 - d01 * d21) / denom : 0;
+    float w = denom != 0 ? (d00 * d21 - d01 * d20) / denom : 0;
+    float u = 1 - v - w;
+
+    const float EPSILON = 1e-5f;
+    bool onEdge[3] = { w <= EPSILON, u <= EPSILON, v <= EPSILON };
+    Vector3f normal;
+    if (onEdge[2] && onEdge[0]) {
+        normal = m_vertexNormals[f[0]];
+    } else if (onEdge[0] && onEdge[1]) {
+        normal = m_vertexNormals[f[1]];
+    } else if (onEdge[1] && onEdge[2]) {
+        normal = m_vertexNormals[f[2]];
+    } else if (onEdge[0]) {
+        normal = m_edgeNormals[face * 3];
+    } else if (onEdge[1]) {
+        normal = m_edgeNormals[face * 3 + 1];
+    } else if (onEdge[2]) {
+        normal = m_edgeNormals[face * 3 + 2];
+    } else {
+        normal = m_faceNormals[face];
+    }
+    inside = (point - closest).dot(normal) < 0;
+    return true;
+}
+
+Vector3f CollisionTriMesh::penetration(const Vector3f &point) const
+{
+    // Points outside the bounds are outside a closed mesh, and skipping them
+    // saves a full closest point search.
+    Vector3f closest;
+    bool inside;
+    if (!m_bounds.contains(point) || !closestPoint(point, closest, inside) || !inside) {
+        return Vector3f::Zero();
+    }
+    return closest - point;
+}
+
+Vector3f CollisionTriMesh::pointIntersection(Vector3f point)
+{
+    return penetration(point);
+}
+
+void CollisionTriMesh::pointIntersections(const Vector3f *points, int count, Vector3f *out)
+{
+    Parallel::forRange(0, count, PARALLEL_GRAIN, [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            out[i] = penetration(points[i]);
+        }
+    });
+}
+
+bool CollisionTriMesh::mayIntersect(const AlignedBox3f &box) const
+{
+    return !m_faces.empty() && m_bounds.intersects(box);
+}
+
+bool CollisionTriMesh::sweptIntersection(const Vector3f &start, const Vector3f &end, float &t, Vector3f &normal)
+{
+    // Cast with a unit direction so the ray test's tolerances are in world
+    // units whatever the step length.
+    Vector3f segment = end - start;
+    float length = segment.norm();
+    if (length == 0) {
+        return false;
+    }
+    Vector3f direction = segment / length;
+    int face;
+    float dist;
+    if (!m_bvh.intersect(start, direction, face, dist) || dist > length
+            || m_faceNormals[face].dot(direction) >= 0) {
+        return false;
+    }
+    t = dist / length;
+    normal = m_faceNormals[face];
+    return true;
+}
+
+const vector<Vector3f> &CollisionTriMesh::vertices() const
+{
+    return m_vertices;
+}
+
+const vector<Vector3i> &CollisionTriMesh::faces() const
+{
+    return m_faces;
+}
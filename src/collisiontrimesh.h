@@ -0,0 +1,77 @@
+#ifndef COLLISIONTRIMESH_H
+#define COLLISIONTRIMESH_H
+
+#include <string>
+#include <vector>
+#include "collisionobject.h"
+#include "surfacebvh.h"
+
+/**
+ * Static obstacle of a closed triangle mesh with outward facing (counter
+ * clockwise) faces, collided exactly against its triangles through a BVH.
+ * Whether a point is inside is decided by the angle weighted pseudonormal of
+ * the closest feature (face, edge or vertex), which is exact for closed
+ * manifold meshes.
+ */
+class CollisionTriMesh : public CollisionObject
+{
+public:
+    /** Below this many points a batch isn't worth splitting across threads. */
+    static const int PARALLEL_GRAIN = 256;
+
+    CollisionTriMesh();
+
+    void build(const vector<Vector3f> &vertices, const vector<Vector3i> &faces);
+
+    /**
+     * Loads the surface of meshPath, see MeshLoader::loadTriangleMesh.
+     */
+    bool load(const string &meshPath);
+
+    /**
+     * Finds the point on the mesh closest to point and whether point is
+     * inside the mesh. Returns false only for an empty mesh.
+     */
+    bool closestPoint(const Vector3f &point, Vector3f &closest, bool &inside) const;
+
+    /**
+     * Vector from point to the closest point on the mesh if point is inside,
+     * otherwise zero.
+     */
+    Vector3f pointIntersection(Vector3f point) override;
+
+    /**
+     * Answers the whole batch at once, split across threads for large ones.
+     */
+    void pointIntersections(const Vector3f *points, int count, Vector3f *out) override;
+
+    /**
+     * True if the box overlaps the bounds of the mesh.
+     */
+    bool mayIntersect(const AlignedBox3f &box) const override;
+
+    /**
+     * Casts the segment against the BVH. Only a front face counts as
+     * entering; a back face first means the segment started inside.
+     */
+    bool sweptIntersection(const Vector3f &start, const Vector3f &end, float &t, Vector3f &normal) override;
+
+    const vector<Vector3f> &vertices() const;
+    const vector<Vector3i> &faces() const;
+
+private:
+    Vector3f penetration(const Vector3f &point) const;
+
+    vector<Vector3f> m_vertices;
+    vector<Vector3i> m_faces;
+    SurfaceBVH m_bvh;
+    AlignedBox3f m_bounds;
+
+    vector<Vector3f> m_faceNormals;
+    vector<Vector3f> m_vertexNormals;
+
+    /** Three per face; edge k runs from corner k to corner k + 1. */
+    vector<Vector3f> m_edgeNormals;
+};
+
+#endif // COLLISIONTRIMESH_H
@@ -0,0 +1,235 @@
+#include "domain.h"
+
+#include <algorithm>
+#include <iostream>
+
+#include "surfaceextractor.h"
+
+using namespace Eigen;
+using namespace std;
+
+namespace {
+
+/** Adds value to a short sorted list if it isn't there yet. */
+void insertSorted(vector<int> &list, int value)
+{
+    auto at = lower_bound(list.begin(), list.end(), value);
+    if (at == list.end() || *at != value) {
+        list.insert(at, value);
+    }
+}
+
+}
+
+Domain::Domain():
+    m_rank(0),
+    m_numRanks(1),
+    m_numTets(0),
+    m_numGhosts(0)
+{
+}
+
+bool Domain::init(const BinaryMesh &mesh, const vector<int> &tetParts, int numRanks, int rank)
+{
+    if (!mesh.hasRestData() || !mesh.hasMasses()) {
+        cerr << "Error: splitting a mesh needs its rest data and masses" << endl;
+        return false;
+    }
+    m_rank = rank;
+    m_numRanks = numRanks;
+
+    vector<Vector3f> vertices;
+    vector<Vector4i> tets;
+    vector<Vector3i> faces;
+    mesh.copyVertices(vertices);
+    mesh.copyTets(tets);
+    if (mesh.hasFaces()) {
+        mesh.copyFaces(faces);
+    } else {
+        faces = SurfaceExtractor::extractSurface(tets);
+    }
+    const int numVertices = vertices.size();
+
+    // A particle belongs to the part holding most of its tets, the lowest
+    // such part on a tie, so parts own particles in about the ratio they
+    // hold tets. Particles in no tet go to rank 0, which steps them alone.
+    vector<int> counts(numVertices * numRanks, 0);
+    for (unsigned int t = 0; t < tets.size(); t++) {
+        for (int k = 0; k < 4; k++) {
+            counts[tets[t][k] * numRanks + tetParts[t]]++;
+        }
+    }
+    m_owners.assign(numVertices, 0);
+    for (int i = 0; i < numVertices; i++) {
+        const int *count = &counts[i * numRanks];
+        m_owners[i] = max_element(count, count + numRanks) - count;
+    }
+
+    // A tet is simulated by the owner of each of its particles, so every
+    // rank that simulates it holds all four of its particles.
+    vector<vector<int>> holders(numVertices);
+    for (int i = 0; i < numVertices; i++) {
+        holders[i].push_back(m_owners[i]);
+    }
+    vector<int> localTets;
+    for (unsigned int t = 0; t < tets.size(); t++) {
+        const Vector4i &tet = tets[t];
+        for (int k = 0; k < 4; k++) {
+            int owner = m_owners[tet[k]];
+            for (int j = 0; j < 4; j++) {
+                insertSorted(holders[tet[j]], owner);
+            }
+        }
+        if (m_owners[tet[0]] == rank || m_owners[tet[1]] == rank || m_owners[tet[2]] == rank || m_owners[tet[3]] == rank) {
+            localTets.push_back(t);
+        }
+    }
+
+    // Local particles keep the full mesh's order, so local tets sum their
+    // forces in the same order.
+    vector<int> localIndex(numVertices, -1);
+    m_globalIds.clear();
+    m_owned.clear();
+    for (int i = 0; i < numVertices; i++) {
+        if (binary_search(holders[i].begin(), holders[i].end(), rank)) {
+            localIndex[i] = m_globalIds.size();
+            if (m_owners[i] == rank) {
+                m_owned.push_back(m_globalIds.size());
+            }
+            m_globalIds.push_back(i);
+        }
+    }
+    m_numGhosts = m_globalIds.size() - m_owned.size();
+    m_numTets = localTets.size();
+
+    // Both sides of a pair list the particles between them in increasing
+    // order, so the forces line up without sending indices.
+    m_peers.clear();
+    for (int peer = 0; peer < numRanks; peer++) {
+        if (peer == rank) {
+            continue;
+        }
+        Peer p;
+        p.rank = peer;
+        for (int i : m_globalIds) {
+            bool shared = binary_search(holders[i].begin(), holders[i].end(), peer);
+            if (shared && m_owners[i] == rank) {
+                p.send.push_back(localIndex[i]);
+            } else if (shared && m_owners[i] == peer) {
+                p.receive.push_back(localIndex[i]);
+            }
+        }
+        if (!p.send.empty() || !p.receive.empty()) {
+            p.sendBuffer.resize(p.send.size() * 3);
+            p.receiveBuffer.resize(p.receive.size() * 3);
+            m_peers.push_back(p);
+        }
+    }
+
+    // The part as a mesh of its own. Surface faces whose corners are all
+    // local come along, so owned particles on the surface still collide.
+    // Its particles map back through m_globalIds, so it has no external ids,
+    // which would point past its own particles.
+    vector<Vector3f> partVertices;
+    vector<float> partMasses;
+    for (int i : m_globalIds) {
+        partVertices.push_back(vertices[i]);
+        partMasses.push_back(mesh.masses()[i]);
+    }
+    const int restStride = mesh.restStride();
+    vector<Vector4i> partTets;
+    vector<float> partRest;
+    for (int t : localTets) {
+        const Vector4i &tet = tets[t];
+        partTets.push_back(Vector4i(localIndex[tet[0]], localIndex[tet[1]], localIndex[tet[2]], localIndex[tet[3]]));
+        partRest.insert(partRest.end(), mesh.restData() + t * restStride, mesh.restData() + (t + 1) * restStride);
+    }
+    vector<Vector3i> partFaces;
+    for (const Vector3i &face : faces) {
+        if (localIndex[face[0]] >= 0 && localIndex[face[1]] >= 0 && localIndex[face[2]] >= 0) {
+            partFaces.push_back(Vector3i(localIndex[face[0]], localIndex[face[1]], localIndex[face[2]]));
+        }
+    }
+    vector<char> encoded = BinaryMesh::encode(partVertices, partTets, partFaces, partRest, restStride, partMasses, vector<int>());
+    return m_mesh.view(move(encoded));
+}
+
+const BinaryMesh &Domain::mesh() const
+{
+    return m_mesh;
+}
+
+int Domain::numTets() const
+{
+    return m_numTets;
+}
+
+int Domain::numParticles() const
+{
+    return m_globalIds.size();
+}
+
+int Domain::numGhosts() const
+{
+    return m_numGhosts;
+}
+
+bool Domain::exchangeForces(System &system, Transport &transport)
+{
+    // Peers are in increasing rank order, which Transport::exchange needs.
+    for (Peer &peer : m_peers) {
+        for (unsigned int k = 0; k < peer.send.size(); k++) {
+            Vector3f force = system.getParticle(peer.send[k])->getForce();
+            copy(force.data(), force.data() + 3, &peer.sendBuffer[k * 3]);
+        }
+        if (!transport.exchange(peer.rank, peer.sendBuffer.data(), peer.sendBuffer.size() * sizeof(float),
+                                peer.receiveBuffer.data(), peer.receiveBuffer.size() * sizeof(float))) {
+            return false;
+        }
+        for (unsigned int k = 0; k < peer.receive.size(); k++) {
+            system.getParticle(peer.receive[k])->setForce(Map<const Vector3f>(&peer.receiveBuffer[k * 3]));
+        }
+    }
+    return true;
+}
+
+bool Domain::gather(const vector<Vector3f> &vertices, System &system, Transport &transport,
+                    vector<Vector3f> &positions, vector<Vector3f> &velocities)
+{
+    // Each rank sends its owned particles in increasing order, a position
+    // and velocity each, which rank 0 can list from the owners alone.
+    if (m_rank != 0) {
+        vector<float> states;
+        states.reserve(m_owned.size() * 6);
+        for (int i : m_owned) {
+            Vector3f velocity = system.getParticle(i)->getVelocity();
+            states.insert(states.end(), vertices[i].data(), vertices[i].data() + 3);
+            states.insert(states.end(), velocity.data(), velocity.data() + 3);
+        }
+        return transport.send(0, states.data(), states.size() * sizeof(float));
+    }
+
+    positions.resize(m_owners.size());
+    velocities.resize(m_owners.size());
+    for (int i : m_owned) {
+        positions[m_globalIds[i]] = vertices[i];
+        velocities[m_globalIds[i]] = system.getParticle(i)->getVelocity();
+    }
+    for (int peer = 1; peer < m_numRanks; peer++) {
+        vector<int> owned;
+        for (unsigned int i = 0; i < m_owners.size(); i++) {
+            if (m_owners[i] == peer) {
+                owned.push_back(i);
+            }
+        }
+        vector<float> states(owned.size() * 6);
+        if (!transport.receive(peer, states.data(), states.size() * sizeof(float))) {
+            return false;
+        }
+        for (unsigned int k = 0; k < owned.size(); k++) {
+            positions[owned[k]] = Map<const Vector3f>(&states[k * 6]);
+            velocities[owned[k]] = Map<const Vector3f>(&states[k * 6 + 3]);
+        }
+    }
+    return true;
+}
@@ -0,0 +1,87 @@
+#ifndef DOMAIN_H
+#define DOMAIN_H
+
+#include <vector>
+#include "graphics/BinaryMesh.h"
+#include "system.h"
+#include "transport.h"
+
+/**
+ * One rank's share of a mesh split into parts, one per rank, for a run
+ * spread over processes.
+ *
+ * Each particle is owned by the rank whose part holds most of the tets
+ * it belongs to. A rank simulates every tet touching a particle it owns, so
+ * the forces on its own particles are summed from the same tets, in the
+ * same order, as in a single process. The other particles of those tets
+ * are ghosts. Their forces would be missing the tets of other ranks, so
+ * every evaluation their owners send the full forces and the ghosts take
+ * them, and then step exactly as their owners do. Ghosts never need their
+ * positions sent.
+ *
+ * The mesh has to have the rest data and masses MeshCache::load fills in,
+ * since a part's tets alone would give ghosts the wrong masses.
+ */
+class Domain
+{
+public:
+    Domain();
+
+    /**
+     * Sets up rank's share of mesh, where tetParts gives each tet's part
+     * from 0 to numRanks - 1, such as from MeshPartition. Every rank has to
+     * be given the same mesh and parts. Returns false and prints why if the
+     * mesh lacks rest data or masses.
+     */
+    bool init(const BinaryMesh &mesh, const std::vector<int> &tetParts, int numRanks, int rank);
+
+    /** The rank's particles and tets as a mesh of their own, to set up a Scene from. */
+    const BinaryMesh &mesh() const;
+
+    int numTets() const;
+    int numParticles() const;
+    int numGhosts() const;
+
+    /**
+     * Sends the forces on owned particles that other ranks hold as ghosts
+     * and gives the ghosts their owners' forces. Returns false if the run
+     * was aborted.
+     */
+    bool exchangeForces(System &system, Transport &transport);
+
+    /**
+     * Collects every particle's position in mesh space, from vertices, and
+     * velocity, from system, in the full mesh's numbering on rank 0, which
+     * fills positions and velocities. Other ranks send theirs and leave
+     * them alone. Returns false if the run was aborted.
+     */
+    bool gather(const std::vector<Eigen::Vector3f> &vertices, System &system, Transport &transport,
+                std::vector<Eigen::Vector3f> &positions, std::vector<Eigen::Vector3f> &velocities);
+
+private:
+    /** A rank this one shares particles with, and the local particles each way. */
+    struct Peer
+    {
+        int rank;
+        std::vector<int> send;
+        std::vector<int> receive;
+        std::vector<float> sendBuffer;
+        std::vector<float> receiveBuffer;
+    };
+
+    int m_rank;
+    int m_numRanks;
+    BinaryMesh m_mesh;
+    int m_numTets;
+
+    /** Full mesh index of each local particle, in increasing order. */
+    std::vector<int> m_globalIds;
+    std::vector<int> m_owned;
+    int m_numGhosts;
+    std::vector<Peer> m_peers;
+
+    /** Owning rank of every particle of the full mesh, for gather. */
+    std::vector<int> m_owners;
+};
+
+#endif // DOMAIN_H
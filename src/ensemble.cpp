@@ -0,0 +1,453 @@
+#include "ensemble.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "graphics/BinaryMesh.h"
+#include "parallel.h"
+#include "scene.h"
+#include "settings.h"
+#include "surfaceextractor.h"
+#include "tet.h"
+
+using namespace Eigen;
+using namespace std;
+
+namespace {
+
+const int LANES = Ensemble::LANES;
+
+// The same force per unit of penetration and gravity as Solver.
+const float COLLISION_PENALTY = 100;
+const float GRAVITY = -1;
+
+// Floats of rest data per tet: beta, then the four face normals, then the
+// four face areas.
+const int REST_FLOATS = 25;
+
+// Smallest share of tets and of particles handed to one thread at a time.
+// Each carries every lane, so fewer than Solver's.
+const int TET_GRAIN = 32;
+const int PARTICLE_GRAIN = 128;
+
+Parallel::Stage forcesStage("ensemble forces");
+Parallel::Stage collisionStage("ensemble collision");
+Parallel::Stage integrationStage("ensemble integration");
+
+/**
+ * Tet::nodeForces written out per coefficient, for every lane of one tet
+ * at once. Every lane reads the same nodes and rest data, so the lane loop
+ * is straight line code over contiguous rows. Writes the forces on the four
+ * nodes as rows of lanes, node by node, x, y and z. The arrays are taken as
+ * restrict parameters so the compiler knows the output aliases none of
+ * them, which it can't tell of members.
+ */
+void tetLanes(const float *__restrict position, const float *__restrict velocity, const Vector4i &tet,
+              const float *__restrict rest, const float *__restrict incompressibility,
+              const float *__restrict rigidity, const float *__restrict phi, const float *__restrict psi,
+              float *__restrict out)
+{
+    const float *beta = rest;
+    const float *normals = rest + 9;
+    const float *areas = rest + 21;
+    // Each node's rows of x, y and z.
+    const float *x0 = position + tet[0] * 3 * LANES;
+    const float *x1 = position + tet[1] * 3 * LANES;
+    const float *x2 = position + tet[2] * 3 * LANES;
+    const float *x3 = position + tet[3] * 3 * LANES;
+    const float *v0 = velocity + tet[0] * 3 * LANES;
+    const float *v1 = velocity + tet[1] * 3 * LANES;
+    const float *v2 = velocity + tet[2] * 3 * LANES;
+    const float *v3 = velocity + tet[3] * 3 * LANES;
+
+    for (int l = 0; l < LANES; l++) {
+        // Deformation and velocity gradients, P * beta and V * beta.
+        float F[3][3];
+        float G[3][3];
+        for (int r = 0; r < 3; r++) {
+            const int at = r * LANES + l;
+            const float p[3] = { x0[at] - x3[at], x1[at] - x3[at], x2[at] - x3[at] };
+            const float q[3] = { v0[at] - v3[at], v1[at] - v3[at], v2[at] - v3[at] };
+            for (int c = 0; c < 3; c++) {
+                F[r][c] = p[0] * beta[c * 3] + p[1] * beta[c * 3 + 1] + p[2] * beta[c * 3 + 2];
+                G[r][c] = q[0] * beta[c * 3] + q[1] * beta[c * 3 + 1] + q[2] * beta[c * 3 + 2];
+            }
+        }
+
+        // Green's strain and the strain rate.
+        float strain[3][3];
+        float rate[3][3];
+        for (int a = 0; a < 3; a++) {
+            for (int b = 0; b < 3; b++) {
+                strain[a][b] = F[0][a] * F[0][b] + F[1][a] * F[1][b] + F[2][a] * F[2][b] - (a == b ? 1 : 0);
+                rate[a][b] = (F[0][a] * G[0][b] + F[1][a] * G[1][b] + F[2][a] * G[2][b])
+                           + (G[0][a] * F[0][b] + G[1][a] * F[1][b] + G[2][a] * F[2][b]);
+            }
+        }
+        const float strainTrace = strain[0][0] + strain[1][1] + strain[2][2];
+        const float rateTrace = rate[0][0] + rate[1][1] + rate[2][2];
+
+        float stress[3][3];
+        for (int a = 0; a < 3; a++) {
+            for (int b = 0; b < 3; b++) {
+                float elastic = (a == b ? incompressibility[l] * strainTrace : 0) + 2 * rigidity[l] * strain[a][b];
+                float viscous = (a == b ? phi[l] * rateTrace : 0) + 2 * psi[l] * rate[a][b];
+                stress[a][b] = elastic + viscous;
+            }
+        }
+
+        // F * stress * area * normal for each node's opposite face.
+        float M[3][3];
+        for (int r = 0; r < 3; r++) {
+            for (int c = 0; c < 3; c++) {
+                M[r][c] = F[r][0] * stress[0][c] + F[r][1] * stress[1][c] + F[r][2] * stress[2][c];
+            }
+        }
+        for (int k = 0; k < 4; k++) {
+            const float *n = normals + k * 3;
+            for (int r = 0; r < 3; r++) {
+                out[(k * 3 + r) * LANES + l] = M[r][0] * areas[k] * n[0] + M[r][1] * areas[k] * n[1]
+                                             + M[r][2] * areas[k] * n[2];
+            }
+        }
+    }
+}
+
+/**
+ * The first half of the midpoint step for particles [begin, end): half a
+ * velocity onto positions, half a step of acceleration onto velocities.
+ */
+void halfStep(float *__restrict position, float *__restrict velocity, const float *__restrict force,
+              const float *__restrict mass, int begin, int end, float seconds)
+{
+    for (int i = begin; i < end; i++) {
+        for (int c = 0; c < 3; c++) {
+            for (int l = 0; l < LANES; l++) {
+                const int at = (i * 3 + c) * LANES + l;
+                position[at] += velocity[at] * 0.5f;
+                velocity[at] += force[at] / mass[i * LANES + l] * 0.5f * seconds;
+            }
+        }
+    }
+}
+
+/** The end of the midpoint step, from the start of the step and the midpoint. */
+void fullStep(float *__restrict position, float *__restrict velocity, const float *__restrict force,
+              const float *__restrict mass, const float *__restrict startPosition,
+              const float *__restrict startVelocity, int begin, int end, float seconds)
+{
+    for (int i = begin; i < end; i++) {
+        for (int c = 0; c < 3; c++) {
+            for (int l = 0; l < LANES; l++) {
+                const int at = (i * 3 + c) * LANES + l;
+                position[at] = startPosition[at] + velocity[at];
+                velocity[at] = startVelocity[at] + seconds * (force[at] / mass[i * LANES + l]);
+            }
+        }
+    }
+}
+
+}
+
+Ensemble::Ensemble():
+    m_numParticles(0)
+{
+    for (int l = 0; l < LANES; l++) {
+        m_incompressibility[l] = incompressibility;
+        m_rigidity[l] = rigidity;
+        m_phi[l] = phi;
+        m_psi[l] = psi;
+        m_density[l] = density;
+    }
+}
+
+bool Ensemble::init(const BinaryMesh &binary, const ColliderSet &colliders)
+{
+    vector<Vector3f> vertices;
+    binary.copyVertices(vertices);
+    binary.copyTets(m_tets);
+    vector<Vector3i> faces;
+    if (binary.hasFaces()) {
+        binary.copyFaces(faces);
+    } else {
+        faces = SurfaceExtractor::extractSurface(m_tets);
+    }
+
+    m_numParticles = vertices.size();
+    m_restPositions.resize(m_numParticles);
+    for (int i = 0; i < m_numParticles; i++) {
+        m_restPositions[i] = vertices[i] + shapeTranslation.vector();
+    }
+
+    // Like Scene, rest data and masses come from the mesh when it has both,
+    // and are worked out from the rest shape otherwise.
+    const float *masses = binary.masses();
+    const float *restData = binary.restStride() == TetRestData::NUM_FLOATS ? binary.restData() : nullptr;
+    const bool precomputed = restData && masses;
+    m_unitMasses.assign(m_numParticles, 0);
+    if (precomputed) {
+        copy(masses, masses + m_numParticles, m_unitMasses.begin());
+    }
+    m_rest.resize(m_tets.size() * REST_FLOATS);
+    for (unsigned int t = 0; t < m_tets.size(); t++) {
+        const Vector4i &tet = m_tets[t];
+        TetRestData rest = precomputed
+            ? TetRestData::fromFloats(restData + t * TetRestData::NUM_FLOATS)
+            : TetRestData::compute(m_restPositions[tet[0]], m_restPositions[tet[1]],
+                                   m_restPositions[tet[2]], m_restPositions[tet[3]]);
+        float *out = &m_rest[t * REST_FLOATS];
+        Map<Matrix3f> betaOut(out);
+        betaOut = rest.beta;
+        for (int k = 0; k < 4; k++) {
+            Map<Vector3f> normalOut(out + 9 + k * 3);
+            normalOut = rest.normals[k];
+            out[21 + k] = rest.areas[k];
+            if (!precomputed) {
+                m_unitMasses[tet[k]] += rest.volume / 4.f;
+            }
+        }
+    }
+
+    vector<bool> onSurface(m_numParticles, false);
+    for (const Vector3i &face : faces) {
+        onSurface[face[0]] = onSurface[face[1]] = onSurface[face[2]] = true;
+    }
+    m_surface.clear();
+    for (int i = 0; i < m_numParticles; i++) {
+        if (onSurface[i]) {
+            m_surface.push_back(i);
+        }
+    }
+    m_colliders = colliders;
+
+    m_position.resize(m_numParticles * 3 * LANES);
+    m_velocity.resize(m_numParticles * 3 * LANES);
+    m_force.resize(m_numParticles * 3 * LANES);
+    m_mass.resize(m_numParticles * LANES);
+    m_tetForces.resize(m_tets.size() * 4 * 3 * LANES);
+    for (int l = 0; l < LANES; l++) {
+        setMaterial(l, m_incompressibility[l], m_rigidity[l], m_phi[l], m_psi[l], m_density[l]);
+    }
+    return m_numParticles > 0;
+}
+
+void Ensemble::setMaterial(int lane, float incompressibility, float rigidity, float phi, float psi, float density)
+{
+    m_incompressibility[lane] = incompressibility;
+    m_rigidity[lane] = rigidity;
+    m_phi[lane] = phi;
+    m_psi[lane] = psi;
+    m_density[lane] = density;
+    for (int i = 0; i < m_numParticles; i++) {
+        m_mass[i * LANES + lane] = 1 + density * m_unitMasses[i];
+    }
+    resetLane(lane);
+}
+
+void Ensemble::resetLane(int lane)
+{
+    for (int i = 0; i < m_numParticles; i++) {
+        for (int c = 0; c < 3; c++) {
+            m_position[row(i, c) + lane] = m_restPositions[i][c];
+            m_velocity[row(i, c) + lane] = 0;
+        }
+    }
+}
+
+void Ensemble::update(float seconds)
+{
+    // The same midpoint step as Solver::midpointStep, quirks included: the
+    // half step moves positions by half a velocity, not half a step of it,
+    // and the full step by the midpoint velocity.
+    {
+        Parallel::StageTimer timer(integrationStage);
+        m_startPosition = m_position;
+        m_startVelocity = m_velocity;
+    }
+
+    evaluate();
+
+    {
+        Parallel::StageTimer timer(integrationStage);
+        Parallel::forRange(0, m_numParticles, PARTICLE_GRAIN, [&](int begin, int end) {
+            halfStep(m_position.data(), m_velocity.data(), m_force.data(), m_mass.data(), begin, end, seconds);
+        });
+    }
+
+    evaluate();
+
+    Parallel::StageTimer timer(integrationStage);
+    Parallel::forRange(0, m_numParticles, PARTICLE_GRAIN, [&](int begin, int end) {
+        fullStep(m_position.data(), m_velocity.data(), m_force.data(), m_mass.data(), m_startPosition.data(),
+                 m_startVelocity.data(), begin, end, seconds);
+    });
+}
+
+void Ensemble::evaluate()
+{
+    // The stages run as a graph, as in Solver::derivEval: forces start from
+    // gravity, collisions add to them, and the tets, worked out alongside,
+    // are added last in tet order.
+    Parallel::TaskGraph graph;
+    int external = graph.add(forcesStage, [&]() {
+        for (int i = 0; i < m_numParticles; i++) {
+            fill_n(&m_force[row(i, 0)], LANES, 0.f);
+            fill_n(&m_force[row(i, 1)], LANES, GRAVITY);
+            fill_n(&m_force[row(i, 2)], LANES, 0.f);
+        }
+    });
+    int collisions = graph.add(collisionStage, [&]() {
+        collide(COLLISION_PENALTY);
+        for (unsigned int s = 0; s < m_surface.size(); s++) {
+            for (int c = 0; c < 3; c++) {
+                float *force = &m_force[row(m_surface[s], c)];
+                const float *penalty = &m_collisionForces[c][s * LANES];
+                for (int l = 0; l < LANES; l++) {
+                    force[l] += penalty[l];
+                }
+            }
+        }
+    }, { external });
+    int elastic = graph.add(forcesStage, [&]() {
+        Parallel::forRange(0, m_tets.size(), TET_GRAIN, [&](int begin, int end) {
+            tetForces(begin, end);
+        });
+    });
+    graph.add(forcesStage, [&]() {
+        for (unsigned int t = 0; t < m_tets.size(); t++) {
+            for (int k = 0; k < 4; k++) {
+                for (int c = 0; c < 3; c++) {
+                    float *force = &m_force[row(m_tets[t][k], c)];
+                    const float *tetForce = &m_tetForces[((t * 4 + k) * 3 + c) * LANES];
+                    for (int l = 0; l < LANES; l++) {
+                        force[l] += tetForce[l];
+                    }
+                }
+            }
+        }
+    }, { collisions, elastic });
+    graph.run();
+}
+
+void Ensemble::tetForces(int begin, int end)
+{
+    for (int t = begin; t < end; t++) {
+        tetLanes(m_position.data(), m_velocity.data(), m_tets[t], &m_rest[t * REST_FLOATS], m_incompressibility,
+                 m_rigidity, m_phi, m_psi, &m_tetForces[t * 4 * 3 * LANES]);
+    }
+}
+
+void Ensemble::collide(float penalty)
+{
+    // As Solver::applyColliders, with a point for each surface particle in
+    // each lane. A particle's lanes are next to each other, so the broad
+    // phase's clusters are a few particles across every lane.
+    const int count = m_surface.size() * LANES;
+    m_collisionPositions.resize(count);
+    for (int k = 0; k < 3; k++) {
+        m_collisionCoordinates[k].resize(count);
+        m_collisionForces[k].assign(count, 0);
+    }
+    for (unsigned int s = 0; s < m_surface.size(); s++) {
+        for (int c = 0; c < 3; c++) {
+            copy_n(&m_position[row(m_surface[s], c)], LANES, &m_collisionCoordinates[c][s * LANES]);
+        }
+    }
+    for (int i = 0; i < count; i++) {
+        m_collisionPositions[i] = Vector3f(m_collisionCoordinates[0][i], m_collisionCoordinates[1][i],
+                                           m_collisionCoordinates[2][i]);
+    }
+
+    const vector<shared_ptr<CollisionObject>> &colliders = m_colliders.others();
+    m_broadPhase.update(m_collisionPositions, colliders);
+    m_colliders.addPenalties(m_broadPhase, m_collisionCoordinates[0].data(), m_collisionCoordinates[1].data(),
+                             m_collisionCoordinates[2].data(), penalty, m_collisionForces[0].data(),
+                             m_collisionForces[1].data(), m_collisionForces[2].data());
+
+    for (unsigned int k = 0; k < colliders.size(); k++) {
+        const vector<int> &clusters = m_broadPhase.clusters(k);
+        if (clusters.empty()) {
+            continue;
+        }
+        m_queryIndices.clear();
+        m_queryPositions.clear();
+        for (int c : clusters) {
+            for (int i = m_broadPhase.clusterBegin(c); i < m_broadPhase.clusterEnd(c); i++) {
+                m_queryIndices.push_back(i);
+                m_queryPositions.push_back(m_collisionPositions[i]);
+            }
+        }
+        m_penetrations.resize(m_queryPositions.size());
+        colliders[k]->pointIntersections(m_queryPositions.data(), m_queryPositions.size(), m_penetrations.data());
+        for (unsigned int q = 0; q < m_penetrations.size(); q++) {
+            for (int c = 0; c < 3; c++) {
+                m_collisionForces[c][m_queryIndices[q]] += m_penetrations[q][c] * penalty;
+            }
+        }
+    }
+}
+
+int Ensemble::numParticles() const
+{
+    return m_numParticles;
+}
+
+Vector3f Ensemble::position(int lane, int particle) const
+{
+    return Vector3f(m_position[row(particle, 0) + lane], m_position[row(particle, 1) + lane],
+                    m_position[row(particle, 2) + lane]);
+}
+
+void Ensemble::bounds(AlignedBox3f boxes[LANES]) const
+{
+    // Non finite coordinates would be skipped by the comparisons, so they
+    // are summed apart, times zero, and leave a lane's box NaN.
+    float low[3][LANES];
+    float high[3][LANES];
+    float finite[LANES];
+    for (int c = 0; c < 3; c++) {
+        fill_n(low[c], LANES, INFINITY);
+        fill_n(high[c], LANES, -INFINITY);
+    }
+    fill_n(finite, LANES, 0.f);
+    for (int i = 0; i < m_numParticles; i++) {
+        for (int c = 0; c < 3; c++) {
+            const float *position = &m_position[row(i, c)];
+            for (int l = 0; l < LANES; l++) {
+                low[c][l] = min(low[c][l], position[l]);
+                high[c][l] = max(high[c][l], position[l]);
+                finite[l] += position[l] * 0;
+            }
+        }
+    }
+    for (int l = 0; l < LANES; l++) {
+        boxes[l].min() = Vector3f(low[0][l], low[1][l], low[2][l]) + Vector3f::Constant(finite[l]);
+        boxes[l].max() = Vector3f(high[0][l], high[1][l], high[2][l]) + Vector3f::Constant(finite[l]);
+    }
+}
+
+void Ensemble::kineticEnergies(double energies[LANES]) const
+{
+    fill_n(energies, LANES, 0.0);
+    for (int i = 0; i < m_numParticles; i++) {
+        for (int l = 0; l < LANES; l++) {
+            float speed2 = 0;
+            for (int c = 0; c < 3; c++) {
+                speed2 += m_velocity[row(i, c) + l] * m_velocity[row(i, c) + l];
+            }
+            energies[l] += 0.5 * m_mass[i * LANES + l] * speed2;
+        }
+    }
+}
+
+void Ensemble::touching(bool touching[LANES])
+{
+    // Any penalty at all means a point is inside a collider.
+    collide(1);
+    fill_n(touching, LANES, false);
+    for (unsigned int i = 0; i < m_surface.size() * LANES; i++) {
+        if (m_collisionForces[0][i] != 0 || m_collisionForces[1][i] != 0 || m_collisionForces[2][i] != 0) {
+            touching[i % LANES] = true;
+        }
+    }
+}
@@ -0,0 +1,119 @@
+#ifndef ENSEMBLE_H
+#define ENSEMBLE_H
+
+#include <vector>
+#include "broadphase.h"
+#include "colliderset.h"
+
+class BinaryMesh;
+
+/**
+ * LANES copies of one mesh, each with a material of its own, stepped in
+ * lockstep. Every particle keeps its lanes' values side by side, so each
+ * kernel runs one tet or particle at a time with an inner loop over lanes
+ * that loads and stores whole rows and vectorizes, and the tets, their rest
+ * data and the surface are stored once for all lanes.
+ *
+ * Lanes are stepped the way Solver steps a single body, with the same
+ * gravity and collider penalty, and only differ from a Scene by rounding.
+ * Only what a single body needs is supported: no pushes, self collision,
+ * body contacts, sleeping or swept collisions.
+ */
+class Ensemble
+{
+public:
+    static const int LANES = 8;
+
+    Ensemble();
+
+    /**
+     * Sets up every lane from a loaded mesh, placed as Scene places one
+     * body, colliding with colliders. Lanes start with the material from the
+     * settings. Returns false if the mesh is empty.
+     */
+    bool init(const BinaryMesh &binary, const ColliderSet &colliders);
+
+    /** Sets a lane's material, density included, and puts it back at rest. */
+    void setMaterial(int lane, float incompressibility, float rigidity, float phi, float psi, float density);
+
+    /** Puts a lane back where it started, at rest, such as once it has blown up. */
+    void resetLane(int lane);
+
+    /** Takes one midpoint step of every lane. */
+    void update(float seconds);
+
+    int numParticles() const;
+
+    Vector3f position(int lane, int particle) const;
+
+    /** Box around each lane's particles. */
+    void bounds(AlignedBox3f boxes[LANES]) const;
+
+    void kineticEnergies(double energies[LANES]) const;
+
+    /** Whether any surface particle of each lane is inside a collider. */
+    void touching(bool touching[LANES]);
+
+private:
+    /**
+     * Values of particle i's coordinate c, one per lane. State arrays hold
+     * 3 * LANES floats per particle.
+     */
+    static int row(int i, int c) { return (i * 3 + c) * LANES; }
+
+    /** Leaves the force on every particle and lane in m_force. */
+    void evaluate();
+
+    /** Computes the forces of tets [begin, end) into m_tetForces. */
+    void tetForces(int begin, int end);
+
+    /**
+     * Sums penalty times penetration of every collider into
+     * m_collisionForces, one row of lanes per surface particle.
+     */
+    void collide(float penalty);
+
+    int m_numParticles;
+    vector<Vector4i> m_tets;
+    vector<int> m_surface;
+
+    /** Per tet: beta, column major, then the area and normal of the face opposite each node. */
+    vector<float> m_rest;
+
+    /** Lumped mass of each particle at unit density, and its rest position. */
+    vector<float> m_unitMasses;
+    vector<Vector3f> m_restPositions;
+
+    /** Per lane material. */
+    float m_incompressibility[LANES];
+    float m_rigidity[LANES];
+    float m_phi[LANES];
+    float m_psi[LANES];
+    float m_density[LANES];
+
+    vector<float> m_position;
+    vector<float> m_velocity;
+    vector<float> m_force;
+    /** LANES floats per particle. */
+    vector<float> m_mass;
+
+    /** Where the step started, for the midpoint's final update. */
+    vector<float> m_startPosition;
+    vector<float> m_startVelocity;
+
+    /** Each tet's forces on its four nodes, before they're added to the nodes. */
+    vector<float> m_tetForces;
+
+    ColliderSet m_colliders;
+    BroadPhase m_broadPhase;
+
+    /** Surface positions, one point per particle and lane, in the layouts the colliders take. */
+    vector<Vector3f> m_collisionPositions;
+    vector<float> m_collisionCoordinates[3];
+    vector<float> m_collisionForces[3];
+    vector<Vector3f> m_queryPositions;
+    vector<int> m_queryIndices;
+    vector<Vector3f> m_penetrations;
+};
+
+#endif // ENSEMBLE_H
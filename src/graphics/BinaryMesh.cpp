@@ -0,0 +1,291 @@
+#include "BinaryMesh.h"
+
+#include <cstring>
+#include <iostream>
+
+#include <QFile>
+#include <QSaveFile>
+
+using namespace Eigen;
+
+namespace {
+
+const char MAGIC[8] = { 'T', 'E', 'T', 'M', 'E', 'S', 'H', 'B' };
+const uint64_t ALIGNMENT = 16;
+
+uint64_t alignUp(uint64_t offset)
+{
+    return (offset + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+}
+
+bool sectionFits(uint64_t offset, uint64_t bytes, uint64_t size)
+{
+    return offset % ALIGNMENT == 0 && offset <= size && bytes <= size - offset;
+}
+
+/** Returns true if every one of count indices at offset is below limit. */
+bool indicesInRange(const char *data, uint64_t offset, uint64_t count, uint32_t limit)
+{
+    const int32_t *indices = reinterpret_cast<const int32_t *>(data + offset);
+    for (uint64_t i = 0; i < count; i++) {
+        if (indices[i] < 0 || static_cast<uint32_t>(indices[i]) >= limit) {
+            return false;
+        }
+    }
+    return true;
+}
+
+}
+
+BinaryMesh::BinaryMesh():
+    m_data(nullptr),
+    m_header(nullptr)
+{
+}
+
+BinaryMesh::~BinaryMesh()
+{
+}
+
+bool BinaryMesh::isBinaryMesh(const char *data, size_t size)
+{
+    return size >= sizeof(Header) && memcmp(data, MAGIC, sizeof(MAGIC)) == 0;
+}
+
+bool BinaryMesh::open(const std::string &filepath)
+{
+    std::unique_ptr<QFile> file(new QFile(QString::fromStdString(filepath)));
+    if (!file->open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    char magic[sizeof(MAGIC)];
+    if (file->peek(magic, sizeof(magic)) != sizeof(magic) || memcmp(magic, MAGIC, sizeof(MAGIC)) != 0) {
+        return false;
+    }
+    const qint64 size = file->size();
+    const char *data = reinterpret_cast<const char *>(file->map(0, size));
+    if (!data) {
+        std::cout << "Error mapping binary mesh: " << filepath << std::endl;
+        return false;
+    }
+    if (!view(data, size)) {
+        std::cout << "Invalid binary mesh: " << filepath << std::endl;
+        return false;
+    }
+    m_file = std::move(file);
+    m_owned.clear();
+    return true;
+}
+
+bool BinaryMesh::view(std::vector<char> &&encoded)
+{
+    m_owned = std::move(encoded);
+    m_file.reset();
+    return view(m_owned.data(), m_owned.size());
+}
+
+bool BinaryMesh::view(const char *data, size_t size)
+{
+    m_data = nullptr;
+    m_header = nullptr;
+    if (!isBinaryMesh(data, size)) {
+        return false;
+    }
+    const Header *header = reinterpret_cast<const Header *>(data);
+    if (header->version != VERSION || header->fileSize != size) {
+        return false;
+    }
+    bool valid = sectionFits(header->verticesOffset, uint64_t(header->numVertices) * 3 * sizeof(float), size) &&
+                 sectionFits(header->tetsOffset, uint64_t(header->numTets) * 4 * sizeof(int32_t), size);
+    if (header->flags & HAS_FACES) {
+        valid = valid && sectionFits(header->facesOffset, uint64_t(header->numFaces) * 3 * sizeof(int32_t), size);
+    }
+    if (header->flags & HAS_REST_DATA) {
+        valid = valid && sectionFits(header->restOffset, uint64_t(header->numTets) * header->restStride * sizeof(float), size);
+    }
+    if (header->flags & HAS_MASSES) {
+        valid = valid && sectionFits(header->massesOffset, uint64_t(header->numVertices) * sizeof(float), size);
+    }
+    if (header->flags & HAS_EXTERNAL_IDS) {
+        valid = valid && sectionFits(header->externalIdsOffset, uint64_t(header->numVertices) * sizeof(int32_t), size);
+    }
+    if (!valid) {
+        return false;
+    }
+    // Indices are used unchecked from here on, so a bad one has to be
+    // caught now rather than crash whoever reads the mesh.
+    valid = header->numVertices <= uint32_t(INT32_MAX) &&
+            indicesInRange(data, header->tetsOffset, uint64_t(header->numTets) * 4, header->numVertices);
+    if (header->flags & HAS_FACES) {
+        valid = valid && indicesInRange(data, header->facesOffset, uint64_t(header->numFaces) * 3, header->numVertices);
+    }
+    if (header->flags & HAS_EXTERNAL_IDS) {
+        valid = valid && indicesInRange(data, header->externalIdsOffset, header->numVertices, header->numVertices);
+    }
+    if (!valid) {
+        return false;
+    }
+    m_data = data;
+    m_header = header;
+    return true;
+}
+
+std::vector<char> BinaryMesh::encode(const std::vector<Vector3f> &vertices,
+                                     const std::vector<Vector4i> &tets,
+                                     const std::vector<Vector3i> &faces,
+                                     const std::vector<float> &restData, int restStride,
+                                     const std::vector<float> &masses,
+                                     const std::vector<int> &externalIds,
+                                     uint64_t sourceHash, uint64_t sourceSize)
+{
+    Header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.numVertices = vertices.size();
+    header.numTets = tets.size();
+    header.numFaces = faces.size();
+    header.sourceHash = sourceHash;
+    header.sourceSize = sourceSize;
+
+    uint64_t offset = alignUp(sizeof(Header));
+    header.verticesOffset = offset;
+    offset = alignUp(offset + vertices.size() * 3 * sizeof(float));
+    header.tetsOffset = offset;
+    offset = alignUp(offset + tets.size() * 4 * sizeof(int32_t));
+    if (!faces.empty()) {
+        header.flags |= HAS_FACES;
+        header.facesOffset = offset;
+        offset = alignUp(offset + faces.size() * 3 * sizeof(int32_t));
+    }
+    if (!restData.empty()) {
+        header.flags |= HAS_REST_DATA;
+        header.restStride = restStride;
+        header.restOffset = offset;
+        offset = alignUp(offset + restData.size() * sizeof(float));
+    }
+    if (!masses.empty()) {
+        header.flags |= HAS_MASSES;
+        header.massesOffset = offset;
+        offset = alignUp(offset + masses.size() * sizeof(float));
+    }
+    if (!externalIds.empty()) {
+        header.flags |= HAS_EXTERNAL_IDS;
+        header.externalIdsOffset = offset;
+        offset = alignUp(offset + externalIds.size() * sizeof(int32_t));
+    }
+    header.fileSize = offset;
+
+    std::vector<char> out(offset, 0);
+    memcpy(out.data(), &header, sizeof(header));
+    float *v = reinterpret_cast<float *>(out.data() + header.verticesOffset);
+    for (const Vector3f &vertex : vertices) {
+        *v++ = vertex[0];
+        *v++ = vertex[1];
+        *v++ = vertex[2];
+    }
+    int32_t *t = reinterpret_cast<int32_t *>(out.data() + header.tetsOffset);
+    for (const Vector4i &tet : tets) {
+        for (int i = 0; i < 4; i++) {
+            *t++ = tet[i];
+        }
+    }
+    int32_t *f = reinterpret_cast<int32_t *>(out.data() + header.facesOffset);
+    for (const Vector3i &face : faces) {
+        for (int i = 0; i < 3; i++) {
+            *f++ = face[i];
+        }
+    }
+    if (!restData.empty()) {
+        memcpy(out.data() + header.restOffset, restData.data(), restData.size() * sizeof(float));
+    }
+    if (!masses.empty()) {
+        memcpy(out.data() + header.massesOffset, masses.data(), masses.size() * sizeof(float));
+    }
+    int32_t *ids = reinterpret_cast<int32_t *>(out.data() + header.externalIdsOffset);
+    for (int id : externalIds) {
+        *ids++ = id;
+    }
+    return out;
+}
+
+bool BinaryMesh::write(const std::string &filepath, const std::vector<char> &encoded)
+{
+    QSaveFile file(QString::fromStdString(filepath));
+    if (!file.open(QIODevice::WriteOnly)) {
+        std::cout << "Error opening file: " << filepath << std::endl;
+        return false;
+    }
+    if (file.write(encoded.data(), encoded.size()) != static_cast<qint64>(encoded.size())) {
+        file.cancelWriting();
+        file.commit();
+        return false;
+    }
+    return file.commit();
+}
+
+const float *BinaryMesh::vertices() const
+{
+    return m_header ? reinterpret_cast<const float *>(m_data + m_header->verticesOffset) : nullptr;
+}
+
+const int32_t *BinaryMesh::tets() const
+{
+    return m_header ? reinterpret_cast<const int32_t *>(m_data + m_header->tetsOffset) : nullptr;
+}
+
+const int32_t *BinaryMesh::faces() const
+{
+    return hasFaces() ? reinterpret_cast<const int32_t *>(m_data + m_header->facesOffset) : nullptr;
+}
+
+const float *BinaryMesh::restData() const
+{
+    return hasRestData() ? reinterpret_cast<const float *>(m_data + m_header->restOffset) : nullptr;
+}
+
+const float *BinaryMesh::masses() const
+{
+    return hasMasses() ? reinterpret_cast<const float *>(m_data + m_header->massesOffset) : nullptr;
+}
+
+const int32_t *BinaryMesh::externalIds() const
+{
+    return hasExternalIds() ? reinterpret_cast<const int32_t *>(m_data + m_header->externalIdsOffset) : nullptr;
+}
+
+void BinaryMesh::copyVertices(std::vector<Vector3f> &vertices) const
+{
+    const float *v = this->vertices();
+    vertices.reserve(vertices.size() + numVertices());
+    for (int i = 0; i < numVertices(); i++) {
+        vertices.emplace_back(v[i * 3], v[i * 3 + 1], v[i * 3 + 2]);
+    }
+}
+
+void BinaryMesh::copyTets(std::vector<Vector4i> &tets) const
+{
+    const int32_t *t = this->tets();
+    tets.reserve(tets.size() + numTets());
+    for (int i = 0; i < numTets(); i++) {
+        tets.emplace_back(t[i * 4], t[i * 4 + 1], t[i * 4 + 2], t[i * 4 + 3]);
+    }
+}
+
+void BinaryMesh::copyFaces(std::vector<Vector3i> &faces) const
+{
+    const int32_t *f = this->faces();
+    faces.reserve(faces.size() + numFaces());
+    for (int i = 0; i < numFaces(); i++) {
+        faces.emplace_back(f[i * 3], f[i * 3 + 1], f[i * 3 + 2]);
+    }
+}
+
+void BinaryMesh::copyExternalIds(std::vector<int> &ids) const
+{
+    const int32_t *external = externalIds();
+    ids.resize(numVertices());
+    for (int i = 0; i < numVertices(); i++) {
+        ids[i] = external ? external[i] : i;
+    }
+}
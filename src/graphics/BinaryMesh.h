@@ -0,0 +1,147 @@
+#ifndef BINARYMESH_H
+#define BINARYMESH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include <Eigen/Dense>
+#include <Eigen/StdVector>
+
+class QFile;
+
+/**
+ * Versioned binary tet mesh. The file is a fixed header followed by raw,
+ * 16 byte aligned little endian arrays, so it can be memory mapped and used
+ * without any parsing:
+ *
+ *  - vertices: numVertices * 3 floats
+ *  - tets:     numTets * 4 int32s
+ *  - faces:    numFaces * 3 int32s, the boundary surface (optional)
+ *  - rest:     numTets * restStride floats, see TetRestData (optional)
+ *  - masses:   numVertices floats, lumped mass at unit density (optional)
+ *  - ids:      numVertices int32s, the index each vertex had in the file the
+ *              mesh was built from, when it was reordered (optional)
+ *
+ * A binary mesh built from another mesh file (see MeshCache) records the
+ * size and content hash of that file so it can be checked for staleness.
+ */
+class BinaryMesh
+{
+public:
+    static const uint32_t VERSION = 3;
+
+    enum Sections
+    {
+        HAS_FACES = 1,
+        HAS_REST_DATA = 2,
+        HAS_MASSES = 4,
+        HAS_EXTERNAL_IDS = 8
+    };
+
+    struct Header
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t flags;
+        uint32_t numVertices;
+        uint32_t numTets;
+        uint32_t numFaces;
+        uint32_t restStride;
+        uint64_t verticesOffset;
+        uint64_t tetsOffset;
+        uint64_t facesOffset;
+        uint64_t restOffset;
+        uint64_t massesOffset;
+        uint64_t externalIdsOffset;
+        uint64_t fileSize;
+        uint64_t sourceHash;
+        uint64_t sourceSize;
+    };
+
+    BinaryMesh();
+    ~BinaryMesh();
+
+    /**
+     * Returns true if data starts with a binary mesh header.
+     */
+    static bool isBinaryMesh(const char *data, size_t size);
+
+    /**
+     * Maps the file at filepath. Returns false without printing anything if
+     * the file is not a binary mesh, so callers can fall back to text.
+     */
+    bool open(const std::string &filepath);
+
+    /**
+     * Uses data as the mesh without copying it. data has to outlive this
+     * object. Returns false if the header or section bounds are invalid or
+     * a tet, face or external id refers past the last vertex.
+     */
+    bool view(const char *data, size_t size);
+
+    /**
+     * Takes ownership of an encoded mesh and uses it as the mesh.
+     */
+    bool view(std::vector<char> &&encoded);
+
+    /**
+     * Serializes a mesh. faces, restData, masses and externalIds are written
+     * only when they are non-empty.
+     */
+    static std::vector<char> encode(const std::vector<Eigen::Vector3f> &vertices,
+                                    const std::vector<Eigen::Vector4i> &tets,
+                                    const std::vector<Eigen::Vector3i> &faces,
+                                    const std::vector<float> &restData, int restStride,
+                                    const std::vector<float> &masses,
+                                    const std::vector<int> &externalIds,
+                                    uint64_t sourceHash = 0, uint64_t sourceSize = 0);
+
+    /**
+     * Writes an encoded mesh. The file is replaced atomically so processes
+     * that have the old file mapped are not affected.
+     */
+    static bool write(const std::string &filepath, const std::vector<char> &encoded);
+
+    int numVertices() const { return m_header ? m_header->numVertices : 0; }
+    int numTets() const { return m_header ? m_header->numTets : 0; }
+    int numFaces() const { return m_header ? m_header->numFaces : 0; }
+    int restStride() const { return m_header ? m_header->restStride : 0; }
+
+    uint64_t sourceHash() const { return m_header ? m_header->sourceHash : 0; }
+    uint64_t sourceSize() const { return m_header ? m_header->sourceSize : 0; }
+
+    bool hasFaces() const { return m_header && (m_header->flags & HAS_FACES); }
+    bool hasRestData() const { return m_header && (m_header->flags & HAS_REST_DATA); }
+    bool hasMasses() const { return m_header && (m_header->flags & HAS_MASSES); }
+    bool hasExternalIds() const { return m_header && (m_header->flags & HAS_EXTERNAL_IDS); }
+
+    const float *vertices() const;
+    const int32_t *tets() const;
+    const int32_t *faces() const;
+    const float *restData() const;
+    const float *masses() const;
+    const int32_t *externalIds() const;
+
+    void copyVertices(std::vector<Eigen::Vector3f> &vertices) const;
+    void copyTets(std::vector<Eigen::Vector4i> &tets) const;
+    void copyFaces(std::vector<Eigen::Vector3i> &faces) const;
+
+    /**
+     * Copies the external vertex ids, or the identity if the mesh was not
+     * reordered.
+     */
+    void copyExternalIds(std::vector<int> &ids) const;
+
+private:
+    BinaryMesh(const BinaryMesh &) = delete;
+    BinaryMesh &operator=(const BinaryMesh &) = delete;
+
+    std::unique_ptr<QFile> m_file;
+    std::vector<char> m_owned;
+    const char *m_data;
+    const Header *m_header;
+};
+
+#endif // BINARYMESH_H
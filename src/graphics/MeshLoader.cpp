@@ -5,48 +5,105 @@
 
 #include <iostream>
 
+#include <QByteArray>
 #include <QString>
 #include <QFile>
-#include <QTextStream>
-#include <QRegularExpression>
+
+#include "BinaryMesh.h"
+#include "MeshParser.h"
+#include "surfaceextractor.h"
 
 using namespace Eigen;
 
+namespace {
+
+/** Returns true if every index of every element is a vertex of the mesh. */
+template <typename Element>
+bool indicesInRange(const std::vector<Element> &elements, size_t numVertices)
+{
+    for(const Element &element : elements) {
+        if((element.array() < 0).any() || (element.array() >= static_cast<int>(numVertices)).any()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+}
+
 bool MeshLoader::loadTetMesh(const std::string &filepath, std::vector<Eigen::Vector3f> &vertices, std::vector<Eigen::Vector4i> &tets)
 {
     QString qpath = QString::fromStdString(filepath);
     QFile file(qpath);
 
-    if(!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+    if(!file.open(QIODevice::ReadOnly)) {
         std::cout << "Error opening file: " << filepath << std::endl;
         return false;
     }
-    QTextStream in(&file);
 
-    QRegularExpression vrxp("v (-?\\d*\\.?\\d+) +(-?\\d*\\.?\\d+) +(-?\\d*\\.?\\d+)");
-    QRegularExpression trxp("t (\\d+) +(\\d+) +(\\d+) +(\\d+)");
-
-    while(!in.atEnd()) {
-        QString line = in.readLine();
-        auto match = vrxp.match(line);
-        if(match.hasMatch()) {
-            vertices.emplace_back(match.captured(1).toFloat(),
-                                  match.captured(2).toFloat(),
-                                  match.captured(3).toFloat());
-            continue;
+    // Parse straight out of the page cache when the file can be mapped, and
+    // fall back to reading it into one buffer when it can't.
+    qint64 size = file.size();
+    QByteArray contents;
+    const char *data = nullptr;
+    if(size > 0) {
+        data = reinterpret_cast<const char *>(file.map(0, size));
+        if(!data) {
+            contents = file.readAll();
+            data = contents.constData();
+            size = contents.size();
         }
-        match = trxp.match(line);
-        if(match.hasMatch()) {
-            tets.emplace_back(match.captured(1).toInt(),
-                              match.captured(2).toInt(),
-                              match.captured(3).toInt(),
-                              match.captured(4).toInt());
+    }
+    if(data && BinaryMesh::isBinaryMesh(data, size)) {
+        BinaryMesh binary;
+        if(!binary.view(data, size)) {
+            std::cout << "Invalid binary mesh: " << filepath << std::endl;
+            return false;
         }
+        binary.copyVertices(vertices);
+        binary.copyTets(tets);
+    } else if(data) {
+        MeshParser::parseParallel(data, data + size, vertices, tets);
     }
     file.close();
     return true;
 }
 
+bool MeshLoader::loadTriangleMesh(const std::string &filepath, std::vector<Eigen::Vector3f> &vertices, std::vector<Eigen::Vector3i> &faces)
+{
+    QString qpath = QString::fromStdString(filepath);
+    if(!qpath.endsWith(".obj", Qt::CaseInsensitive)) {
+        std::vector<Vector4i> tets;
+        if(!loadTetMesh(filepath, vertices, tets) || !indicesInRange(tets, vertices.size())) {
+            return false;
+        }
+        faces = SurfaceExtractor::extractSurface(tets);
+        return true;
+    }
+
+    tinyobj::attrib_t attrib;
+    std::vector<tinyobj::shape_t> shapes;
+    std::vector<tinyobj::material_t> materials;
+    std::string err;
+    if(!tinyobj::LoadObj(&attrib, &shapes, &materials, &err, filepath.c_str())) {
+        std::cout << "Error loading obj: " << filepath << " " << err << std::endl;
+        return false;
+    }
+
+    vertices.clear();
+    faces.clear();
+    for(size_t i = 0; i + 2 < attrib.vertices.size(); i += 3) {
+        vertices.emplace_back(attrib.vertices[i], attrib.vertices[i + 1], attrib.vertices[i + 2]);
+    }
+    for(const tinyobj::shape_t &shape : shapes) {
+        const std::vector<tinyobj::index_t> &indices = shape.mesh.indices;
+        for(size_t i = 0; i + 2 < indices.size(); i += 3) {
+            faces.emplace_back(indices[i].vertex_index, indices[i + 1].vertex_index, indices[i + 2].vertex_index);
+        }
+    }
+    return indicesInRange(faces, vertices.size());
+}
+
 MeshLoader::MeshLoader()
 {
 
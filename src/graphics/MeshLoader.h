@@ -10,7 +10,18 @@ EIGEN_DEFINE_STL_VECTOR_SPECIALIZATION(Eigen::Matrix4i)
 class MeshLoader
 {
 public:
+    /**
+     * Loads a text .mesh file or a binary mesh (see BinaryMesh), detected
+     * from the file contents.
+     */
     static bool loadTetMesh(const std::string &filepath, std::vector<Eigen::Vector3f> &vertices, std::vector<Eigen::Vector4i> &tets);
+
+    /**
+     * Loads a triangle surface: every face of a .obj file (triangulated), or
+     * the boundary of any mesh loadTetMesh reads. Returns false if a face
+     * or tet refers to a vertex that does not exist.
+     */
+    static bool loadTriangleMesh(const std::string &filepath, std::vector<Eigen::Vector3f> &vertices, std::vector<Eigen::Vector3i> &faces);
 private:
     MeshLoader();
 };
@@ -0,0 +1,248 @@
+#include "MeshParser.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#include "parallel.h"
+
+using namespace Eigen;
+
+namespace {
+
+// Every power of ten up to 1e22 is exactly representable as a double.
+const double POW10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+inline bool isDigit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+inline const char *skipBlanks(const char *p, const char *end)
+{
+    while (p < end && (*p == ' ' || *p == '\t')) {
+        p++;
+    }
+    return p;
+}
+
+inline const char *nextLine(const char *p, const char *end)
+{
+    const char *newline = static_cast<const char *>(memchr(p, '\n', end - p));
+    return newline ? newline + 1 : end;
+}
+
+// A record line starts with its tag followed by a blank.
+inline bool isRecord(const char *p, const char *end, char tag)
+{
+    return end - p >= 2 && p[0] == tag && (p[1] == ' ' || p[1] == '\t');
+}
+
+}
+
+void MeshParser::countLines(const char *begin, const char *end, size_t &numVertices, size_t &numTets)
+{
+    numVertices = 0;
+    numTets = 0;
+    const char *p = begin;
+    while (p < end) {
+        const char *line = skipBlanks(p, end);
+        if (line < end) {
+            numVertices += (*line == 'v');
+            numTets += (*line == 't');
+        }
+        p = nextLine(line, end);
+    }
+}
+
+void MeshParser::parse(const char *begin, const char *end, std::vector<Vector3f> &vertices, std::vector<Vector4i> &tets)
+{
+    size_t numVertices, numTets;
+    countLines(begin, end, numVertices, numTets);
+    vertices.reserve(vertices.size() + numVertices);
+    tets.reserve(tets.size() + numTets);
+    parseRecords(begin, end, vertices, tets);
+}
+
+void MeshParser::parseParallel(const char *begin, const char *end,
+                               std::vector<Vector3f> &vertices, std::vector<Vector4i> &tets,
+                               unsigned int numThreads, size_t chunkBytes)
+{
+    if (numThreads == 0) {
+        numThreads = Parallel::threadCount();
+    }
+    chunkBytes = std::max<size_t>(chunkBytes, 1);
+    if (numThreads <= 1 || static_cast<size_t>(end - begin) <= chunkBytes) {
+        parse(begin, end, vertices, tets);
+        return;
+    }
+
+    // Line aligned chunk boundaries: each chunk ends just after a newline.
+    std::vector<const char *> bounds;
+    bounds.push_back(begin);
+    while (bounds.back() < end) {
+        const char *p = bounds.back();
+        const char *nominal = static_cast<size_t>(end - p) <= chunkBytes ? end : p + chunkBytes;
+        bounds.push_back(nominal < end ? nextLine(nominal, end) : end);
+    }
+    const int numChunks = static_cast<int>(bounds.size()) - 1;
+
+    // Counting is much cheaper than parsing, so size the outputs exactly first.
+    std::vector<size_t> chunkVertices(numChunks), chunkTets(numChunks);
+    Parallel::forEachThread(numThreads, [&](unsigned int t) {
+        for (int c = t; c < numChunks; c += numThreads) {
+            countLines(bounds[c], bounds[c + 1], chunkVertices[c], chunkTets[c]);
+        }
+    });
+    size_t totalVertices = 0, totalTets = 0;
+    for (int c = 0; c < numChunks; c++) {
+        totalVertices += chunkVertices[c];
+        totalTets += chunkTets[c];
+    }
+    vertices.reserve(vertices.size() + totalVertices);
+    tets.reserve(tets.size() + totalTets);
+
+    std::vector<std::vector<Vector3f>> windowVertices(numThreads);
+    std::vector<std::vector<Vector4i>> windowTets(numThreads);
+    for (int window = 0; window < numChunks; window += numThreads) {
+        const int windowSize = std::min<int>(numThreads, numChunks - window);
+        Parallel::forEachThread(windowSize, [&](unsigned int t) {
+            windowVertices[t].clear();
+            windowTets[t].clear();
+            parseRecords(bounds[window + t], bounds[window + t + 1], windowVertices[t], windowTets[t]);
+        });
+        for (int t = 0; t < windowSize; t++) {
+            vertices.insert(vertices.end(), windowVertices[t].begin(), windowVertices[t].end());
+            tets.insert(tets.end(), windowTets[t].begin(), windowTets[t].end());
+        }
+    }
+}
+
+void MeshParser::parseRecords(const char *begin, const char *end, std::vector<Vector3f> &vertices, std::vector<Vector4i> &tets)
+{
+    const char *p = begin;
+    while (p < end) {
+        const char *q = skipBlanks(p, end);
+        if (isRecord(q, end, 'v')) {
+            float x, y, z;
+            q = skipBlanks(q + 1, end);
+            if (parseFloat(q, end, x) &&
+                    parseFloat(q = skipBlanks(q, end), end, y) &&
+                    parseFloat(q = skipBlanks(q, end), end, z)) {
+                vertices.emplace_back(x, y, z);
+            }
+        } else if (isRecord(q, end, 't')) {
+            int a, b, c, d;
+            q = skipBlanks(q + 1, end);
+            if (parseInt(q, end, a) &&
+                    parseInt(q = skipBlanks(q, end), end, b) &&
+                    parseInt(q = skipBlanks(q, end), end, c) &&
+                    parseInt(q = skipBlanks(q, end), end, d)) {
+                tets.emplace_back(a, b, c, d);
+            }
+        }
+        p = nextLine(q, end);
+    }
+}
+
+bool MeshParser::parseFloat(const char *&p, const char *end, float &out)
+{
+    const char *s = p;
+    bool negative = false;
+    if (s < end && (*s == '-' || *s == '+')) {
+        negative = (*s == '-');
+        s++;
+    }
+
+    // Keep the first 19 significant digits in an integer mantissa and track
+    // the decimal exponent of the rest.
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+    bool sawDigit = false;
+    while (s < end && isDigit(*s)) {
+        sawDigit = true;
+        if (digits < 19) {
+            mantissa = mantissa * 10 + (*s - '0');
+            digits += (mantissa != 0);
+        } else {
+            exponent++;
+        }
+        s++;
+    }
+    if (s < end && *s == '.') {
+        s++;
+        while (s < end && isDigit(*s)) {
+            sawDigit = true;
+            if (digits < 19) {
+                mantissa = mantissa * 10 + (*s - '0');
+                digits += (mantissa != 0);
+                exponent--;
+            }
+            s++;
+        }
+    }
+    if (!sawDigit) {
+        return false;
+    }
+    if (s < end && (*s == 'e' || *s == 'E')) {
+        const char *e = s + 1;
+        bool negativeExponent = false;
+        if (e < end && (*e == '-' || *e == '+')) {
+            negativeExponent = (*e == '-');
+            e++;
+        }
+        if (e < end && isDigit(*e)) {
+            int value = 0;
+            while (e < end && isDigit(*e)) {
+                if (value < 10000) {
+                    value = value * 10 + (*e - '0');
+                }
+                e++;
+            }
+            exponent += negativeExponent ? -value : value;
+            s = e;
+        }
+    }
+
+    double value = static_cast<double>(mantissa);
+    if (mantissa == 0) {
+        value = 0.0;
+    } else if (exponent >= 0 && exponent <= 22) {
+        value *= POW10[exponent];
+    } else if (exponent < 0 && exponent >= -22) {
+        value /= POW10[-exponent];
+    } else {
+        value *= std::pow(10.0, exponent);
+    }
+    out = static_cast<float>(negative ? -value : value);
+    p = s;
+    return true;
+}
+
+bool MeshParser::parseInt(const char *&p, const char *end, int &out)
+{
+    // Only plain digits, as indices have no sign, and nothing past what an
+    // int holds, so no index can come out negative.
+    const char *s = p;
+    if (s >= end || !isDigit(*s)) {
+        return false;
+    }
+    int64_t value = 0;
+    while (s < end && isDigit(*s)) {
+        if (value <= INT32_MAX) {
+            value = value * 10 + (*s - '0');
+        }
+        s++;
+    }
+    if (value > INT32_MAX) {
+        return false;
+    }
+    out = static_cast<int>(value);
+    p = s;
+    return true;
+}
@@ -0,0 +1,63 @@
+#ifndef MESHPARSER_H
+#define MESHPARSER_H
+
+#include <cstddef>
+#include <vector>
+#include <Eigen/Dense>
+#include <Eigen/StdVector>
+
+/**
+ * Parser for the text .mesh format over a raw byte buffer. Lines of the form
+ * "v x y z" are vertices and lines of the form "t a b c d" are tets; every
+ * other line is ignored. Nothing is allocated per line.
+ */
+class MeshParser
+{
+public:
+    /**
+     * Counts the vertex and tet lines in [begin, end) without parsing them.
+     */
+    static void countLines(const char *begin, const char *end, size_t &numVertices, size_t &numTets);
+
+    /**
+     * Parses [begin, end), appending to vertices and tets. Reserves space for
+     * all of the lines up front.
+     */
+    static void parse(const char *begin, const char *end, std::vector<Eigen::Vector3f> &vertices, std::vector<Eigen::Vector4i> &tets);
+
+    /**
+     * Parses [begin, end) like parse, split into line aligned chunks of about
+     * chunkBytes that are parsed on numThreads threads (0 uses every hardware
+     * thread) and appended in file order. Chunks are parsed a window of
+     * numThreads at a time into reused buffers, so the extra memory is
+     * bounded by the window rather than the file size.
+     */
+    static void parseParallel(const char *begin, const char *end,
+                              std::vector<Eigen::Vector3f> &vertices, std::vector<Eigen::Vector4i> &tets,
+                              unsigned int numThreads = 0, size_t chunkBytes = DEFAULT_CHUNK_BYTES);
+
+    static const size_t DEFAULT_CHUNK_BYTES = 8 << 20;
+
+    /**
+     * Parses a decimal float (optionally signed, with fraction and exponent)
+     * starting at p. On success advances p past the number.
+     */
+    static bool parseFloat(const char *&p, const char *end, float &out);
+
+    /**
+     * Parses an unsigned decimal integer that fits in an int starting at p.
+     * On success advances p past the number. A sign fails, so a tet line
+     * with a negative index is skipped like any other malformed line.
+     */
+    static bool parseInt(const char *&p, const char *end, int &out);
+
+private:
+    MeshParser();
+
+    /**
+     * Appends the records in [begin, end) without reserving first.
+     */
+    static void parseRecords(const char *begin, const char *end, std::vector<Eigen::Vector3f> &vertices, std::vector<Eigen::Vector4i> &tets);
+};
+
+#endif // MESHPARSER_H
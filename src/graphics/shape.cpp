@@ -3,9 +3,19 @@
 #include <iostream>
 
 #include "graphics/Shader.h"
+#include "parallel.h"
 
 using namespace Eigen;
 
+namespace {
+
+// Smallest number of faces given to one thread when rebuilding normals.
+const int NORMALS_GRAIN = 1024;
+
+Parallel::Stage normalsStage("normals");
+
+}
+
 Shape::Shape()
     : m_tetVao(-1),
       m_numSurfaceVertices(),
@@ -152,24 +162,24 @@ void Shape::setVertices(const std::vector<Eigen::Vector3f> &vertices)
         std::cerr << "You can't set vertices to a vector that is a different length that what shape was inited with" << std::endl;
         return;
     }
-    std::vector<Eigen::Vector3f> verts;
-    std::vector<Eigen::Vector3f> normals;
-    verts.reserve(m_faces.size() * 3);
-    normals.reserve(m_faces.size() * 3);
-    for(auto& f : m_faces) {
-        auto& v1 = vertices[f[0]];
-        auto& v2 = vertices[f[1]];
-        auto& v3 = vertices[f[2]];
-        auto& e1 = v2 - v1;
-        auto& e2 = v3 - v1;
-        auto n = e1.cross(e2);
-        normals.push_back(n);
-        normals.push_back(n);
-        normals.push_back(n);
-        verts.push_back(v1);
-        verts.push_back(v2);
-        verts.push_back(v3);
-    }
+    Parallel::StageTimer timer(normalsStage);
+    std::vector<Eigen::Vector3f> verts(m_faces.size() * 3);
+    std::vector<Eigen::Vector3f> normals(m_faces.size() * 3);
+    Parallel::forRange(0, m_faces.size(), NORMALS_GRAIN, [&](int begin, int end) {
+        for(int i = begin; i < end; i++) {
+            const Eigen::Vector3i &f = m_faces[i];
+            const Eigen::Vector3f &v1 = vertices[f[0]];
+            const Eigen::Vector3f &v2 = vertices[f[1]];
+            const Eigen::Vector3f &v3 = vertices[f[2]];
+            Eigen::Vector3f n = (v2 - v1).cross(v3 - v1);
+            normals[i * 3] = n;
+            normals[i * 3 + 1] = n;
+            normals[i * 3 + 2] = n;
+            verts[i * 3] = v1;
+            verts[i * 3 + 1] = v2;
+            verts[i * 3 + 2] = v3;
+        }
+    });
     glBindBuffer(GL_ARRAY_BUFFER, m_surfaceVbo);
     glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(float) * verts.size() * 3, static_cast<const void *>(verts.data()));
     glBufferSubData(GL_ARRAY_BUFFER, sizeof(float) * verts.size() * 3, sizeof(float) * verts.size() * 3, static_cast<const void *>(normals.data()));
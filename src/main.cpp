@@ -6,12 +6,6 @@
 
 using namespace std;
 
-QString meshFile;
-float incompressibility;
-float rigidity;
-float phi;
-float psi;
-float density;
 QString sphereFile;
 
 int main(int argc, char *argv[])
@@ -20,28 +14,21 @@ int main(int argc, char *argv[])
 
     QCommandLineParser parser;
     parser.addHelpOption();
-    parser.addPositionalArgument("mesh", "Mesh file");
-    parser.addPositionalArgument("incompressibility", "Elastic incompressibility");
-    parser.addPositionalArgument("rigidity", "Elastic rigidity");
-    parser.addPositionalArgument("phi", "Phi (viscous incompressibility)");
-    parser.addPositionalArgument("psi", "Psi (viscous rigidity)");
-    parser.addPositionalArgument("density", "Uniform mesh density");
+    addSceneArguments(parser);
     parser.addPositionalArgument("sphere", "Sphere mesh file");
 
     parser.process(a);
 
+    if (!readSceneArguments(parser)) {
+        a.exit(1);
+        return 1;
+    }
     const QStringList args = parser.positionalArguments();
-    if(args.size() < 4) {
+    if (args.size() < 7) {
         cerr << "Error: Wrong number of arguments" << endl;
         a.exit(1);
         return 1;
     }
-    meshFile = args[0];
-    incompressibility = args[1].toFloat();
-    rigidity = args[2].toFloat();
-    phi = args[3].toFloat();
-    psi = args[4].toFloat();
-    density = args[5].toFloat();
     sphereFile = args[6];
 
     MainWindow w;
@@ -2,13 +2,8 @@
 #define MAIN_H
 
 #include <QApplication>
+#include "settings.h"
 
-extern QString meshFile;
-extern float incompressibility;
-extern float rigidity;
-extern float phi;
-extern float psi;
-extern float density;
 extern QString sphereFile;
 
 #endif // MAIN_H
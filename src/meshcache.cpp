@@ -0,0 +1,111 @@
+#include "meshcache.h"
+
+#include <cstring>
+#include <iostream>
+
+#include <QByteArray>
+#include <QFile>
+
+#include "graphics/BinaryMesh.h"
+#include "graphics/MeshParser.h"
+#include "meshconverter.h"
+
+using namespace Eigen;
+using namespace std;
+
+namespace {
+
+const uint64_t PRIME1 = 0x9E3779B185EBCA87ull;
+const uint64_t PRIME2 = 0xC2B2AE3D27D4EB4Full;
+
+inline uint64_t rotl(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+inline uint64_t mixLane(uint64_t acc, uint64_t input)
+{
+    return rotl(acc + input * PRIME2, 31) * PRIME1;
+}
+
+bool upToDate(const BinaryMesh &cache, uint64_t hash, uint64_t size, bool reorder)
+{
+    return cache.sourceHash() == hash && cache.sourceSize() == size &&
+           cache.hasFaces() && cache.hasMasses() && cache.hasRestData() &&
+           cache.hasExternalIds() == reorder;
+}
+
+}
+
+string MeshCache::cachePath(const string &meshPath)
+{
+    return meshPath + ".cache";
+}
+
+uint64_t MeshCache::hashBytes(const char *data, size_t size)
+{
+    // Four independent lanes so the multiplies pipeline, folded at the end.
+    uint64_t lanes[4] = { PRIME1 + PRIME2, PRIME2, 0, 0 - PRIME1 };
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        for (int lane = 0; lane < 4; lane++) {
+            uint64_t word;
+            memcpy(&word, data + i + lane * 8, 8);
+            lanes[lane] = mixLane(lanes[lane], word);
+        }
+    }
+    uint64_t h = rotl(lanes[0], 1) + rotl(lanes[1], 7) + rotl(lanes[2], 12) + rotl(lanes[3], 18);
+    h += size;
+    for (; i < size; i++) {
+        h = rotl(h ^ (static_cast<unsigned char>(data[i]) * PRIME1), 11) * PRIME2;
+    }
+    h ^= h >> 33;
+    h *= PRIME2;
+    h ^= h >> 29;
+    return h;
+}
+
+bool MeshCache::load(const string &meshPath, BinaryMesh &mesh, bool reorder)
+{
+    if (mesh.open(meshPath)) {
+        return true;
+    }
+
+    QFile file(QString::fromStdString(meshPath));
+    if (!file.open(QIODevice::ReadOnly)) {
+        cout << "Error opening file: " << meshPath << endl;
+        return false;
+    }
+    qint64 size = file.size();
+    QByteArray contents;
+    const char *data = size > 0 ? reinterpret_cast<const char *>(file.map(0, size)) : nullptr;
+    if (!data) {
+        contents = file.readAll();
+        data = contents.constData();
+        size = contents.size();
+    }
+    const uint64_t hash = hashBytes(data, size);
+
+    const string sidecar = cachePath(meshPath);
+    if (mesh.open(sidecar) && upToDate(mesh, hash, size, reorder)) {
+        return true;
+    }
+
+    vector<Vector3f> vertices;
+    vector<Vector4i> tets;
+    MeshParser::parseParallel(data, data + size, vertices, tets);
+    for (const Vector4i &tet : tets) {
+        if ((tet.array() < 0).any() || (tet.array() >= static_cast<int>(vertices.size())).any()) {
+            cout << "Tet references a vertex that does not exist in " << meshPath << endl;
+            return false;
+        }
+    }
+    vector<char> encoded = MeshConverter::buildBinaryMesh(std::move(vertices), std::move(tets), reorder, hash, size);
+
+    // Failing to write the sidecar (e.g. a read only directory) only costs
+    // the next run a recompute.
+    if (!BinaryMesh::write(sidecar, encoded)) {
+        cout << "Could not write mesh cache: " << sidecar << endl;
+    }
+    return mesh.view(std::move(encoded));
+}
@@ -0,0 +1,40 @@
+#ifndef MESHCACHE_H
+#define MESHCACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+class BinaryMesh;
+
+/**
+ * Keeps the derived rest state of a text mesh (surface, tet rest data and
+ * masses) in a binary mesh sidecar file next to it, named <mesh>.cache. The
+ * sidecar records the size and content hash of the mesh it was built from
+ * and is rebuilt whenever they stop matching.
+ */
+class MeshCache
+{
+public:
+    /**
+     * Loads meshPath into mesh with every derived section present. Binary
+     * meshes are opened directly. Text meshes use a valid sidecar when there
+     * is one, and otherwise are parsed and precomputed and the sidecar is
+     * (re)written. If reorder is set, text meshes are renumbered for locality
+     * (see MeshReorder) and the sidecar keeps the original vertex ids.
+     * Returns false only if the mesh itself can't be loaded.
+     */
+    static bool load(const std::string &meshPath, BinaryMesh &mesh, bool reorder = false);
+
+    static std::string cachePath(const std::string &meshPath);
+
+    /**
+     * 64 bit content hash used to validate sidecars.
+     */
+    static uint64_t hashBytes(const char *data, size_t size);
+
+private:
+    MeshCache();
+};
+
+#endif // MESHCACHE_H
@@ -0,0 +1,80 @@
+#include "meshconverter.h"
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+
+#include "graphics/BinaryMesh.h"
+#include "graphics/MeshLoader.h"
+#include "meshreorder.h"
+#include "surfaceextractor.h"
+#include "tet.h"
+
+using namespace Eigen;
+using namespace std;
+
+vector<char> MeshConverter::buildBinaryMesh(vector<Vector3f> vertices, vector<Vector4i> tets, bool reorder,
+                                            uint64_t sourceHash, uint64_t sourceSize)
+{
+    vector<int> externalIds;
+    if (reorder) {
+        externalIds = MeshReorder::reorder(vertices, tets);
+    }
+
+    vector<Vector3i> faces = SurfaceExtractor::extractSurface(tets);
+
+    vector<float> restData(tets.size() * TetRestData::NUM_FLOATS);
+    vector<float> masses(vertices.size(), 0.f);
+    for (unsigned int i = 0; i < tets.size(); i++) {
+        const Vector4i &tet = tets[i];
+        TetRestData rest = TetRestData::compute(vertices[tet[0]], vertices[tet[1]],
+                                                vertices[tet[2]], vertices[tet[3]]);
+        rest.toFloats(restData.data() + i * TetRestData::NUM_FLOATS);
+        for (int n = 0; n < 4; n++) {
+            masses[tet[n]] += rest.volume / 4.f;
+        }
+    }
+
+    return BinaryMesh::encode(vertices, tets, faces, restData, TetRestData::NUM_FLOATS, masses,
+                              externalIds, sourceHash, sourceSize);
+}
+
+bool MeshConverter::convert(const string &inputPath, const string &outputPath, bool reorder)
+{
+    vector<Vector3f> vertices;
+    vector<Vector4i> tets;
+    if (!MeshLoader::loadTetMesh(inputPath, vertices, tets)) {
+        return false;
+    }
+    for (const Vector4i &tet : tets) {
+        if ((tet.array() < 0).any() || (tet.array() >= static_cast<int>(vertices.size())).any()) {
+            cerr << "Tet references a vertex that does not exist in " << inputPath << endl;
+            return false;
+        }
+    }
+    return BinaryMesh::write(outputPath, buildBinaryMesh(std::move(vertices), std::move(tets), reorder));
+}
+
+bool MeshConverter::writeTextMesh(const string &path, const vector<Vector3f> &vertices, const vector<Vector4i> &tets,
+                                  const vector<int> &externalIds, const Vector3f &translation)
+{
+    ofstream out(path);
+    if (!out) {
+        return false;
+    }
+    vector<Vector3f> ordered(vertices.size());
+    for (unsigned int i = 0; i < vertices.size(); i++) {
+        ordered[externalIds[i]] = vertices[i] + translation;
+    }
+    char line[96];
+    for (const Vector3f &v : ordered) {
+        int len = snprintf(line, sizeof(line), "v %.9g %.9g %.9g\n", v.x(), v.y(), v.z());
+        out.write(line, len);
+    }
+    for (const Vector4i &tet : tets) {
+        int len = snprintf(line, sizeof(line), "t %d %d %d %d\n", externalIds[tet[0]], externalIds[tet[1]],
+                           externalIds[tet[2]], externalIds[tet[3]]);
+        out.write(line, len);
+    }
+    return static_cast<bool>(out);
+}
@@ -0,0 +1,46 @@
+#ifndef MESHCONVERTER_H
+#define MESHCONVERTER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <Eigen/Dense>
+#include <Eigen/StdVector>
+
+class MeshConverter
+{
+public:
+    /**
+     * Builds a binary mesh (see BinaryMesh) with the boundary surface, per tet
+     * rest data and lumped unit density masses precomputed. If reorder is
+     * set the mesh is first renumbered for locality (see MeshReorder) and the
+     * original vertex indices are stored as external ids. sourceHash and
+     * sourceSize identify the file the mesh came from, if any.
+     */
+    static std::vector<char> buildBinaryMesh(std::vector<Eigen::Vector3f> vertices,
+                                             std::vector<Eigen::Vector4i> tets,
+                                             bool reorder,
+                                             uint64_t sourceHash = 0, uint64_t sourceSize = 0);
+
+    /**
+     * Loads a mesh in any format MeshLoader supports and writes it out as a
+     * binary mesh, optionally reordered.
+     */
+    static bool convert(const std::string &inputPath, const std::string &outputPath, bool reorder);
+
+    /**
+     * Writes vertices, moved by translation, and tets as a text .mesh with
+     * each vertex at the index externalIds gives it, so a reordered mesh
+     * comes out in the order of the file it was built from.
+     */
+    static bool writeTextMesh(const std::string &path,
+                              const std::vector<Eigen::Vector3f> &vertices,
+                              const std::vector<Eigen::Vector4i> &tets,
+                              const std::vector<int> &externalIds,
+                              const Eigen::Vector3f &translation);
+
+private:
+    MeshConverter();
+};
+
+#endif // MESHCONVERTER_H
@@ -0,0 +1,123 @@
+#include "meshpartition.h"
+
+#include <numeric>
+
+using namespace Eigen;
+using namespace std;
+
+namespace {
+
+/** Vertex to tet incidence in compressed rows. */
+struct Incidence
+{
+    vector<int> start;
+    vector<int> tets;
+};
+
+/**
+ * Breadth first traversal from start over the tets whose part is part,
+ * appending them to order until it holds limit tets or the component runs
+ * out. visited holds the stamp of the last traversal that reached a tet.
+ */
+void traverse(int start, int part, size_t limit, const vector<Vector4i> &tets, const Incidence &incidence,
+              const vector<int> &parts, int stamp, vector<int> &visited, vector<int> &order)
+{
+    size_t head = order.size();
+    order.push_back(start);
+    visited[start] = stamp;
+    while (head < order.size() && order.size() < limit) {
+        const Vector4i &tet = tets[order[head++]];
+        for (int n = 0; n < 4; n++) {
+            for (int i = incidence.start[tet[n]]; i < incidence.start[tet[n] + 1]; i++) {
+                int neighbor = incidence.tets[i];
+                if (parts[neighbor] == part && visited[neighbor] != stamp && order.size() < limit) {
+                    visited[neighbor] = stamp;
+                    order.push_back(neighbor);
+                }
+            }
+        }
+    }
+}
+
+/**
+ * Splits the tets of part, count of them, into numParts parts numbered from
+ * part, moving the later ones to their new numbers.
+ */
+void bisect(int part, int count, int numParts, const vector<Vector4i> &tets, const Incidence &incidence,
+            vector<int> &parts, int &stamp, vector<int> &visited)
+{
+    if (numParts < 2 || count == 0) {
+        return;
+    }
+    const int firstParts = numParts / 2;
+    const size_t firstCount = static_cast<size_t>(count) * firstParts / numParts;
+
+    // The first half grows from the last tet a trial traversal reaches,
+    // which is far from the rest. A component too small to fill it is
+    // taken whole and growing carries on from the next tet.
+    vector<int> members;
+    members.reserve(count);
+    for (unsigned int t = 0; t < tets.size(); t++) {
+        if (parts[t] == part) {
+            members.push_back(t);
+        }
+    }
+    vector<int> first;
+    first.reserve(firstCount);
+    vector<int> trial;
+    const int firstStamp = ++stamp;
+    for (int start : members) {
+        if (first.size() >= firstCount) {
+            break;
+        }
+        if (visited[start] == firstStamp) {
+            continue;
+        }
+        trial.clear();
+        traverse(start, part, tets.size(), tets, incidence, parts, ++stamp, visited, trial);
+        int peripheral = trial.back();
+        for (int t : first) {
+            visited[t] = firstStamp;
+        }
+        traverse(peripheral, part, firstCount, tets, incidence, parts, firstStamp, visited, first);
+    }
+
+    // The second half is everything else, renumbered past the first half's
+    // parts.
+    const int secondPart = part + firstParts;
+    for (int t : members) {
+        if (visited[t] != firstStamp) {
+            parts[t] = secondPart;
+        }
+    }
+    bisect(part, first.size(), firstParts, tets, incidence, parts, stamp, visited);
+    bisect(secondPart, count - first.size(), numParts - firstParts, tets, incidence, parts, stamp, visited);
+}
+
+}
+
+vector<int> MeshPartition::partitionTets(const vector<Vector4i> &tets, int numVertices, int numParts)
+{
+    const int numTets = static_cast<int>(tets.size());
+    Incidence incidence;
+    incidence.start.assign(numVertices + 1, 0);
+    for (const Vector4i &tet : tets) {
+        for (int n = 0; n < 4; n++) {
+            incidence.start[tet[n] + 1]++;
+        }
+    }
+    partial_sum(incidence.start.begin(), incidence.start.end(), incidence.start.begin());
+    incidence.tets.resize(incidence.start.back());
+    vector<int> fill(incidence.start.begin(), incidence.start.end() - 1);
+    for (int t = 0; t < numTets; t++) {
+        for (int n = 0; n < 4; n++) {
+            incidence.tets[fill[tets[t][n]]++] = t;
+        }
+    }
+
+    vector<int> parts(numTets, 0);
+    vector<int> visited(numTets, 0);
+    int stamp = 0;
+    bisect(0, numTets, numParts, tets, incidence, parts, stamp, visited);
+    return parts;
+}
@@ -0,0 +1,29 @@
+#ifndef MESHPARTITION_H
+#define MESHPARTITION_H
+
+#include <vector>
+#include <Eigen/Dense>
+#include <Eigen/StdVector>
+
+/**
+ * Splits a tet mesh into parts of about equal numbers of tets with short
+ * boundaries between them, for simulating each part in a process of its
+ * own. Two tets are adjacent if they share a vertex, as in MeshReorder.
+ */
+class MeshPartition
+{
+public:
+    /**
+     * Part of each tet, from 0 to numParts - 1, by recursive graph
+     * bisection: each part is split by growing one half breadth first from
+     * a pseudo-peripheral tet until it holds its share, so halves are
+     * connected and their boundary is one traversal level. The same input
+     * always gives the same parts.
+     */
+    static std::vector<int> partitionTets(const std::vector<Eigen::Vector4i> &tets, int numVertices, int numParts);
+
+private:
+    MeshPartition();
+};
+
+#endif // MESHPARTITION_H
@@ -0,0 +1,160 @@
+#include "meshreorder.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <numeric>
+
+using namespace Eigen;
+using namespace std;
+
+namespace {
+
+const int MORTON_BITS = 21;
+
+// Spreads the low 21 bits of x so there are two zero bits between each.
+uint64_t spreadBits(uint64_t x)
+{
+    x &= 0x1FFFFF;
+    x = (x | x << 32) & 0x1F00000000FFFFull;
+    x = (x | x << 16) & 0x1F0000FF0000FFull;
+    x = (x | x << 8) & 0x100F00F00F00F00Full;
+    x = (x | x << 4) & 0x10C30C30C30C30C3ull;
+    x = (x | x << 2) & 0x1249249249249249ull;
+    return x;
+}
+
+/**
+ * Breadth first traversal of one connected component of tets from start.
+ * Each tet's unvisited neighbors are appended in order of increasing degree.
+ */
+void traverse(int start, const vector<Vector4i> &tets, const vector<int> &incidenceStart,
+              const vector<int> &incidence, const vector<int> &degree, int stamp,
+              vector<int> &visited, vector<int> &order)
+{
+    size_t head = order.size();
+    order.push_back(start);
+    visited[start] = stamp;
+    vector<int> neighbors;
+    while (head < order.size()) {
+        const Vector4i &tet = tets[order[head++]];
+        neighbors.clear();
+        for (int n = 0; n < 4; n++) {
+            for (int i = incidenceStart[tet[n]]; i < incidenceStart[tet[n] + 1]; i++) {
+                int neighbor = incidence[i];
+                if (visited[neighbor] != stamp) {
+                    visited[neighbor] = stamp;
+                    neighbors.push_back(neighbor);
+                }
+            }
+        }
+        sort(neighbors.begin(), neighbors.end(), [&degree](int a, int b) {
+            return degree[a] < degree[b] || (degree[a] == degree[b] && a < b);
+        });
+        order.insert(order.end(), neighbors.begin(), neighbors.end());
+    }
+}
+
+}
+
+vector<int> MeshReorder::mortonVertexOrder(const vector<Vector3f> &vertices)
+{
+    vector<int> order(vertices.size());
+    iota(order.begin(), order.end(), 0);
+    if (vertices.empty()) {
+        return order;
+    }
+
+    Vector3f lo = vertices[0];
+    Vector3f hi = vertices[0];
+    for (const Vector3f &v : vertices) {
+        lo = lo.cwiseMin(v);
+        hi = hi.cwiseMax(v);
+    }
+    const float cells = static_cast<float>((1 << MORTON_BITS) - 1);
+    Vector3f scale = (hi - lo).cwiseMax(Vector3f::Constant(1e-20f)).cwiseInverse() * cells;
+
+    vector<uint64_t> codes(vertices.size());
+    for (unsigned int i = 0; i < vertices.size(); i++) {
+        Vector3f cell = (vertices[i] - lo).cwiseProduct(scale);
+        codes[i] = spreadBits(static_cast<uint64_t>(cell[0])) |
+                   spreadBits(static_cast<uint64_t>(cell[1])) << 1 |
+                   spreadBits(static_cast<uint64_t>(cell[2])) << 2;
+    }
+    stable_sort(order.begin(), order.end(), [&codes](int a, int b) { return codes[a] < codes[b]; });
+    return order;
+}
+
+vector<int> MeshReorder::cuthillMcKeeTetOrder(const vector<Vector4i> &tets, int numVertices)
+{
+    const int numTets = static_cast<int>(tets.size());
+
+    // Vertex to tet incidence in compressed rows.
+    vector<int> incidenceStart(numVertices + 1, 0);
+    for (const Vector4i &tet : tets) {
+        for (int n = 0; n < 4; n++) {
+            incidenceStart[tet[n] + 1]++;
+        }
+    }
+    partial_sum(incidenceStart.begin(), incidenceStart.end(), incidenceStart.begin());
+    vector<int> incidence(incidenceStart.back());
+    vector<int> fill(incidenceStart.begin(), incidenceStart.end() - 1);
+    for (int t = 0; t < numTets; t++) {
+        for (int n = 0; n < 4; n++) {
+            incidence[fill[tets[t][n]]++] = t;
+        }
+    }
+
+    // Summed node valence stands in for the exact number of neighbor tets.
+    vector<int> degree(numTets, 0);
+    for (int t = 0; t < numTets; t++) {
+        for (int n = 0; n < 4; n++) {
+            degree[t] += incidenceStart[tets[t][n] + 1] - incidenceStart[tets[t][n]];
+        }
+    }
+
+    vector<int> byDegree(numTets);
+    iota(byDegree.begin(), byDegree.end(), 0);
+    stable_sort(byDegree.begin(), byDegree.end(), [&degree](int a, int b) { return degree[a] < degree[b]; });
+
+    // visited holds the stamp of the last traversal that reached each tet.
+    // Odd stamps are trial traversals, even stamps are final ones.
+    vector<int> visited(numTets, 0);
+    vector<int> order;
+    order.reserve(numTets);
+    vector<int> trial;
+    int stamp = 0;
+    for (int start : byDegree) {
+        if (visited[start] != 0 && visited[start] % 2 == 0) {
+            continue;
+        }
+        // The last tet reached from a low degree tet is a pseudo-peripheral
+        // start, which gives narrower traversal levels.
+        trial.clear();
+        traverse(start, tets, incidenceStart, incidence, degree, ++stamp, visited, trial);
+        traverse(trial.back(), tets, incidenceStart, incidence, degree, ++stamp, visited, order);
+    }
+    reverse(order.begin(), order.end());
+    return order;
+}
+
+vector<int> MeshReorder::reorder(vector<Vector3f> &vertices, vector<Vector4i> &tets)
+{
+    vector<int> vertexOrder = mortonVertexOrder(vertices);
+    vector<int> newIndex(vertices.size());
+    vector<Vector3f> newVertices(vertices.size());
+    for (unsigned int i = 0; i < vertexOrder.size(); i++) {
+        newIndex[vertexOrder[i]] = i;
+        newVertices[i] = vertices[vertexOrder[i]];
+    }
+
+    vector<int> tetOrder = cuthillMcKeeTetOrder(tets, vertices.size());
+    vector<Vector4i> newTets(tets.size());
+    for (unsigned int i = 0; i < tetOrder.size(); i++) {
+        const Vector4i &tet = tets[tetOrder[i]];
+        newTets[i] = Vector4i(newIndex[tet[0]], newIndex[tet[1]], newIndex[tet[2]], newIndex[tet[3]]);
+    }
+
+    vertices.swap(newVertices);
+    tets.swap(newTets);
+    return vertexOrder;
+}
@@ -0,0 +1,43 @@
+#ifndef MESHREORDER_H
+#define MESHREORDER_H
+
+#include <vector>
+#include <Eigen/Dense>
+#include <Eigen/StdVector>
+
+/**
+ * Load time renumbering of a tet mesh for memory locality. Mesh files list
+ * vertices and tets in arbitrary order, which makes the per tet gathers of
+ * node positions and scatters of node forces jump all over memory.
+ *
+ * Orders are returned as new-to-old index lists: order[newIndex] is the
+ * index the element had in the file.
+ */
+class MeshReorder
+{
+public:
+    /**
+     * Sorts vertices along a Morton (Z order) curve through their bounding
+     * box so vertices close in space are close in memory.
+     */
+    static std::vector<int> mortonVertexOrder(const std::vector<Eigen::Vector3f> &vertices);
+
+    /**
+     * Reverse Cuthill-McKee order of the tets, where two tets are adjacent if
+     * they share a vertex. Neighboring tets end up close together, which keeps
+     * the set of nodes touched by a run of tets small.
+     */
+    static std::vector<int> cuthillMcKeeTetOrder(const std::vector<Eigen::Vector4i> &tets, int numVertices);
+
+    /**
+     * Reorders vertices with mortonVertexOrder and tets with
+     * cuthillMcKeeTetOrder, remapping tet indices to the new vertex numbers.
+     * Returns the vertex order, i.e. the file index of every vertex.
+     */
+    static std::vector<int> reorder(std::vector<Eigen::Vector3f> &vertices, std::vector<Eigen::Vector4i> &tets);
+
+private:
+    MeshReorder();
+};
+
+#endif // MESHREORDER_H
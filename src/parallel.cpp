@@ -0,0 +1,329 @@
+#include "parallel.h"
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <thread>
+#include <vector>
+#include <unsupported/Eigen/CXX11/ThreadPool>
+
+using namespace std;
+
+namespace {
+
+typedef chrono::steady_clock Clock;
+
+long long nanosSince(Clock::time_point start)
+{
+    return chrono::duration_cast<chrono::nanoseconds>(Clock::now() - start).count();
+}
+
+unsigned int hardwareThreads()
+{
+    unsigned int n = thread::hardware_concurrency();
+    return n == 0 ? 1 : n;
+}
+
+/** The pool and its size; no pool when there is one thread. */
+struct Pool
+{
+    Pool():
+        threads(hardwareThreads())
+    {
+        start();
+    }
+
+    void start()
+    {
+        pool.reset(threads > 1 ? new Eigen::NonBlockingThreadPool(threads - 1) : nullptr);
+    }
+
+    unsigned int threads;
+    unique_ptr<Eigen::NonBlockingThreadPool> pool;
+};
+
+Pool &sharedPool()
+{
+    static Pool pool;
+    return pool;
+}
+
+vector<Parallel::Stage *> &stages()
+{
+    static vector<Parallel::Stage *> stages;
+    return stages;
+}
+
+mutex &stagesMutex()
+{
+    static mutex m;
+    return m;
+}
+
+thread_local Parallel::Stage *currentStage = nullptr;
+
+// Set while the thread's loops run in place, see SerialScope.
+thread_local bool serial = false;
+
+// Set while the thread runs a loop's task, whose time is already charged to
+// the loop, so loops nested in it don't charge it again.
+thread_local bool inTask = false;
+
+}
+
+Parallel::Stage::Stage(const char *name):
+    m_name(name),
+    m_calls(0),
+    m_wallNanos(0),
+    m_busyNanos(0),
+    m_loopNanos(0)
+{
+    lock_guard<mutex> lock(stagesMutex());
+    stages().push_back(this);
+}
+
+const char *Parallel::Stage::name() const
+{
+    return m_name;
+}
+
+Parallel::StageTimer::StageTimer(Stage &stage):
+    m_stage(stage),
+    m_outer(currentStage),
+    m_start(Clock::now())
+{
+    currentStage = &stage;
+}
+
+Parallel::StageTimer::~StageTimer()
+{
+    currentStage = m_outer;
+    m_stage.m_calls.fetch_add(1, memory_order_relaxed);
+    m_stage.m_wallNanos.fetch_add(nanosSince(m_start), memory_order_relaxed);
+}
+
+/** A loop's tasks, shared with the copies of work queued on the pool. */
+struct Parallel::Loop
+{
+    const function<void(unsigned int)> *task;
+    Stage *stage;
+    unsigned int numTasks;
+    /** The next task no thread has started. */
+    atomic<unsigned int> next;
+    mutex m;
+    condition_variable done;
+    unsigned int finished;
+};
+
+/** One run of a graph, shared with the copies of runNode queued on the pool. */
+struct Parallel::GraphRun
+{
+    vector<Parallel::TaskGraph::Node> *nodes;
+    /** Per task: dependencies not finished yet, and whether a thread took it. */
+    unique_ptr<atomic<int>[]> waiting;
+    unique_ptr<atomic<bool>[]> taken;
+    mutex m;
+    condition_variable changed;
+    int finished;
+};
+
+int Parallel::TaskGraph::add(Stage &stage, function<void()> task, initializer_list<int> after)
+{
+    int id = m_nodes.size();
+    m_nodes.push_back(Node());
+    Node &node = m_nodes.back();
+    node.stage = &stage;
+    node.task = move(task);
+    node.numDependencies = after.size();
+    for (int dependency : after) {
+        m_nodes[dependency].dependents.push_back(id);
+    }
+    return id;
+}
+
+void Parallel::TaskGraph::clear()
+{
+    m_nodes.clear();
+}
+
+void Parallel::TaskGraph::run()
+{
+    const int numNodes = m_nodes.size();
+    shared_ptr<GraphRun> run = make_shared<GraphRun>();
+    run->nodes = &m_nodes;
+    run->waiting.reset(new atomic<int>[numNodes]);
+    run->taken.reset(new atomic<bool>[numNodes]);
+    run->finished = 0;
+    for (int i = 0; i < numNodes; i++) {
+        run->waiting[i] = m_nodes[i].numDependencies;
+        run->taken[i] = false;
+    }
+
+    Pool &pool = sharedPool();
+    if (pool.pool && !serial) {
+        for (int i = 0; i < numNodes; i++) {
+            if (m_nodes[i].numDependencies == 0) {
+                pool.pool->Schedule([run, i]() { runNode(run, i); });
+            }
+        }
+    }
+    // Take the first ready task nobody has started, or wait for a running
+    // one to ready more.
+    while (true) {
+        int ready = -1;
+        {
+            unique_lock<mutex> lock(run->m);
+            run->changed.wait(lock, [&]() {
+                if (run->finished == numNodes) {
+                    return true;
+                }
+                for (int i = 0; i < numNodes; i++) {
+                    if (run->waiting[i] == 0 && !run->taken[i]) {
+                        ready = i;
+                        return true;
+                    }
+                }
+                return false;
+            });
+        }
+        if (ready < 0) {
+            return;
+        }
+        runNode(run, ready);
+    }
+}
+
+void Parallel::runNode(const shared_ptr<GraphRun> &run, int node)
+{
+    if (run->taken[node].exchange(true)) {
+        return;
+    }
+    TaskGraph::Node &task = (*run->nodes)[node];
+    {
+        StageTimer timer(*task.stage);
+        task.task();
+    }
+    Pool &pool = sharedPool();
+    for (int dependent : task.dependents) {
+        if (--run->waiting[dependent] == 0 && pool.pool && !serial) {
+            pool.pool->Schedule([run, dependent]() { runNode(run, dependent); });
+        }
+    }
+    lock_guard<mutex> lock(run->m);
+    run->finished++;
+    run->changed.notify_all();
+}
+
+Parallel::SerialScope::SerialScope():
+    m_outer(serial)
+{
+    serial = true;
+}
+
+Parallel::SerialScope::~SerialScope()
+{
+    serial = m_outer;
+}
+
+unsigned int Parallel::threadCount()
+{
+    return sharedPool().threads;
+}
+
+void Parallel::setThreadCount(unsigned int count)
+{
+    Pool &pool = sharedPool();
+    pool.pool.reset();
+    pool.threads = count == 0 ? hardwareThreads() : count;
+    pool.start();
+}
+
+void Parallel::runTasks(unsigned int numTasks, const function<void(unsigned int)> &task)
+{
+    if (numTasks == 0) {
+        return;
+    }
+    Pool &pool = sharedPool();
+    // Loops run in place count as the timing thread's own work.
+    if (numTasks == 1 || !pool.pool || serial) {
+        for (unsigned int t = 0; t < numTasks; t++) {
+            task(t);
+        }
+        return;
+    }
+
+    Clock::time_point start = Clock::now();
+    shared_ptr<Loop> loop = make_shared<Loop>();
+    loop->task = &task;
+    loop->stage = currentStage;
+    loop->numTasks = numTasks;
+    loop->next = 0;
+    loop->finished = 0;
+    // Each helper takes tasks until none are left, so there's no point in
+    // more helpers than workers.
+    unsigned int helpers = min(numTasks - 1, pool.threads - 1);
+    for (unsigned int h = 0; h < helpers; h++) {
+        pool.pool->Schedule([loop]() { work(*loop); });
+    }
+    work(*loop);
+    {
+        unique_lock<mutex> lock(loop->m);
+        loop->done.wait(lock, [&]() { return loop->finished == numTasks; });
+    }
+    if (loop->stage && !inTask) {
+        loop->stage->m_loopNanos.fetch_add(nanosSince(start), memory_order_relaxed);
+    }
+}
+
+void Parallel::work(Loop &loop)
+{
+    for (unsigned int t = loop.next++; t < loop.numTasks; t = loop.next++) {
+        // Loops started by the task are charged to the same stage.
+        Stage *outerStage = currentStage;
+        bool outerInTask = inTask;
+        currentStage = loop.stage;
+        inTask = true;
+        Clock::time_point start = Clock::now();
+        (*loop.task)(t);
+        if (loop.stage && !outerInTask) {
+            loop.stage->m_busyNanos.fetch_add(nanosSince(start), memory_order_relaxed);
+        }
+        currentStage = outerStage;
+        inTask = outerInTask;
+
+        lock_guard<mutex> lock(loop.m);
+        if (++loop.finished == loop.numTasks) {
+            loop.done.notify_all();
+        }
+    }
+}
+
+void Parallel::printStats(ostream &out)
+{
+    lock_guard<mutex> lock(stagesMutex());
+    unsigned int threads = threadCount();
+    for (const Stage *stage : stages()) {
+        long long calls = stage->m_calls.load();
+        if (calls == 0) {
+            continue;
+        }
+        // The timing thread is busy whenever it isn't waiting on a loop, and
+        // the loops' tasks count for themselves.
+        double wall = stage->m_wallNanos.load();
+        double busy = stage->m_busyNanos.load() + max(0.0, wall - stage->m_loopNanos.load());
+        out << stage->name() << ": " << calls << " runs, " << wall * 1e-6 / calls << " ms each, "
+            << 100 * busy / (wall * threads) << "% of " << threads << " threads busy" << endl;
+    }
+}
+
+void Parallel::resetStats()
+{
+    lock_guard<mutex> lock(stagesMutex());
+    for (Stage *stage : stages()) {
+        stage->m_calls = 0;
+        stage->m_wallNanos = 0;
+        stage->m_busyNanos = 0;
+        stage->m_loopNanos = 0;
+    }
+}
@@ -0,0 +1,195 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <initializer_list>
+#include <iosfwd>
+#include <memory>
+#include <vector>
+
+/**
+ * Splits loops across one shared work-stealing thread pool. The pool has
+ * threadCount() - 1 workers and the calling thread takes part in each loop,
+ * so a loop never waits for a thread to start. A thread waiting on a loop
+ * or graph first runs whatever of it no thread has started, and only then
+ * waits for what others are running, so loops can start loops from any
+ * thread without deadlocking.
+ *
+ * Time spent in the pool is charged to the Stage timed on the thread that
+ * started the loop, so each stage of a step can report how busy it kept the
+ * threads.
+ */
+class Parallel
+{
+public:
+    /**
+     * A named part of the work, such as force evaluation or collision.
+     * Stages live for the whole program and are listed by printStats in the
+     * order they were first made.
+     */
+    class Stage
+    {
+    public:
+        explicit Stage(const char *name);
+
+        const char *name() const;
+
+    private:
+        friend class Parallel;
+
+        const char *m_name;
+        std::atomic<long long> m_calls;
+        std::atomic<long long> m_wallNanos;
+        /** Time threads spent on the stage's work, summed over threads. */
+        std::atomic<long long> m_busyNanos;
+        /** Time the timing thread spent waiting on loops, out of m_wallNanos. */
+        std::atomic<long long> m_loopNanos;
+    };
+
+    /**
+     * Times the enclosing scope as a stage, and charges the loops started in
+     * it on this thread to the stage. Timers nest; the inner one wins.
+     */
+    class StageTimer
+    {
+    public:
+        explicit StageTimer(Stage &stage);
+        ~StageTimer();
+
+    private:
+        Stage &m_stage;
+        Stage *m_outer;
+        std::chrono::steady_clock::time_point m_start;
+    };
+
+    /**
+     * Tasks that depend on each other, each run as soon as the tasks it
+     * depends on have finished, so independent stages overlap. Tasks are
+     * added after the tasks they depend on. The calling thread runs ready
+     * tasks in the order they were added, and idle workers take the others,
+     * so the first ready task of each wave runs on the calling thread. A
+     * graph can be run any number of times.
+     */
+    class TaskGraph
+    {
+    public:
+        /**
+         * Adds a task, timed as the given stage, to run after the tasks with
+         * the given ids. Returns the task's id.
+         */
+        int add(Stage &stage, std::function<void()> task, std::initializer_list<int> after = {});
+
+        /** Runs every task and waits for all of them. */
+        void run();
+
+        void clear();
+
+    private:
+        friend class Parallel;
+
+        struct Node
+        {
+            Stage *stage;
+            std::function<void()> task;
+            /** Tasks that depend on this one. */
+            std::vector<int> dependents;
+            int numDependencies;
+        };
+
+        std::vector<Node> m_nodes;
+    };
+
+    /**
+     * While one lives, the loops and graphs its thread starts run on that
+     * thread alone. For work that keeps every thread busy on its own, like
+     * many scenes stepped side by side.
+     */
+    class SerialScope
+    {
+    public:
+        SerialScope();
+        ~SerialScope();
+
+    private:
+        bool m_outer;
+    };
+
+    /**
+     * Number of threads loops are split across, the workers and the calling
+     * thread, always at least one.
+     */
+    static unsigned int threadCount();
+
+    /**
+     * Rebuilds the pool for count threads, or one per hardware thread for
+     * zero. Only call it while no loops or tasks are running.
+     */
+    static void setThreadCount(unsigned int count);
+
+    /**
+     * Calls func(threadIndex) once for each index below numThreads and waits
+     * for all of them. No index runs on two threads at once, so indices can
+     * pick scratch space.
+     */
+    template <typename Func>
+    static void forEachThread(unsigned int numThreads, Func func)
+    {
+        runTasks(numThreads, [&func](unsigned int t) { func(t); });
+    }
+
+    /**
+     * Calls func(chunkBegin, chunkEnd) over [begin, end) split into
+     * contiguous chunks of at least grainSize elements. There are a few
+     * chunks per thread where the range allows, so threads that finish
+     * early steal what's left from slower ones.
+     */
+    template <typename Func>
+    static void forRange(int begin, int end, int grainSize, Func func)
+    {
+        int count = end - begin;
+        if (count <= 0) {
+            return;
+        }
+        int maxChunks = std::max(1, count / std::max(1, grainSize));
+        int numChunks = std::min(static_cast<int>(threadCount() * CHUNKS_PER_THREAD), maxChunks);
+        if (threadCount() == 1) {
+            numChunks = 1;
+        }
+        int chunk = (count + numChunks - 1) / numChunks;
+        runTasks(numChunks, [&](unsigned int c) {
+            int chunkBegin = begin + static_cast<int>(c) * chunk;
+            int chunkEnd = std::min(end, chunkBegin + chunk);
+            if (chunkBegin < chunkEnd) {
+                func(chunkBegin, chunkEnd);
+            }
+        });
+    }
+
+    /**
+     * Writes, per stage, the number of times it ran, the time per run and
+     * the share of the threads' time it kept busy.
+     */
+    static void printStats(std::ostream &out);
+
+    static void resetStats();
+
+private:
+    static const unsigned int CHUNKS_PER_THREAD = 4;
+
+    struct Loop;
+    struct GraphRun;
+
+    /** Runs task(0) to task(numTasks - 1) across the pool and waits for them. */
+    static void runTasks(unsigned int numTasks, const std::function<void(unsigned int)> &task);
+
+    /** Runs the loop's tasks no thread has started yet. */
+    static void work(Loop &loop);
+
+    /** Runs the graph's task if no other thread has, and readies its dependents. */
+    static void runNode(const std::shared_ptr<GraphRun> &run, int node);
+};
+
+#endif // PARALLEL_H
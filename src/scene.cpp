@@ -0,0 +1,362 @@
+#include "scene.h"
+
+#include <cmath>
+#include <iostream>
+#include <set>
+
+#include "graphics/BinaryMesh.h"
+#include "meshcache.h"
+#include "parallel.h"
+#include "settings.h"
+#include "surfaceextractor.h"
+
+using namespace Eigen;
+using namespace std;
+
+Translation3f shapeTranslation = Translation3f(0, 3, 0);
+Vector3f spherePos = Vector3f(0, 0, 0);
+float sphereRadius = 1;
+
+namespace {
+
+Parallel::Stage refitStage("refit");
+
+}
+
+Scene::Scene():
+    Scene(incompressibility, rigidity, phi, psi, density)
+{
+
+}
+
+Scene::Scene(float incompressibility, float rigidity, float phi, float psi, float density):
+    m_system(),
+    m_solver(incompressibility, rigidity, phi, psi, density),
+    m_density(density)
+{
+
+}
+
+bool Scene::init()
+{
+    BinaryMesh binary;
+    if (!MeshCache::load(meshFile.toStdString(), binary, reorderMesh)) {
+        initColliders();
+        return false;
+    }
+    return init(binary);
+}
+
+bool Scene::init(const BinaryMesh &binary)
+{
+    // The surface, rest data and masses come precomputed from a binary mesh
+    // or the mesh's cache sidecar, so only particles and tets are built here.
+    binary.copyVertices(m_vertices);
+    binary.copyTets(m_tets);
+    binary.copyExternalIds(m_externalIds);
+
+    // A surface face is a face that belongs to only one tet.
+    if (binary.hasFaces()) {
+        binary.copyFaces(m_faces);
+    } else {
+        m_faces = SurfaceExtractor::extractSurface(m_tets);
+    }
+
+    // Every copy of the mesh shares its masses and rest data.
+    const int bodyVertices = m_vertices.size();
+    const int bodyTets = m_tets.size();
+    const int bodyFaces = m_faces.size();
+    placeBodies(bodyCount);
+
+    // The masses are only used along with the rest data. Without both the
+    // tets work out their rest data and add their masses themselves.
+    const float *masses = binary.masses();
+    const float *restData = binary.restStride() == TetRestData::NUM_FLOATS ? binary.restData() : nullptr;
+    const bool precomputed = restData && masses;
+    for (unsigned int i = 0; i < m_vertices.size(); i++) {
+        float mass = precomputed ? 1 + m_density * masses[i % bodyVertices] : 1;
+        m_system.setParticle(i, make_shared<Particle>(Particle(m_vertices.at(i) + shapeTranslation.vector(), i, mass)));
+    }
+
+    std::vector<Tet> tetsList = std::vector<Tet>();
+    tetsList.reserve(m_tets.size());
+    for (unsigned int i = 0; i < m_tets.size(); i++) {
+        const Vector4i &tet = m_tets[i];
+        shared_ptr<Particle> m1 = m_system.getParticle(tet[0]);
+        shared_ptr<Particle> m2 = m_system.getParticle(tet[1]);
+        shared_ptr<Particle> m3 = m_system.getParticle(tet[2]);
+        shared_ptr<Particle> m4 = m_system.getParticle(tet[3]);
+
+        if (precomputed) {
+            tetsList.push_back(Tet(m1, m2, m3, m4, TetRestData::fromFloats(restData + (i % bodyTets) * TetRestData::NUM_FLOATS)));
+        } else {
+            tetsList.push_back(Tet(m1, m2, m3, m4, m_density));
+        }
+    }
+    m_system.setTets(tetsList);
+
+    // Only particles on the surface are tested against colliders.
+    vector<bool> onSurface(m_vertices.size(), false);
+    for (const Vector3i &face : m_faces) {
+        onSurface[face[0]] = onSurface[face[1]] = onSurface[face[2]] = true;
+    }
+    vector<int> surfaceParticles;
+    for (unsigned int i = 0; i < onSurface.size(); i++) {
+        if (onSurface[i]) {
+            surfaceParticles.push_back(i);
+        }
+    }
+    m_system.setSurfaceParticles(surfaceParticles);
+    if (selfCollision) {
+        m_system.setSelfCollision(make_shared<SelfCollision>(m_faces, m_vertices));
+    }
+    if (bodyCount > 1) {
+        shared_ptr<BodyContacts> bodyContacts = make_shared<BodyContacts>();
+        for (int b = 0; b < bodyCount; b++) {
+            bodyContacts->addBody(vector<Vector3i>(m_faces.begin() + b * bodyFaces, m_faces.begin() + (b + 1) * bodyFaces),
+                                  m_vertices);
+        }
+        m_system.setBodyContacts(bodyContacts);
+    }
+
+    double edgeSum = 0;
+    for (const Vector3i &face : m_faces) {
+        for (int k = 0; k < 3; k++) {
+            edgeSum += (m_vertices[face[(k + 1) % 3]] - m_vertices[face[k]]).norm();
+        }
+    }
+    const float meanEdge = m_faces.empty() ? 0 : edgeSum / (m_faces.size() * 3);
+
+    // A particle moving less than half a surface edge per step can't
+    // get far past a collider's surface before its penalty catches it.
+    if (sweepCollisions && !m_faces.empty()) {
+        m_solver.setSweepThreshold(0.5f * meanEdge);
+    }
+
+    // Each copy of the mesh sleeps on its own, or with those it rests on.
+    if (sleepThreshold > 0 && meanEdge > 0) {
+        shared_ptr<SleepIslands> sleepIslands = make_shared<SleepIslands>(sleepThreshold * meanEdge, surfaceParticles);
+        for (int b = 0; b < bodyCount; b++) {
+            sleepIslands->addBody(b * bodyVertices, bodyVertices, b * bodyTets, bodyTets);
+        }
+        m_system.setSleepIslands(sleepIslands);
+    }
+    m_surfaceBVH.build(m_faces, m_vertices);
+    initColliders();
+    return !m_vertices.empty();
+}
+
+void Scene::update(float seconds)
+{
+    m_solver.midpointStep(m_system, seconds);
+
+    Parallel::StageTimer timer(refitStage);
+    for (unsigned int i = 0; i < m_vertices.size(); i++) {
+        assert(m_system.getParticlesMap().count(i) == 1);
+        m_vertices.at(i) = m_system.getParticlesMap()[i]->getWorldPosition() - shapeTranslation.vector();
+    }
+    m_surfaceBVH.refit(m_vertices);
+}
+
+void Scene::setForceExchange(function<void(System &)> exchange)
+{
+    m_solver.setForceExchange(move(exchange));
+}
+
+void Scene::zeroPush()
+{
+    shared_ptr<Particle> null;
+    m_system.setPushForce(null, null, null, Vector3f::Zero());
+}
+
+void Scene::castClickRay(Vector3f point, Vector3f direction, float force)
+{
+    // The surface BVH is kept in the shape's model space.
+    int face;
+    float dist;
+    bool hit = m_surfaceBVH.intersect(point - shapeTranslation.vector(), direction, face, dist);
+
+    shared_ptr<Particle> mp1;
+    shared_ptr<Particle> mp2;
+    shared_ptr<Particle> mp3;
+
+    if (hit) {
+        mp1 = m_system.getParticle(m_faces[face][0]);
+        mp2 = m_system.getParticle(m_faces[face][1]);
+        mp3 = m_system.getParticle(m_faces[face][2]);
+        m_system.setPushForce(mp1, mp2, mp3, direction * force);
+    } else {
+        m_system.setPushForce(mp1, mp2, mp3, Vector3f::Zero());
+    }
+}
+
+void Scene::castBrushRays(Vector3f point, Vector3f direction, float radius, float force)
+{
+    // A disc of parallel rays around the center ray: the center, then rings
+    // of evenly spaced samples out to radius.
+    const int RINGS = 3;
+    const int RING_SAMPLES = 12;
+    Vector3f origin = point - shapeTranslation.vector();
+    Vector3f side = direction.unitOrthogonal();
+    Vector3f up = direction.cross(side);
+    vector<Vector3f> origins;
+    origins.reserve(1 + RINGS * RING_SAMPLES);
+    origins.push_back(origin);
+    for (int ring = 1; ring <= RINGS; ring++) {
+        float r = radius * ring / RINGS;
+        for (int i = 0; i < RING_SAMPLES; i++) {
+            float angle = 2 * M_PI * (i + 0.5f * ring) / RING_SAMPLES;
+            origins.push_back(origin + r * (cosf(angle) * side + sinf(angle) * up));
+        }
+    }
+    vector<Vector3f> directions(origins.size(), direction);
+    vector<int> faces(origins.size());
+    vector<float> dists(origins.size());
+    m_surfaceBVH.intersectPacket(origins.data(), directions.data(), origins.size(), faces.data(), dists.data());
+
+    set<int> nodes;
+    for (int face : faces) {
+        if (face >= 0) {
+            nodes.insert(m_faces[face][0]);
+            nodes.insert(m_faces[face][1]);
+            nodes.insert(m_faces[face][2]);
+        }
+    }
+    if (nodes.empty()) {
+        zeroPush();
+        return;
+    }
+
+    // Spread the force so the brush pushes as hard in total as a single
+    // click does on its three nodes.
+    vector<shared_ptr<Particle>> pushNodes;
+    for (int node : nodes) {
+        pushNodes.push_back(m_system.getParticle(node));
+    }
+    m_system.setPushForce(pushNodes, direction * force * 3.f / pushNodes.size());
+}
+
+const vector<Vector3f> &Scene::getVertices() const
+{
+    return m_vertices;
+}
+
+const vector<Vector3i> &Scene::getFaces() const
+{
+    return m_faces;
+}
+
+const vector<Vector4i> &Scene::getTets() const
+{
+    return m_tets;
+}
+
+const vector<int> &Scene::getExternalVertexIds() const
+{
+    return m_externalIds;
+}
+
+System &Scene::getSystem()
+{
+    return m_system;
+}
+
+double Scene::kineticEnergy()
+{
+    double energy = 0;
+    for (unsigned int i = 0; i < m_system.getParticlesMap().size(); i++) {
+        const Particle &particle = *m_system.getParticle(i);
+        energy += 0.5 * particle.getMass() * particle.getVelocity().squaredNorm();
+    }
+    return energy;
+}
+
+void Scene::shareObstacles(const Scene &other)
+{
+    m_sdfObstacle = other.m_sdfObstacle;
+    m_meshObstacle = other.m_meshObstacle;
+}
+
+shared_ptr<CollisionSDF> Scene::getSdfObstacle() const
+{
+    return m_sdfObstacle;
+}
+
+shared_ptr<CollisionTriMesh> Scene::getMeshObstacle() const
+{
+    return m_meshObstacle;
+}
+
+void Scene::initColliders()
+{
+    m_system.addCollider(make_shared<CollisionPlane>(CollisionPlane(Vector3f(0, 0, 0), Vector3f(0, 1, 0))));
+    m_system.addCollider(make_shared<CollisionSphere>(CollisionSphere(spherePos, sphereRadius)));
+
+    if (!m_sdfObstacle && !sdfObstacleFile.isEmpty()) {
+        shared_ptr<CollisionSDF> sdf = make_shared<CollisionSDF>();
+        if (sdf->load(sdfObstacleFile.toStdString())) {
+            m_sdfObstacle = sdf;
+        }
+    }
+    if (m_sdfObstacle) {
+        m_system.addCollider(m_sdfObstacle);
+    }
+    if (!m_meshObstacle && !meshObstacleFile.isEmpty()) {
+        shared_ptr<CollisionTriMesh> mesh = make_shared<CollisionTriMesh>();
+        if (mesh->load(meshObstacleFile.toStdString())) {
+            m_meshObstacle = mesh;
+        }
+    }
+    if (m_meshObstacle) {
+        m_system.addCollider(m_meshObstacle);
+    }
+}
+
+void Scene::placeBodies(int count)
+{
+    if (count <= 1) {
+        return;
+    }
+
+    // Copies go side by side in square layers, a quarter of the mesh's size
+    // apart, and the layers stack upwards from where the single mesh sits.
+    AlignedBox3f box;
+    box.setEmpty();
+    for (const Vector3f &v : m_vertices) {
+        box.extend(v);
+    }
+    const Vector3f spacing = 1.25f * box.sizes();
+    const int side = static_cast<int>(ceil(cbrt(static_cast<double>(count)) - 1e-9));
+    const int numVertices = m_vertices.size();
+    const int numTets = m_tets.size();
+    const int numFaces = m_faces.size();
+    const int numIds = m_externalIds.size();
+    m_vertices.reserve(numVertices * count);
+    m_tets.reserve(numTets * count);
+    m_faces.reserve(numFaces * count);
+    m_externalIds.reserve(numIds * count);
+    for (int b = 1; b < count; b++) {
+        Vector3f offset((b % side - 0.5f * (side - 1)) * spacing.x(),
+                        (b / (side * side)) * spacing.y(),
+                        ((b / side) % side - 0.5f * (side - 1)) * spacing.z());
+        const int first = b * numVertices;
+        for (int i = 0; i < numVertices; i++) {
+            m_vertices.push_back(m_vertices[i] + offset);
+        }
+        for (int i = 0; i < numTets; i++) {
+            m_tets.push_back(m_tets[i] + Vector4i::Constant(first));
+        }
+        for (int i = 0; i < numFaces; i++) {
+            m_faces.push_back(m_faces[i] + Vector3i::Constant(first));
+        }
+        for (int i = 0; i < numIds; i++) {
+            m_externalIds.push_back(m_externalIds[i] + first);
+        }
+    }
+
+    // The first copy sits in its own column and layer too.
+    Vector3f offset(-0.5f * (side - 1) * spacing.x(), 0, -0.5f * (side - 1) * spacing.z());
+    for (int i = 0; i < numVertices; i++) {
+        m_vertices[i] += offset;
+    }
+}
@@ -0,0 +1,109 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <memory>
+#include "collisionsdf.h"
+#include "collisiontrimesh.h"
+#include "solver.h"
+#include "surfacebvh.h"
+#include "system.h"
+
+class BinaryMesh;
+
+/** Where the mesh is dropped from, and the sphere collider, in world space. */
+extern Translation3f shapeTranslation;
+extern Vector3f spherePos;
+extern float sphereRadius;
+
+/**
+ * The simulated part of the scene, with no drawing: the bodies loaded from
+ * the mesh, the colliders and the solver, set up from the settings. The
+ * window draws it through Simulation and the headless driver steps it on
+ * its own.
+ */
+class Scene
+{
+public:
+    /** Uses the material from the settings. */
+    Scene();
+    Scene(float incompressibility, float rigidity, float phi, float psi, float density);
+
+    /**
+     * Loads the mesh and sets up the bodies, colliders and options from the
+     * settings. Returns false if the mesh couldn't be loaded.
+     */
+    bool init();
+
+    /**
+     * Sets up from a mesh already loaded, with everything MeshCache::load
+     * fills in, so many scenes can share one load.
+     */
+    bool init(const BinaryMesh &binary);
+
+    /**
+     * Collides with the obstacles other already loaded instead of loading
+     * them again. Call before init.
+     */
+    void shareObstacles(const Scene &other);
+
+    /** Steps the solver and updates the vertices and picking BVH. */
+    void update(float seconds);
+
+    /** See Solver::setForceExchange. */
+    void setForceExchange(function<void(System &)> exchange);
+
+    void zeroPush();
+
+    void castClickRay(Vector3f point, Vector3f direction, float force);
+
+    /**
+     * Pushes every surface node under a disc of the given radius centered on
+     * the ray, casting the disc's rays as one packet.
+     */
+    void castBrushRays(Vector3f point, Vector3f direction, float radius, float force);
+
+    /** Particle positions in the mesh's own space, shapeTranslation below the world. */
+    const vector<Vector3f> &getVertices() const;
+    const vector<Vector3i> &getFaces() const;
+    const vector<Vector4i> &getTets() const;
+
+    /**
+     * Index in the mesh file of each particle. Differs from the particle
+     * index when the mesh was reordered at load time.
+     */
+    const vector<int> &getExternalVertexIds() const;
+
+    System &getSystem();
+
+    double kineticEnergy();
+
+    /** The obstacles given with --sdf and --obstacle, or null if not given or not loaded. */
+    shared_ptr<CollisionSDF> getSdfObstacle() const;
+    shared_ptr<CollisionTriMesh> getMeshObstacle() const;
+
+private:
+    /**
+     * Turns the loaded mesh into count copies of itself in layers of columns,
+     * appending the copies' particles, tets, faces and ids in body order.
+     */
+    void placeBodies(int count);
+
+    void initColliders();
+
+    System m_system;
+    Solver m_solver;
+    float m_density;
+
+    vector<Vector3f> m_vertices;
+    vector<Vector3i> m_faces;
+    vector<Vector4i> m_tets;
+    vector<int> m_externalIds;
+
+    /** Surface triangles over m_vertices, refit every update, for picking. */
+    SurfaceBVH m_surfaceBVH;
+
+    shared_ptr<CollisionSDF> m_sdfObstacle;
+    shared_ptr<CollisionTriMesh> m_meshObstacle;
+};
+
+#endif // SCENE_H
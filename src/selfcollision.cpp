@@ -0,0 +1,304 @@
+#include "selfcollision.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#include "parallel.h"
+#include "surfacebvh.h"
+#include "system.h"
+
+namespace {
+
+// A triangle stretched over more cells than this isn't tested rather than
+// scanning the whole table; only a body that has already blown up gets there.
+const int MAX_TRIANGLE_CELLS = 512;
+
+/**
+ * Calls func(thread, begin, end) over [0, count) split into contiguous
+ * chunks, one per thread, or a single chunk for small counts.
+ */
+template <typename Func>
+unsigned int forChunks(int count, int grainSize, Func func)
+{
+    unsigned int numThreads = count < grainSize ? 1 : Parallel::threadCount();
+    int chunk = (count + numThreads - 1) / numThreads;
+    Parallel::forEachThread(numThreads, [&](unsigned int t) {
+        int begin = min(count, static_cast<int>(t) * chunk);
+        int end = min(count, begin + chunk);
+        func(t, begin, end);
+    });
+    return numThreads;
+}
+
+}
+
+SelfCollision::SelfCollision(const vector<Vector3i> &faces, const vector<Vector3f> &restPositions):
+    m_cellSize(1),
+    m_thickness(0.25f),
+    m_tableSize(1)
+{
+    // Renumber the surface's particles densely so the per step arrays only
+    // hold the surface.
+    vector<int> local(restPositions.size(), -1);
+    for (const Vector3i &face : faces) {
+        for (int k = 0; k < 3; k++) {
+            if (local[face[k]] < 0) {
+                local[face[k]] = 0;
+            }
+        }
+    }
+    for (unsigned int i = 0; i < local.size(); i++) {
+        if (local[i] == 0) {
+            local[i] = m_particles.size();
+            m_particles.push_back(i);
+        }
+    }
+    m_triangles.reserve(faces.size());
+    double edgeSum = 0;
+    for (const Vector3i &face : faces) {
+        m_triangles.push_back(Vector3i(local[face[0]], local[face[1]], local[face[2]]));
+        for (int k = 0; k < 3; k++) {
+            edgeSum += (restPositions[face[(k + 1) % 3]] - restPositions[face[k]]).norm();
+        }
+    }
+
+    // Surface edges, both ways, grouped by vertex.
+    vector<pair<int, int>> edges;
+    edges.reserve(m_triangles.size() * 6);
+    for (const Vector3i &tri : m_triangles) {
+        for (int k = 0; k < 3; k++) {
+            edges.push_back(make_pair(tri[k], tri[(k + 1) % 3]));
+            edges.push_back(make_pair(tri[(k + 1) % 3], tri[k]));
+        }
+    }
+    sort(edges.begin(), edges.end());
+    edges.erase(unique(edges.begin(), edges.end()), edges.end());
+    m_neighbourOffsets.assign(m_particles.size() + 1, 0);
+    m_neighbours.reserve(edges.size());
+    for (const pair<int, int> &edge : edges) {
+        m_neighbourOffsets[edge.first + 1]++;
+        m_neighbours.push_back(edge.second);
+    }
+    for (unsigned int i = 0; i < m_particles.size(); i++) {
+        m_neighbourOffsets[i + 1] += m_neighbourOffsets[i];
+    }
+
+    if (edgeSum > 0) {
+        m_cellSize = edgeSum / (faces.size() * 3);
+        m_thickness = m_cellSize * 0.25f;
+    }
+
+    // Twice as many buckets as vertices keeps most buckets to a vertex or
+    // none, so hash collisions stay rare.
+    while (m_tableSize < 2 * static_cast<int>(m_particles.size())) {
+        m_tableSize *= 2;
+    }
+    m_cellStarts.resize(m_tableSize + 1);
+    m_cellCounts.reset(new atomic<int>[m_tableSize]);
+    m_positions.resize(m_particles.size());
+    m_vertexCells.resize(m_particles.size());
+    m_vertexHashes.resize(m_particles.size());
+    m_cellVertices.resize(m_particles.size());
+}
+
+float SelfCollision::cellSize() const
+{
+    return m_cellSize;
+}
+
+float SelfCollision::thickness() const
+{
+    return m_thickness;
+}
+
+Vector3i SelfCollision::cellOf(const Vector3f &point) const
+{
+    // Clamped so a runaway (or NaN) position still converts to an int.
+    const float LIMIT = 1e8f;
+    Vector3i cell;
+    for (int k = 0; k < 3; k++) {
+        cell[k] = static_cast<int>(floorf(max(-LIMIT, min(LIMIT, point[k] / m_cellSize))));
+    }
+    return cell;
+}
+
+int SelfCollision::hashCell(const Vector3i &cell) const
+{
+    uint32_t h = (static_cast<uint32_t>(cell[0]) * 73856093u)
+               ^ (static_cast<uint32_t>(cell[1]) * 19349663u)
+               ^ (static_cast<uint32_t>(cell[2]) * 83492791u);
+    return static_cast<int>(h & static_cast<uint32_t>(m_tableSize - 1));
+}
+
+void SelfCollision::buildGrid()
+{
+    const int numVertices = m_particles.size();
+
+    // Counting sort of the vertices by bucket: count, prefix sum, scatter.
+    forChunks(m_tableSize, PARALLEL_GRAIN, [&](unsigned int, int begin, int end) {
+        for (int h = begin; h < end; h++) {
+            m_cellCounts[h].store(0, memory_order_relaxed);
+        }
+    });
+    forChunks(numVertices, PARALLEL_GRAIN, [&](unsigned int, int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            m_vertexCells[i] = cellOf(m_positions[i]);
+            m_vertexHashes[i] = hashCell(m_vertexCells[i]);
+            m_cellCounts[m_vertexHashes[i]].fetch_add(1, memory_order_relaxed);
+        }
+    });
+    m_cellStarts[0] = 0;
+    for (int h = 0; h < m_tableSize; h++) {
+        m_cellStarts[h + 1] = m_cellStarts[h] + m_cellCounts[h].load(memory_order_relaxed);
+    }
+    forChunks(numVertices, PARALLEL_GRAIN, [&](unsigned int, int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            int h = m_vertexHashes[i];
+            m_cellVertices[m_cellStarts[h] + m_cellCounts[h].fetch_sub(1, memory_order_relaxed) - 1] = i;
+        }
+    });
+
+    // Threads scatter into a bucket in any order, so sort each one to keep
+    // the forces, and so the simulation, the same from run to run.
+    forChunks(m_tableSize, PARALLEL_GRAIN, [&](unsigned int, int begin, int end) {
+        for (int h = begin; h < end; h++) {
+            if (m_cellStarts[h + 1] - m_cellStarts[h] > 1) {
+                sort(m_cellVertices.begin() + m_cellStarts[h], m_cellVertices.begin() + m_cellStarts[h + 1]);
+            }
+        }
+    });
+}
+
+bool SelfCollision::isNear(int vertex, const Vector3i &triangle) const
+{
+    if (triangle[0] == vertex || triangle[1] == vertex || triangle[2] == vertex) {
+        return true;
+    }
+    const int *begin = m_neighbours.data() + m_neighbourOffsets[vertex];
+    const int *end = m_neighbours.data() + m_neighbourOffsets[vertex + 1];
+    for (const int *n = begin; n != end; n++) {
+        if (*n == triangle[0] || *n == triangle[1] || *n == triangle[2]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void SelfCollision::findContacts(int begin, int end, float penalty, vector<Contact> &contacts) const
+{
+    const float thickness2 = m_thickness * m_thickness;
+    for (int t = begin; t < end; t++) {
+        const Vector3i &tri = m_triangles[t];
+        const Vector3f &a = m_positions[tri[0]];
+        const Vector3f &b = m_positions[tri[1]];
+        const Vector3f &c = m_positions[tri[2]];
+        AlignedBox3f box(a);
+        box.extend(b);
+        box.extend(c);
+        box.min() -= Vector3f::Constant(m_thickness);
+        box.max() += Vector3f::Constant(m_thickness);
+        Vector3i low = cellOf(box.min());
+        Vector3i high = cellOf(box.max());
+        Vector3i extent = high - low + Vector3i::Ones();
+        if ((extent.array() > MAX_TRIANGLE_CELLS).any() || extent.prod() > MAX_TRIANGLE_CELLS) {
+            continue;
+        }
+
+        Vector3f ab = b - a;
+        Vector3f ac = c - a;
+        float d00 = ab.dot(ab);
+        float d01 = ab.dot(ac);
+        float d11 = ac.dot(ac);
+        float denom = d00 * d11 - d01 * d01;
+
+        Vector3i cell;
+        for (cell[2] = low[2]; cell[2] <= high[2]; cell[2]++) {
+            for (cell[1] = low[1]; cell[1] <= high[1]; cell[1]++) {
+                for (cell[0] = low[0]; cell[0] <= high[0]; cell[0]++) {
+                    int h = hashCell(cell);
+                    for (int slot = m_cellStarts[h]; slot < m_cellStarts[h + 1]; slot++) {
+                        // Only vertices really in this cell, so a vertex in
+                        // a colliding cell isn't tested twice.
+                        int i = m_cellVertices[slot];
+                        const Vector3f &p = m_positions[i];
+                        if (m_vertexCells[i] != cell || !box.contains(p) || isNear(i, tri)) {
+                            continue;
+                        }
+                        Vector3f q = SurfaceBVH::closestPointOnTriangle(p, a, b, c);
+                        Vector3f offset = p - q;
+                        float dist2 = offset.squaredNorm();
+                        if (dist2 >= thickness2) {
+                            continue;
+                        }
+
+                        // Push along the offset, or along the triangle's
+                        // normal when the vertex sits right on the triangle.
+                        float dist = sqrtf(dist2);
+                        Vector3f direction;
+                        if (dist > m_thickness * 1e-3f) {
+                            direction = offset / dist;
+                        } else {
+                            direction = ab.cross(ac);
+                            float length = direction.norm();
+                            if (length == 0) {
+                                continue;
+                            }
+                            direction /= length;
+                        }
+
+                        // Barycentric coordinates of q share the reaction
+                        // between the triangle's corners so momentum is
+                        // conserved.
+                        Vector3f aq = q - a;
+                        float d20 = aq.dot(ab);
+                        float d21 = aq.dot(ac);
+                        float v = denom != 0 ? (d11 * d20 - d01 * d21) / denom : 1.f / 3;
+                        float w = denom != 0 ? (d00 * d21 - d01 * d20) / denom : 1.f / 3;
+
+                        Contact contact;
+                        contact.vertex = i;
+                        contact.triangle = t;
+                        contact.force = penalty * (m_thickness - dist) * direction;
+                        contact.weights = Vector3f(1 - v - w, v, w);
+                        contacts.push_back(contact);
+                    }
+                }
+            }
+        }
+    }
+}
+
+void SelfCollision::apply(System &system, float penalty)
+{
+    const int numVertices = m_particles.size();
+    const int numTriangles = m_triangles.size();
+    if (numTriangles == 0) {
+        return;
+    }
+    vector<Particle *> particles(numVertices);
+    for (int i = 0; i < numVertices; i++) {
+        particles[i] = system.getParticle(m_particles[i]).get();
+        m_positions[i] = particles[i]->getWorldPosition();
+    }
+
+    buildGrid();
+
+    m_threadContacts.resize(Parallel::threadCount());
+    unsigned int numThreads = forChunks(numTriangles, PARALLEL_GRAIN, [&](unsigned int t, int begin, int end) {
+        m_threadContacts[t].clear();
+        findContacts(begin, end, penalty, m_threadContacts[t]);
+    });
+
+    // A vertex can be pushed by triangles on any thread, so the forces are
+    // added here, in thread order.
+    for (unsigned int t = 0; t < numThreads; t++) {
+        for (const Contact &contact : m_threadContacts[t]) {
+            const Vector3i &tri = m_triangles[contact.triangle];
+            particles[contact.vertex]->addForce(contact.force);
+            for (int k = 0; k < 3; k++) {
+                particles[tri[k]]->addForce(-contact.weights[k] * contact.force);
+            }
+        }
+    }
+}
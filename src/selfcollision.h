@@ -0,0 +1,92 @@
+#ifndef SELFCOLLISION_H
+#define SELFCOLLISION_H
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <Eigen/Dense>
+#include <Eigen/StdVector>
+
+using namespace Eigen;
+using namespace std;
+
+class System;
+
+/**
+ * Keeps a body's surface from passing through itself. Each evaluation the
+ * surface vertices are counting sorted into a uniform spatial hash by cell,
+ * then every triangle tests the vertices in the cells its box, grown by the
+ * thickness, covers (Teschner et al., Optimized Spatial Hashing for
+ * Collision Detection of Deformable Objects). A vertex closer to a triangle
+ * than the thickness is pushed out with a penalty force, and the opposite
+ * force is spread over the triangle's corners. Every pass is linear in the
+ * size of the surface.
+ */
+class SelfCollision
+{
+public:
+    /** Below this many vertices or triangles a pass stays on one thread. */
+    static const int PARALLEL_GRAIN = 1024;
+
+    /**
+     * faces index the system's particles, and restPositions are the
+     * particles' rest positions. The cell size is the surface's mean edge
+     * length and the thickness a quarter of it.
+     */
+    SelfCollision(const vector<Vector3i> &faces, const vector<Vector3f> &restPositions);
+
+    /**
+     * Adds penalty times penetration of the thickness to every surface
+     * particle too close to a triangle. Triangles touching the particle or
+     * one of its neighbours along an edge are skipped, since they are close
+     * at rest.
+     */
+    void apply(System &system, float penalty);
+
+    float cellSize() const;
+    float thickness() const;
+
+private:
+    struct Contact
+    {
+        int vertex;
+        int triangle;
+        Vector3f force;
+        Vector3f weights;
+    };
+
+    void buildGrid();
+    void findContacts(int begin, int end, float penalty, vector<Contact> &contacts) const;
+    bool isNear(int vertex, const Vector3i &triangle) const;
+
+    Vector3i cellOf(const Vector3f &point) const;
+    int hashCell(const Vector3i &cell) const;
+
+    /** Surface particle indices, and the faces renumbered into them. */
+    vector<int> m_particles;
+    vector<Vector3i> m_triangles;
+
+    /** Each vertex's neighbours along surface edges, sorted. */
+    vector<int> m_neighbourOffsets;
+    vector<int> m_neighbours;
+
+    float m_cellSize;
+    float m_thickness;
+
+    vector<Vector3f> m_positions;
+
+    /** Each vertex's cell and its hash, as of the last build. */
+    vector<Vector3i> m_vertexCells;
+    vector<int> m_vertexHashes;
+
+    /** Vertices of hash bucket h are m_cellVertices[m_cellStarts[h], m_cellStarts[h + 1]). */
+    int m_tableSize;
+    vector<int> m_cellStarts;
+    vector<int> m_cellVertices;
+    unique_ptr<atomic<int>[]> m_cellCounts;
+
+    /** Contacts found by each thread, applied in thread order. */
+    vector<vector<Contact>> m_threadContacts;
+};
+
+#endif // SELFCOLLISION_H
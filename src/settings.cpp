@@ -0,0 +1,92 @@
+#include "settings.h"
+
+#include <iostream>
+
+#include "parallel.h"
+
+using namespace std;
+
+QString meshFile;
+float incompressibility;
+float rigidity;
+float phi;
+float psi;
+float density;
+bool reorderMesh;
+QString sdfObstacleFile;
+QString meshObstacleFile;
+bool selfCollision;
+bool sweepCollisions;
+int bodyCount;
+float sleepThreshold;
+
+namespace {
+
+const int NUM_SCENE_ARGUMENTS = 6;
+
+}
+
+void addSceneArguments(QCommandLineParser &parser)
+{
+    parser.addPositionalArgument("mesh", "Mesh file");
+    parser.addPositionalArgument("incompressibility", "Elastic incompressibility");
+    parser.addPositionalArgument("rigidity", "Elastic rigidity");
+    parser.addPositionalArgument("phi", "Phi (viscous incompressibility)");
+    parser.addPositionalArgument("psi", "Psi (viscous rigidity)");
+    parser.addPositionalArgument("density", "Uniform mesh density");
+    addSceneOptions(parser);
+}
+
+void addSceneOptions(QCommandLineParser &parser)
+{
+    parser.addOption(QCommandLineOption("reorder", "Renumber particles and tets for memory locality when loading the mesh"));
+    parser.addOption(QCommandLineOption("sdf", "Add a static obstacle from a closed .obj or .mesh surface, collided through a cached signed distance field", "file"));
+    parser.addOption(QCommandLineOption("obstacle", "Add a static obstacle from a closed .obj or .mesh surface, collided exactly against its triangles", "file"));
+    parser.addOption(QCommandLineOption("self-collision", "Keep the body's surface from passing through itself"));
+    parser.addOption(QCommandLineOption("ccd", "Sweep fast moving surface particles against the colliders so they can't step through thin ones"));
+    parser.addOption(QCommandLineOption("bodies", "Drop this many copies of the mesh, in layers of columns, colliding with each other", "count", "1"));
+    parser.addOption(QCommandLineOption("sleep", "Stop simulating bodies once they move less than this fraction of a surface edge per step, until pushed or touched", "fraction", "0"));
+    parser.addOption(QCommandLineOption("threads", "Split the work across this many threads, or one per hardware thread for 0", "count", "0"));
+}
+
+bool readSceneArguments(const QCommandLineParser &parser)
+{
+    const QStringList args = parser.positionalArguments();
+    if (args.size() < NUM_SCENE_ARGUMENTS) {
+        cerr << "Error: Wrong number of arguments" << endl;
+        return false;
+    }
+    meshFile = args[0];
+    incompressibility = args[1].toFloat();
+    rigidity = args[2].toFloat();
+    phi = args[3].toFloat();
+    psi = args[4].toFloat();
+    density = args[5].toFloat();
+    return readSceneOptions(parser);
+}
+
+bool readSceneOptions(const QCommandLineParser &parser)
+{
+    reorderMesh = parser.isSet("reorder");
+    sdfObstacleFile = parser.value("sdf");
+    meshObstacleFile = parser.value("obstacle");
+    selfCollision = parser.isSet("self-collision");
+    sweepCollisions = parser.isSet("ccd");
+    bodyCount = parser.value("bodies").toInt();
+    if (bodyCount < 1) {
+        cerr << "Error: --bodies needs a count of at least 1" << endl;
+        return false;
+    }
+    sleepThreshold = parser.value("sleep").toFloat();
+    if (sleepThreshold < 0) {
+        cerr << "Error: --sleep needs a fraction of at least 0" << endl;
+        return false;
+    }
+    const int threads = parser.value("threads").toInt();
+    if (threads < 0) {
+        cerr << "Error: --threads needs a count of at least 0" << endl;
+        return false;
+    }
+    Parallel::setThreadCount(threads);
+    return true;
+}
@@ -0,0 +1,43 @@
+#ifndef SETTINGS_H
+#define SETTINGS_H
+
+#include <QCommandLineParser>
+#include <QString>
+
+/**
+ * Material parameters and options of the simulated scene, shared by the
+ * window and the headless driver. Both read them from their command lines
+ * through the two functions below.
+ */
+extern QString meshFile;
+extern float incompressibility;
+extern float rigidity;
+extern float phi;
+extern float psi;
+extern float density;
+extern bool reorderMesh;
+extern QString sdfObstacleFile;
+extern QString meshObstacleFile;
+extern bool selfCollision;
+extern bool sweepCollisions;
+extern int bodyCount;
+extern float sleepThreshold;
+
+/**
+ * Adds the mesh and material positional arguments, first, and the scene
+ * options to parser.
+ */
+void addSceneArguments(QCommandLineParser &parser);
+
+/**
+ * Reads the arguments added by addSceneArguments from a processed parser
+ * into the settings above. Prints an error and returns false if any is
+ * missing or out of range.
+ */
+bool readSceneArguments(const QCommandLineParser &parser);
+
+/** The scene options alone, for tools that take the mesh and material their own way. */
+void addSceneOptions(QCommandLineParser &parser);
+bool readSceneOptions(const QCommandLineParser &parser);
+
+#endif // SETTINGS_H
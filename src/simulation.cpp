@@ -1,96 +1,165 @@
 #include "simulation.h"
 
+#include <cmath>
 #include <iostream>
-#include <set>
+
 #include "main.h"
 
-#include "graphics/MeshLoader.h"
+#include "graphics/BinaryMesh.h"
+#include "meshcache.h"
+#include "surfaceextractor.h"
 
 using namespace Eigen;
 using namespace std;
 
+namespace {
+
+// Seconds per step, what the window used to step by at 60 frames per second.
+const float STEP_SECONDS = 0.00016f;
+
+// Simulated seconds that pass per real second. The scene has always run at
+// a hundredth of real time.
+const double SIMULATED_PER_REAL_SECOND = 0.01;
+
+// Most steps taken at once to catch up after the thread falls behind. Time
+// owed beyond that is dropped rather than carried, so a machine too slow to
+// keep up runs the scene slower instead of falling ever further behind.
+const int MAX_CATCH_UP_STEPS = 8;
+
+// Real seconds between reports of dropped time.
+const double DROP_REPORT_SECONDS = 1;
+
+}
+
 Simulation::Simulation():
-    m_system(),
-    m_solver(incompressibility, rigidity, phi, psi, density)
+    m_scene(),
+    m_paused(true),
+    m_stopping(false),
+    m_showingCurrent(true),
+    m_hasSdfObstacle(false),
+    m_hasMeshObstacle(false)
 {
 
 }
 
-Translation3f shapeTranslation = Translation3f(0, 3, 0);
+Simulation::~Simulation()
+{
+    m_stopping = true;
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+}
 
 void Simulation::init()
 {
+    if (m_scene.init()) {
+        m_shape.init(m_scene.getVertices(), m_scene.getFaces(), m_scene.getTets());
+    }
+    m_shape.setModelMatrix(Affine3f(shapeTranslation));
 
-    if(MeshLoader::loadTetMesh(meshFile.toStdString(), m_vertices, m_tets)) {
-        for (unsigned int i = 0; i < m_vertices.size(); i++) {
-            m_system.setParticle(i, make_shared<Particle>(Particle(m_vertices.at(i) + shapeTranslation.vector(), i, 1)));
-        }
+    initSphere();
 
-        std::vector<Tet> tetsList = std::vector<Tet>();
-        for (Vector4i tet : m_tets) {
-            shared_ptr<Particle> m1 = m_system.getParticlesMap()[tet[0]];
-            shared_ptr<Particle> m2 = m_system.getParticlesMap()[tet[1]];
-            shared_ptr<Particle> m3 = m_system.getParticlesMap()[tet[2]];
-            shared_ptr<Particle> m4 = m_system.getParticlesMap()[tet[3]];
+    initGround();
 
-            tetsList.push_back(Tet(m1, m2, m3, m4, density));
-        }
-        m_system.setTets(tetsList);
-
-        // Calculate which faces are on the surface.
-        // Represent a face on the tet by the index of the opposite vertex.
-        // A surface face is a face that has only one opposite vertex.
-
-        m_faces = vector<Vector3i>();
-        for (Tet t : tetsList) {
-            shared_ptr<Particle> n1 = t.getNodes().at(0);
-            shared_ptr<Particle> n2 = t.getNodes().at(1);
-            shared_ptr<Particle> n3 = t.getNodes().at(2);
-            shared_ptr<Particle> n4 = t.getNodes().at(3);
-
-            Vector3i face1 = Vector3i(n1->getIndex(), n3->getIndex(), n2->getIndex());
-            Vector3i face2 = Vector3i(n1->getIndex(), n2->getIndex(), n4->getIndex());
-            Vector3i face3 = Vector3i(n1->getIndex(), n4->getIndex(), n3->getIndex());
-            Vector3i face4 = Vector3i(n2->getIndex(), n3->getIndex(), n4->getIndex());
-
-            vector<Vector3i> fourFaces = vector<Vector3i>{ face1, face2, face3, face4 };
-
-            for (int faceIndex = 0; faceIndex < 4; faceIndex++) {
-                Vector3i thisFace = fourFaces.at(faceIndex);
-                bool faceRemoved = false;
-                vector<Vector3i>::iterator faceIter = m_faces.begin();
-                while (faceIter != m_faces.end()) {
-                    if (facesEqual(*faceIter, thisFace)) {
-                        m_faces.erase(faceIter);
-                        faceRemoved = true;
-                    } else {
-                        ++faceIter;
-                    }
-                }
-                if (!faceRemoved) {
-                    m_faces.push_back(thisFace);
-                }
+    initObstacles();
+
+    m_current.vertices = m_scene.getVertices();
+    m_current.step = 0;
+    m_current.time = chrono::steady_clock::now();
+    m_previous = m_current;
+    m_shown = m_current.vertices;
+    m_thread = std::thread(&Simulation::run, this);
+}
+
+void Simulation::setPaused(bool paused)
+{
+    m_paused = paused;
+}
+
+void Simulation::run()
+{
+    long long step = 0;
+    // Simulated time owed to the scene and not stepped yet, and dropped
+    // since the last report.
+    double owed = 0;
+    double dropped = 0;
+    double totalDropped = 0;
+    chrono::steady_clock::time_point last = chrono::steady_clock::now();
+    chrono::steady_clock::time_point lastReport = last;
+    while (!m_stopping) {
+        if (m_pushes.take()) {
+            const Push &push = m_pushes.readSlot();
+            if (push.kind == Push::RAY) {
+                m_scene.castClickRay(push.point, push.direction, push.force);
+            } else if (push.kind == Push::BRUSH) {
+                m_scene.castBrushRays(push.point, push.direction, push.radius, push.force);
+            } else {
+                m_scene.zeroPush();
             }
         }
-        m_shape.init(m_vertices, m_faces, m_tets);
-    }
-    m_shape.setModelMatrix(Affine3f(shapeTranslation));
+        chrono::steady_clock::time_point now = chrono::steady_clock::now();
+        double elapsed = chrono::duration<double>(now - last).count();
+        last = now;
+        if (m_paused) {
+            owed = 0;
+            this_thread::sleep_for(chrono::milliseconds(1));
+            continue;
+        }
 
-    initSphere();
+        owed += elapsed * SIMULATED_PER_REAL_SECOND;
+        for (int i = 0; i < MAX_CATCH_UP_STEPS && owed >= STEP_SECONDS; i++) {
+            m_scene.update(STEP_SECONDS);
+            owed -= STEP_SECONDS;
+            Snapshot &snapshot = m_snapshots.writeSlot();
+            snapshot.vertices = m_scene.getVertices();
+            snapshot.step = ++step;
+            snapshot.time = chrono::steady_clock::now();
+            m_snapshots.publish();
+        }
+        if (owed >= STEP_SECONDS) {
+            double kept = fmod(owed, static_cast<double>(STEP_SECONDS));
+            dropped += owed - kept;
+            owed = kept;
+        }
 
-    initGround();
+        now = chrono::steady_clock::now();
+        if (dropped > 0 && chrono::duration<double>(now - lastReport).count() >= DROP_REPORT_SECONDS) {
+            totalDropped += dropped;
+            cout << "Simulation is behind real time: dropped " << dropped << " s of simulated time, "
+                 << totalDropped << " s in all" << endl;
+            dropped = 0;
+            lastReport = now;
+        }
+        // Sleeps until the next step is due.
+        double wait = (STEP_SECONDS - owed) / SIMULATED_PER_REAL_SECOND;
+        this_thread::sleep_for(chrono::duration<double>(wait));
+    }
 }
 
-void Simulation::update(float seconds)
+void Simulation::update()
 {
-    m_solver.midpointStep(m_system, seconds);
+    bool taken = m_snapshots.take();
+    if (taken) {
+        swap(m_previous, m_current);
+        m_current = m_snapshots.readSlot();
+    } else if (m_showingCurrent) {
+        return;
+    }
 
-    for (unsigned int i = 0; i < m_vertices.size(); i++) {
-        assert(m_system.getParticlesMap().count(i) == 1);
-        m_vertices.at(i) = m_system.getParticlesMap()[i]->getWorldPosition() - shapeTranslation.vector();
+    // The view trails the thread by one state, moving from the one before
+    // to the newest over as long as passed between them, so motion stays
+    // smooth however long steps take.
+    float alpha = 1;
+    double interval = chrono::duration<double>(m_current.time - m_previous.time).count();
+    if (interval > 0) {
+        double since = chrono::duration<double>(chrono::steady_clock::now() - m_current.time).count();
+        alpha = static_cast<float>(min(1.0, since / interval));
+    }
+    for (unsigned int i = 0; i < m_shown.size(); i++) {
+        m_shown[i] = m_previous.vertices[i] + alpha * (m_current.vertices[i] - m_previous.vertices[i]);
     }
-    //m_shape.init(m_vertices, m_faces, m_tets);
-    m_shape.setVertices(m_vertices);
+    m_showingCurrent = alpha >= 1;
+    m_shape.setVertices(m_shown);
 }
 
 void Simulation::draw(Shader *shader)
@@ -98,87 +167,39 @@ void Simulation::draw(Shader *shader)
     m_sphere.draw(shader);
     m_shape.draw(shader);
     m_ground.draw(shader);
-}
-
-// This is from this wikipedia article: https://en.wikipedia.org/wiki/M%C3%B6ller%E2%80%93Trumbore_intersection_algorithm.
-bool Simulation::rayIntersectsTriangle(Vector3f rayOrigin,
-                           Vector3f rayVector,
-                           vector<Vector3f> inTriangle,
-                           Vector3f& outIntersectionPoint,
-                           float& dist)
-{
-    const float EPSILON = 0.0000001;
-    Vector3f vertex0 = inTriangle.at(0);
-    Vector3f vertex1 = inTriangle.at(1);
-    Vector3f vertex2 = inTriangle.at(2);
-    Vector3f edge1, edge2, h, s, q;
-    float a,f,u,v;
-    edge1 = vertex1 - vertex0;
-    edge2 = vertex2 - vertex0;
-    h = rayVector.cross(edge2);
-    a = edge1.dot(h);
-    if (a > -EPSILON && a < EPSILON)
-        return false;    // This ray is parallel to this triangle.
-    f = 1.0/a;
-    s = rayOrigin - vertex0;
-    u = f * s.dot(h);
-    if (u < 0.0 || u > 1.0)
-        return false;
-    q = s.cross(edge1);
-    v = f * rayVector.dot(q);
-    if (v < 0.0 || u + v > 1.0)
-        return false;
-    // At this stage we can compute t to find out where the intersection point is on the line.
-    float t = f * edge2.dot(q);
-    if (t > EPSILON) // ray intersection
-    {
-        outIntersectionPoint = rayOrigin + rayVector * t;
-        dist = t;
-        return true;
+    if (m_hasSdfObstacle) {
+        m_sdfObstacle.draw(shader);
+    }
+    if (m_hasMeshObstacle) {
+        m_meshObstacle.draw(shader);
     }
-    else // This means that there is a line intersection but not a ray intersection.
-        return false;
 }
 
 void Simulation::zeroPush()
 {
-    shared_ptr<Particle> null;
-    m_system.setPushForce(null, null, null, Vector3f::Zero());
+    postPush(Push::NONE, Vector3f::Zero(), Vector3f::Zero(), 0, 0);
 }
 
 void Simulation::castClickRay(Vector3f point, Vector3f direction, float force)
 {
+    postPush(Push::RAY, point, direction, 0, force);
+}
 
-    Vector3f minIntersect = Vector3f::Zero();
-    float minDist = 100000.f;
-
-    shared_ptr<Particle> mp1;
-    shared_ptr<Particle> mp2;
-    shared_ptr<Particle> mp3;
-
-    for (Vector3i face : m_faces) {
-        Vector3f v1 = m_system.getParticlesMap()[face[0]]->getWorldPosition();
-        Vector3f v2 = m_system.getParticlesMap()[face[1]]->getWorldPosition();
-        Vector3f v3 = m_system.getParticlesMap()[face[2]]->getWorldPosition();
-
-        Vector3f rayIntersect;
-        float dist;
-        bool intersects = rayIntersectsTriangle(point, direction, vector<Vector3f>{ v1, v2, v3 }, rayIntersect, dist);
-
-        if (intersects && dist < minDist) {
-            minIntersect = rayIntersect;
-            minDist = dist;
-            mp1 = m_system.getParticlesMap()[face[0]];
-            mp2 = m_system.getParticlesMap()[face[1]];
-            mp3 = m_system.getParticlesMap()[face[2]];
-        }
-    }
+void Simulation::castBrushRays(Vector3f point, Vector3f direction, float radius, float force)
+{
+    postPush(Push::BRUSH, point, direction, radius, force);
+}
 
-    if (minDist < 100000.f) {
-        m_system.setPushForce(mp1, mp2, mp3, direction * force);
-    } else {
-        m_system.setPushForce(mp1, mp2, mp3, Vector3f::Zero());
-    }
+void Simulation::postPush(Push::Kind kind, Vector3f point, Vector3f direction, float radius, float force)
+{
+    // The rays are cast on the thread, against the surface as it is then.
+    Push &push = m_pushes.writeSlot();
+    push.kind = kind;
+    push.point = point;
+    push.direction = direction;
+    push.radius = radius;
+    push.force = force;
+    m_pushes.publish();
 }
 
 void Simulation::toggleWire()
@@ -186,8 +207,10 @@ void Simulation::toggleWire()
     m_shape.toggleWireframe();
 }
 
-Vector3f spherePos = Vector3f(0, 0, 0);
-float sphereRadius = 1;
+const vector<int> &Simulation::getExternalVertexIds() const
+{
+    return m_scene.getExternalVertexIds();
+}
 
 void Simulation::initGround()
 {
@@ -200,8 +223,6 @@ void Simulation::initGround()
     groundFaces.emplace_back(0, 1, 2);
     groundFaces.emplace_back(0, 2, 3);
     m_ground.init(groundVerts, groundFaces);
-    m_system.addCollider(make_shared<CollisionPlane>(CollisionPlane(Vector3f(0, 0, 0), Vector3f(0, 1, 0))));
-    m_system.addCollider(make_shared<CollisionSphere>(CollisionSphere(spherePos, sphereRadius)));
 }
 
 void Simulation::initSphere()
@@ -209,33 +230,15 @@ void Simulation::initSphere()
     vector<Vector3f> verts;
     vector<Vector4i> tets;
 
-    if(MeshLoader::loadTetMesh(sphereFile.toStdString(), verts, tets)) {
-        vector<Vector3i> faces = vector<Vector3i>();
-        for (Vector4i t : tets) {
-
-            Vector3i face1 = Vector3i(t[0], t[2], t[1]);
-            Vector3i face2 = Vector3i(t[0], t[1], t[3]);
-            Vector3i face3 = Vector3i(t[0], t[3], t[2]);
-            Vector3i face4 = Vector3i(t[1], t[2], t[3]);
-
-            vector<Vector3i> fourFaces = vector<Vector3i>{ face1, face2, face3, face4 };
-
-            for (int faceIndex = 0; faceIndex < 4; faceIndex++) {
-                Vector3i thisFace = fourFaces.at(faceIndex);
-                bool faceRemoved = false;
-                vector<Vector3i>::iterator faceIter = faces.begin();
-                while (faceIter != faces.end()) {
-                    if (facesEqual(*faceIter, thisFace)) {
-                        faces.erase(faceIter);
-                        faceRemoved = true;
-                    } else {
-                        ++faceIter;
-                    }
-                }
-                if (!faceRemoved) {
-                    faces.push_back(thisFace);
-                }
-            }
+    BinaryMesh binary;
+    if(MeshCache::load(sphereFile.toStdString(), binary)) {
+        binary.copyVertices(verts);
+        binary.copyTets(tets);
+        vector<Vector3i> faces;
+        if (binary.hasFaces()) {
+            binary.copyFaces(faces);
+        } else {
+            faces = SurfaceExtractor::extractSurface(tets);
         }
         m_sphere.init(verts, faces, tets);
         Affine3f sphereTransform = Affine3f(Eigen::Translation3f(spherePos));
@@ -244,20 +247,16 @@ void Simulation::initSphere()
 
 }
 
-bool Simulation::facesEqual(Vector3i face1, Vector3i face2)
+void Simulation::initObstacles()
 {
-    for (int i = 0; i < 3; i++) {
-        bool eq = false;
-        for (int j = 0; j < 3; j++) {
-            if (face1[i] == face2[j]) {
-                eq = true;
-            }
-        }
-        if (eq == false) {
-            return false;
-        }
+    if (shared_ptr<CollisionSDF> sdf = m_scene.getSdfObstacle()) {
+        m_sdfObstacle.init(sdf->vertices(), sdf->faces());
+        m_hasSdfObstacle = true;
+    }
+    if (shared_ptr<CollisionTriMesh> mesh = m_scene.getMeshObstacle()) {
+        m_meshObstacle.init(mesh->vertices(), mesh->faces());
+        m_hasMeshObstacle = true;
     }
-    return true;
 }
 
 Vector3f Simulation::normal(Vector3f a, Vector3f b, Vector3f c)
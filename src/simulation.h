@@ -1,46 +1,99 @@
 #ifndef SIMULATION_H
 #define SIMULATION_H
 
-#include <memory>
+#include <atomic>
+#include <chrono>
+#include <thread>
 #include "graphics/shape.h"
-#include "solver.h"
-#include "system.h"
+#include "scene.h"
+#include "triplebuffer.h"
 
 class Shader;
 
+/**
+ * Steps the scene on a thread of its own and draws it. The thread takes
+ * fixed steps, as many as keep the scene in time with the clock while not
+ * paused, and drops time it can't catch up on. It publishes the
+ * particle positions after each through a triple buffer, so neither it
+ * nor the window ever waits for the other. The window shows the last two
+ * states it took, interpolated, and hands pushes to the thread the same
+ * way.
+ */
 class Simulation
 {
 public:
     Simulation();
+    ~Simulation();
 
+    /** Loads the scene and starts its thread, paused. */
     void init();
 
-    void update(float seconds);
+    void setPaused(bool paused);
 
-    void draw(Shader *shader);
+    /**
+     * Takes the newest state the thread published, if there is one, and
+     * updates the shape to the interpolated positions.
+     */
+    void update();
 
-    bool rayIntersectsTriangle(Vector3f rayOrigin,
-                               Vector3f rayVector,
-                               vector<Vector3f> inTriangle,
-                               Vector3f& outIntersectionPoint,
-                               float& dist);
+    void draw(Shader *shader);
 
     void zeroPush();
 
     void castClickRay(Vector3f point, Vector3f direction, float force);
 
+    /**
+     * Pushes every surface node under a disc of the given radius centered on
+     * the ray, casting the disc's rays as one packet.
+     */
+    void castBrushRays(Vector3f point, Vector3f direction, float radius, float force);
+
     void toggleWire();
+
+    /**
+     * Index in the mesh file of each particle. Differs from the particle
+     * index when the mesh was reordered at load time.
+     */
+    const vector<int> &getExternalVertexIds() const;
 private:
-    bool facesEqual(Vector3i face1, Vector3i face2);
+    /** Particle positions after a step, and when the step finished. */
+    struct Snapshot
+    {
+        vector<Vector3f> vertices;
+        long long step;
+        chrono::steady_clock::time_point time;
+    };
+
+    /** The push last asked for, applied by the thread before its next step. */
+    struct Push
+    {
+        enum Kind { NONE, RAY, BRUSH };
+        Kind kind;
+        Vector3f point;
+        Vector3f direction;
+        float radius;
+        float force;
+    };
 
     Vector3f normal(Vector3f a, Vector3f b, Vector3f c);
 
-    System m_system;
-    Solver m_solver;
+    /** The thread's loop. */
+    void run();
+    void postPush(Push::Kind kind, Vector3f point, Vector3f direction, float radius, float force);
+
+    /** Only the thread touches the scene once it has started. */
+    Scene m_scene;
+    std::thread m_thread;
+    std::atomic<bool> m_paused;
+    std::atomic<bool> m_stopping;
+    TripleBuffer<Snapshot> m_snapshots;
+    TripleBuffer<Push> m_pushes;
 
-    vector<Vector3f> m_vertices;
-    vector<Vector3i> m_faces;
-    vector<Vector4i> m_tets;
+    /** The last two states taken from the thread, and the positions shown between them. */
+    Snapshot m_previous;
+    Snapshot m_current;
+    vector<Vector3f> m_shown;
+    bool m_showingCurrent;
 
     Shape m_shape;
     Shape m_sphere;
@@ -48,6 +101,13 @@ private:
     Shape m_ground;
     void initGround();
     void initSphere();
+
+    /** Static obstacles given with --sdf and --obstacle, drawn only if they loaded. */
+    Shape m_sdfObstacle;
+    bool m_hasSdfObstacle;
+    Shape m_meshObstacle;
+    bool m_hasMeshObstacle;
+    void initObstacles();
 };
 
 #endif // SIMULATION_H
@@ -0,0 +1,226 @@
+#include "sleepislands.h"
+
+#include <algorithm>
+#include <numeric>
+
+#include "system.h"
+
+namespace {
+
+// Steps a body has to stay still for before it may sleep. Soft bodies keep
+// ringing long after they land, and this spans several of their bounces.
+const int STILL_STEPS = 250;
+
+}
+
+SleepIslands::SleepIslands(float threshold, const vector<int> &surfaceParticles):
+    m_threshold(threshold),
+    m_surfaceParticles(surfaceParticles),
+    m_numAsleep(0)
+{
+    sort(m_surfaceParticles.begin(), m_surfaceParticles.end());
+}
+
+void SleepIslands::addBody(int firstParticle, int numParticles, int firstTet, int numTets)
+{
+    Body body;
+    body.firstParticle = firstParticle;
+    body.numParticles = numParticles;
+    body.firstTet = firstTet;
+    body.numTets = numTets;
+    body.asleep = false;
+    body.stillSteps = 0;
+    body.island = m_bodies.size();
+    m_bodies.push_back(body);
+
+    if (static_cast<int>(m_particleBodies.size()) < firstParticle + numParticles) {
+        m_particleBodies.resize(firstParticle + numParticles, -1);
+    }
+    fill(m_particleBodies.begin() + firstParticle, m_particleBodies.begin() + firstParticle + numParticles,
+         static_cast<int>(m_bodies.size()) - 1);
+    appendAwake(body);
+}
+
+int SleepIslands::numBodies() const
+{
+    return m_bodies.size();
+}
+
+bool SleepIslands::isAsleep(int body) const
+{
+    return m_bodies[body].asleep;
+}
+
+bool SleepIslands::isParticleAsleep(int particle) const
+{
+    if (particle < 0 || particle >= static_cast<int>(m_particleBodies.size()) || m_particleBodies[particle] < 0) {
+        return false;
+    }
+    return m_bodies[m_particleBodies[particle]].asleep;
+}
+
+bool SleepIslands::allAsleep() const
+{
+    return !m_bodies.empty() && m_numAsleep == static_cast<int>(m_bodies.size());
+}
+
+int SleepIslands::numAsleep() const
+{
+    return m_numAsleep;
+}
+
+const vector<pair<int, int>> &SleepIslands::awakeParticles() const
+{
+    return m_awakeParticles;
+}
+
+const vector<pair<int, int>> &SleepIslands::awakeTets() const
+{
+    return m_awakeTets;
+}
+
+const vector<int> &SleepIslands::awakeSurfaceParticles() const
+{
+    return m_awakeSurfaceParticles;
+}
+
+void SleepIslands::wakeParticle(int particle)
+{
+    if (!isParticleAsleep(particle)) {
+        return;
+    }
+    wake(m_particleBodies[particle]);
+    rebuildAwake();
+}
+
+void SleepIslands::wake(int body)
+{
+    const int island = m_bodies[body].island;
+    for (Body &other : m_bodies) {
+        if (other.asleep && other.island == island) {
+            other.asleep = false;
+            other.stillSteps = 0;
+            m_numAsleep--;
+        }
+    }
+}
+
+int SleepIslands::findRoot(int body)
+{
+    while (m_parents[body] != body) {
+        m_parents[body] = m_parents[m_parents[body]];
+        body = m_parents[body];
+    }
+    return body;
+}
+
+void SleepIslands::update(System &system)
+{
+    const float threshold2 = m_threshold * m_threshold;
+    for (Body &body : m_bodies) {
+        if (body.asleep) {
+            continue;
+        }
+        double energy = 0;
+        double mass = 0;
+        for (int i = body.firstParticle; i < body.firstParticle + body.numParticles; i++) {
+            Particle *particle = system.getParticle(i).get();
+            energy += particle->getMass() * particle->getVelocity().squaredNorm();
+            mass += particle->getMass();
+        }
+        if (energy <= threshold2 * mass) {
+            body.stillSteps++;
+        } else {
+            body.stillSteps = 0;
+        }
+    }
+
+    // Islands join the bodies that touched in the last evaluation, and the
+    // sleeping bodies with the islands they fell asleep in.
+    const int count = m_bodies.size();
+    m_parents.resize(count);
+    iota(m_parents.begin(), m_parents.end(), 0);
+    for (int b = 0; b < count; b++) {
+        if (m_bodies[b].asleep) {
+            m_parents[findRoot(b)] = findRoot(m_bodies[b].island);
+        }
+    }
+    m_touching.clear();
+    if (shared_ptr<BodyContacts> bodyContacts = system.getBodyContacts()) {
+        bodyContacts->touchingPairs(m_touching);
+    }
+    for (const pair<int, int> &touching : m_touching) {
+        m_parents[findRoot(touching.first)] = findRoot(touching.second);
+    }
+
+    m_islandReady.assign(count, true);
+    for (int b = 0; b < count; b++) {
+        if (!m_bodies[b].asleep && m_bodies[b].stillSteps < STILL_STEPS) {
+            m_islandReady[findRoot(b)] = false;
+        }
+    }
+
+    bool changed = false;
+    for (int b = 0; b < count; b++) {
+        Body &body = m_bodies[b];
+        const int root = findRoot(b);
+        if (m_islandReady[root]) {
+            body.island = root;
+            if (!body.asleep) {
+                body.asleep = true;
+                m_numAsleep++;
+                changed = true;
+                for (int i = body.firstParticle; i < body.firstParticle + body.numParticles; i++) {
+                    system.getParticle(i)->setVelocity(Vector3f::Zero());
+                }
+            }
+        } else if (body.asleep) {
+            body.asleep = false;
+            body.stillSteps = 0;
+            m_numAsleep--;
+            changed = true;
+        }
+    }
+    if (changed) {
+        rebuildAwake();
+    }
+}
+
+void SleepIslands::appendAwake(const Body &body)
+{
+    const int particleEnd = body.firstParticle + body.numParticles;
+    const int tetEnd = body.firstTet + body.numTets;
+    if (!m_awakeParticles.empty() && m_awakeParticles.back().second == body.firstParticle) {
+        m_awakeParticles.back().second = particleEnd;
+    } else {
+        m_awakeParticles.push_back(make_pair(body.firstParticle, particleEnd));
+    }
+    if (!m_awakeTets.empty() && m_awakeTets.back().second == body.firstTet) {
+        m_awakeTets.back().second = tetEnd;
+    } else {
+        m_awakeTets.push_back(make_pair(body.firstTet, tetEnd));
+    }
+
+    // With no surface given every particle is tested against the colliders.
+    if (m_surfaceParticles.empty()) {
+        for (int i = body.firstParticle; i < particleEnd; i++) {
+            m_awakeSurfaceParticles.push_back(i);
+        }
+    } else {
+        m_awakeSurfaceParticles.insert(m_awakeSurfaceParticles.end(),
+                                       lower_bound(m_surfaceParticles.begin(), m_surfaceParticles.end(), body.firstParticle),
+                                       lower_bound(m_surfaceParticles.begin(), m_surfaceParticles.end(), particleEnd));
+    }
+}
+
+void SleepIslands::rebuildAwake()
+{
+    m_awakeParticles.clear();
+    m_awakeTets.clear();
+    m_awakeSurfaceParticles.clear();
+    for (const Body &body : m_bodies) {
+        if (!body.asleep) {
+            appendAwake(body);
+        }
+    }
+}
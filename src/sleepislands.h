@@ -0,0 +1,101 @@
+#ifndef SLEEPISLANDS_H
+#define SLEEPISLANDS_H
+
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+class System;
+
+/**
+ * Puts bodies that have come to rest to sleep, so the solver can skip their
+ * forces and integration. Each body is a contiguous range of the system's
+ * particles and tets, numbered the same as the system's BodyContacts.
+ *
+ * A body is still while the mass weighted mean of its particles' squared
+ * speeds stays under the threshold squared, and ready to sleep once it has
+ * been still for a number of steps in a row, so it isn't put to sleep at
+ * the turning point of a bounce. Bodies touching in the last step form an
+ * island, and an island only sleeps once every body in it is ready, since
+ * a moving body would push the others. Bodies that fell asleep together
+ * stay one island, so waking one, by pushing it or by an awake body
+ * touching it, wakes them all.
+ */
+class SleepIslands
+{
+public:
+    /**
+     * @param threshold Speed, in distance per step, under which a body is still.
+     * @param surfaceParticles The system's surface particles, or empty if all
+     *                         particles are tested against colliders.
+     */
+    SleepIslands(float threshold, const vector<int> &surfaceParticles);
+
+    void addBody(int firstParticle, int numParticles, int firstTet, int numTets);
+
+    int numBodies() const;
+    bool isAsleep(int body) const;
+    bool isParticleAsleep(int particle) const;
+    bool allAsleep() const;
+
+    /** Wakes the body holding particle and every body asleep in its island. */
+    void wakeParticle(int particle);
+
+    /**
+     * Updates stillness from the particles' velocities at the end of a step
+     * and puts islands to sleep or wakes them. Sleeping particles have their
+     * velocities zeroed.
+     */
+    void update(System &system);
+
+    /** Half open ranges of the particles and tets of awake bodies. */
+    const vector<pair<int, int>> &awakeParticles() const;
+    const vector<pair<int, int>> &awakeTets() const;
+
+    /** The surface particles of awake bodies, in system order. */
+    const vector<int> &awakeSurfaceParticles() const;
+
+    /** Number of bodies asleep, for reporting. */
+    int numAsleep() const;
+
+private:
+    struct Body
+    {
+        int firstParticle;
+        int numParticles;
+        int firstTet;
+        int numTets;
+        bool asleep;
+
+        /** Steps in a row the body has been still. */
+        int stillSteps;
+
+        /** Body standing for the island it fell asleep with. */
+        int island;
+    };
+
+    int findRoot(int body);
+    void wake(int body);
+
+    /** Appends the ranges and surface particles of an awake body. */
+    void appendAwake(const Body &body);
+    void rebuildAwake();
+
+    float m_threshold;
+    vector<int> m_surfaceParticles;
+    vector<Body> m_bodies;
+    vector<int> m_particleBodies;
+    int m_numAsleep;
+
+    /** Union find over bodies, rebuilt every update. */
+    vector<int> m_parents;
+    vector<bool> m_islandReady;
+    vector<pair<int, int>> m_touching;
+
+    vector<pair<int, int>> m_awakeParticles;
+    vector<pair<int, int>> m_awakeTets;
+    vector<int> m_awakeSurfaceParticles;
+};
+
+#endif // SLEEPISLANDS_H
@@ -1,85 +1,320 @@
 #include "solver.h"
 
+#include "parallel.h"
+
+namespace {
+
+// Force per unit of penetration on each surface particle. Chosen so bodies
+// sink into the ground about as far as with the old per tet penalty of 10,
+// which every tet sharing a node added again.
+const float COLLISION_PENALTY = 100;
+
+// Self collision only pushes within a thin band around the surface, so its
+// penalty has to be stiffer to stop a body before it passes through the band.
+const float SELF_COLLISION_PENALTY = 500;
+
+// Contact between bodies pushes as hard as the colliders. Its band is thin
+// too, but a stiffer penalty crushes soft bodies where they touch.
+const float BODY_CONTACT_PENALTY = 100;
+
+// Damps how fast bodies in contact approach or separate, so stacks settle
+// instead of ringing. Much more sets light bodies ringing the other way.
+const float BODY_CONTACT_DAMPING = 3000;
+
+// Smallest share of tets and of particles handed to one thread at a time.
+const int TET_GRAIN = 256;
+const int PARTICLE_GRAIN = 1024;
+
+Parallel::Stage forcesStage("forces");
+Parallel::Stage collisionStage("collision");
+Parallel::Stage integrationStage("integration");
+
+}
+
 Solver::Solver(float incompressibility, float rigidity, float phi, float psi, float density):
     m_incompressibility(incompressibility),
     m_rigidity(rigidity),
     m_phi(phi),
     m_psi(psi),
-    m_density(density)
+    m_density(density),
+    m_sweepThreshold(0)
+{
+}
+
+void Solver::setSweepThreshold(float threshold)
 {
+    m_sweepThreshold = threshold;
 }
 
-void Solver::midpointStep(System system, float seconds)
+void Solver::setForceExchange(function<void(System &)> exchange)
 {
-    // Record original node position and velocity.
-    vector<vector<Vector3f>> originalPosVel = vector<vector<Vector3f>>();
-    for (unsigned int i = 0; i < system.getParticlesMap().size(); i++) {
-        vector<Vector3f> posVel = vector<Vector3f>();
-        posVel.push_back(system.getParticlesMap()[i].get()->getWorldPosition());
-        posVel.push_back(system.getParticlesMap()[i].get()->getVelocity());
-        originalPosVel.push_back(posVel);
+    m_forceExchange = move(exchange);
+}
+
+void Solver::midpointStep(System &system, float seconds)
+{
+    // Pushing a sleeping body wakes it. With every body asleep there is
+    // nothing to step.
+    shared_ptr<SleepIslands> sleep = system.getSleepIslands();
+    if (sleep) {
+        if (system.getPushForce() != Vector3f::Zero()) {
+            for (shared_ptr<Particle> p : system.getPushNodes()) {
+                if (p) {
+                    sleep->wakeParticle(p->getIndex());
+                }
+            }
+        }
+        if (sleep->allAsleep()) {
+            return;
+        }
+    }
+
+    // Record original node position and velocity. Every particle loop here
+    // touches only its own particle, so they're split across threads.
+    const int numParticles = system.getParticlesMap().size();
+    vector<vector<Vector3f>> originalPosVel(numParticles);
+    {
+        Parallel::StageTimer timer(integrationStage);
+        Parallel::forRange(0, numParticles, PARTICLE_GRAIN, [&](int begin, int end) {
+            for (int i = begin; i < end; i++) {
+                const Particle *particle = system.getParticlesMap().at(i).get();
+                originalPosVel[i] = { particle->getWorldPosition(), particle->getVelocity() };
+            }
+        });
     }
 
     // Get position and velocity after a naive euler step.
     vector<vector<Vector3f>> eulerStep = derivEval(system, seconds);
 
     // Update the system object with values halway between the original and the euler destination.
-    vector<Particle> parts = system.getParticleListCopy();
-    for (unsigned int i = 0; i < parts.size(); i++) {
-        parts.at(i).addPosition(eulerStep.at(i).at(0) * 0.5);
-        parts.at(i).addVelocity(eulerStep.at(i).at(1) * 0.5 * seconds);
-
-        system.getParticle(i).get()->addPosition(eulerStep.at(i).at(0) * 0.5);
-        system.getParticle(i).get()->addVelocity(eulerStep.at(i).at(1) * 0.5 * seconds);
+    {
+        Parallel::StageTimer timer(integrationStage);
+        Parallel::forRange(0, numParticles, PARTICLE_GRAIN, [&](int begin, int end) {
+            for (int i = begin; i < end; i++) {
+                if (sleep && sleep->isParticleAsleep(i)) {
+                    continue;
+                }
+                Particle *particle = system.getParticlesMap().at(i).get();
+                particle->addPosition(eulerStep[i][0] * 0.5);
+                particle->addVelocity(eulerStep[i][1] * 0.5 * seconds);
+            }
+        });
     }
 
     // Get pos and vel of the system calculated from the midpoint between original and euler.
     vector<vector<Vector3f>> midStep = derivEval(system, seconds * 0.5);
 
     // Calculate final position and velocity.
-    for (unsigned int i = 0; i < midStep.size(); i++) {
-        Vector3f finalPos = originalPosVel.at(i).at(0) + midStep.at(i).at(0);
-        Vector3f finalVel = originalPosVel.at(i).at(1) + (seconds * midStep.at(i).at(1));
+    {
+        Parallel::StageTimer timer(integrationStage);
+        Parallel::forRange(0, numParticles, PARTICLE_GRAIN, [&](int begin, int end) {
+            for (int i = begin; i < end; i++) {
+                if (sleep && sleep->isParticleAsleep(i)) {
+                    continue;
+                }
+                Vector3f finalPos = originalPosVel[i][0] + midStep[i][0];
+                Vector3f finalVel = originalPosVel[i][1] + (seconds * midStep[i][1]);
 
-        system.getParticle(i).get()->setPosition(finalPos);
-        system.getParticle(i).get()->setVelocity(finalVel);
+                Particle *particle = system.getParticlesMap().at(i).get();
+                particle->setPosition(finalPos);
+                particle->setVelocity(finalVel);
+            }
+        });
     }
-}
 
+    if (m_sweepThreshold > 0) {
+        Parallel::StageTimer timer(collisionStage);
+        sweepColliders(system, originalPosVel);
+    }
+    if (sleep) {
+        sleep->update(system);
+    }
+}
 
-vector<vector<Vector3f>> Solver::derivEval(System system, float seconds)
+void Solver::sweepColliders(System &system, const vector<vector<Vector3f>> &originalPosVel)
 {
-    // Zero forces
-    for (Tet tet : system.getTets()) {
-        tet.zeroForces();
+    // Penalties only see where a particle ends up, so one that moves far
+    // enough in a step can end up past a thin collider. Slower particles
+    // can't, and skip the sweep.
+    const float threshold2 = m_sweepThreshold * m_sweepThreshold;
+    const vector<int> &surface = system.getSurfaceParticles();
+    vector<shared_ptr<CollisionObject>> colliders = system.getColliders();
+    int count = surface.empty() ? originalPosVel.size() : surface.size();
+    for (int k = 0; k < count; k++) {
+        int i = surface.empty() ? k : surface[k];
+        Particle *particle = system.getParticle(i).get();
+        const Vector3f &start = originalPosVel[i][0];
+        Vector3f end = particle->getWorldPosition();
+        if ((end - start).squaredNorm() <= threshold2) {
+            continue;
+        }
+
+        AlignedBox3f path(start);
+        path.extend(end);
+        float earliest = 2;
+        Vector3f normal;
+        for (const shared_ptr<CollisionObject> &collider : colliders) {
+            float t;
+            Vector3f n;
+            if (collider->mayIntersect(path) && collider->sweptIntersection(start, end, t, n) && t < earliest) {
+                earliest = t;
+                normal = n;
+            }
+        }
+        if (earliest > 1) {
+            continue;
+        }
+
+        // Stop at the time of impact and drop the velocity into the
+        // surface; the penalty takes over from there.
+        particle->setPosition(start + earliest * (end - start));
+        Vector3f velocity = particle->getVelocity();
+        float approach = velocity.dot(normal);
+        if (approach < 0) {
+            particle->setVelocity(velocity - approach * normal);
+        }
     }
+}
+
 
-    if (system.getPushForce() != Vector3f::Zero()) {
-        for (shared_ptr<Particle> p : system.getPushNodes()) {
-            p->addForce(system.getPushForce());
+void Solver::applyColliders(System &system, float penalty)
+{
+    // Only surface particles can touch a collider first, and each is tested
+    // once however many tets share it. Sleeping bodies aren't tested.
+    shared_ptr<SleepIslands> sleep = system.getSleepIslands();
+    const vector<int> &surface = sleep ? sleep->awakeSurfaceParticles() : system.getSurfaceParticles();
+    int count = surface.empty() ? system.getParticlesMap().size() : surface.size();
+    m_collisionParticles.resize(count);
+    m_collisionPositions.resize(count);
+    for (int k = 0; k < 3; k++) {
+        m_collisionCoordinates[k].resize(count);
+        m_collisionForces[k].assign(count, 0);
+    }
+    for (int i = 0; i < count; i++) {
+        m_collisionParticles[i] = system.getParticle(surface.empty() ? i : surface[i]).get();
+        m_collisionPositions[i] = m_collisionParticles[i]->getWorldPosition();
+        for (int k = 0; k < 3; k++) {
+            m_collisionCoordinates[k][i] = m_collisionPositions[i][k];
         }
     }
 
-    for (unsigned int i = 0; i < system.getParticlesMap().size(); i++) {
-        system.getParticlesMap()[i]->addForce(Vector3f(0, -1, 0));
+    // Planes and spheres run their own loops over the clusters they reach,
+    // summing into one force per particle.
+    const ColliderSet &colliderSet = system.getColliderSet();
+    const vector<shared_ptr<CollisionObject>> &colliders = colliderSet.others();
+    m_broadPhase.update(m_collisionPositions, colliders);
+    colliderSet.addPenalties(m_broadPhase, m_collisionCoordinates[0].data(), m_collisionCoordinates[1].data(),
+                             m_collisionCoordinates[2].data(), penalty, m_collisionForces[0].data(),
+                             m_collisionForces[1].data(), m_collisionForces[2].data());
+    for (int i = 0; i < count; i++) {
+        Vector3f force(m_collisionForces[0][i], m_collisionForces[1][i], m_collisionForces[2][i]);
+        if (force != Vector3f::Zero()) {
+            m_collisionParticles[i]->addForce(force);
+        }
     }
 
-    // Accumulate all forces here.
-    for (Tet tet : system.getTets()) {
-        tet.applyColliders(system.getColliders(), 10);
-        tet.applyNodeForces(m_incompressibility, m_rigidity, m_phi, m_psi);
+    // The broad phase gives every other collider only the clusters of
+    // particles it can reach; the rest would add zero. Each collider then
+    // gets all of its points in one call, so expensive colliders can split
+    // the work up.
+    for (unsigned int k = 0; k < colliders.size(); k++) {
+        const vector<int> &clusters = m_broadPhase.clusters(k);
+        if (clusters.empty()) {
+            continue;
+        }
+        m_queryIndices.clear();
+        m_queryPositions.clear();
+        for (int c : clusters) {
+            for (int i = m_broadPhase.clusterBegin(c); i < m_broadPhase.clusterEnd(c); i++) {
+                m_queryIndices.push_back(i);
+                m_queryPositions.push_back(m_collisionPositions[i]);
+            }
+        }
+        m_penetrations.resize(m_queryPositions.size());
+        colliders[k]->pointIntersections(m_queryPositions.data(), m_queryPositions.size(), m_penetrations.data());
+        for (unsigned int q = 0; q < m_penetrations.size(); q++) {
+            if (m_penetrations[q] != Vector3f::Zero()) {
+                m_collisionParticles[m_queryIndices[q]]->addForce(m_penetrations[q] * penalty);
+            }
+        }
     }
+}
+
+vector<vector<Vector3f>> Solver::derivEval(System &system, float seconds)
+{
+    // Only the tets and particles of awake bodies are evaluated.
+    vector<Tet> &tets = system.getTets();
+    shared_ptr<SleepIslands> sleep = system.getSleepIslands();
+    const vector<pair<int, int>> allTets(1, make_pair(0, static_cast<int>(tets.size())));
+    const vector<pair<int, int>> allParticles(1, make_pair(0, static_cast<int>(system.getParticlesMap().size())));
+    const vector<pair<int, int>> &tetRanges = sleep ? sleep->awakeTets() : allTets;
+    const vector<pair<int, int>> &particleRanges = sleep ? sleep->awakeParticles() : allParticles;
 
-    vector<vector<Vector3f>> posVels = vector<vector<Vector3f>>();
-    for (unsigned int i = 0; i < system.getParticlesMap().size(); i++) {
-        shared_ptr<Particle> p = system.getParticlesMap()[i];
+    // The stages run as a graph. Elastic forces only read positions and
+    // velocities, so they're worked out alongside the rest and added to the
+    // nodes last; tets share nodes, so that's on one thread, in tet order.
+    Parallel::TaskGraph graph;
+    int external = graph.add(forcesStage, [&]() {
+        // Zero forces
+        for (const pair<int, int> &range : tetRanges) {
+            for (int t = range.first; t < range.second; t++) {
+                tets[t].zeroForces();
+            }
+        }
 
-        vector<Vector3f> posVel = vector<Vector3f>();
-        posVel.push_back(p->getVelocity());
-        posVel.push_back(p->getForce() / p->getMass());
+        if (system.getPushForce() != Vector3f::Zero()) {
+            for (shared_ptr<Particle> p : system.getPushNodes()) {
+                p->addForce(system.getPushForce());
+            }
+        }
 
-        posVels.push_back(posVel);
+        for (const pair<int, int> &range : particleRanges) {
+            for (int i = range.first; i < range.second; i++) {
+                system.getParticlesMap()[i]->addForce(Vector3f(0, -1, 0));
+            }
+        }
+    });
+    int collisions = graph.add(collisionStage, [&]() {
+        applyColliders(system, COLLISION_PENALTY);
+        if (shared_ptr<SelfCollision> selfCollision = system.getSelfCollision()) {
+            selfCollision->apply(system, SELF_COLLISION_PENALTY);
+        }
+        if (shared_ptr<BodyContacts> bodyContacts = system.getBodyContacts()) {
+            bodyContacts->apply(system, BODY_CONTACT_PENALTY, BODY_CONTACT_DAMPING);
+        }
+    }, { external });
+    int elastic = graph.add(forcesStage, [&]() {
+        m_tetForces.resize(tets.size() * 4);
+        for (const pair<int, int> &range : tetRanges) {
+            Parallel::forRange(range.first, range.second, TET_GRAIN, [&](int begin, int end) {
+                for (int t = begin; t < end; t++) {
+                    tets[t].nodeForces(m_incompressibility, m_rigidity, m_phi, m_psi, &m_tetForces[t * 4]);
+                }
+            });
+        }
+    });
+    graph.add(forcesStage, [&]() {
+        for (const pair<int, int> &range : tetRanges) {
+            for (int t = range.first; t < range.second; t++) {
+                for (int k = 0; k < 4; k++) {
+                    tets[t].node(k)->addForce(m_tetForces[t * 4 + k]);
+                }
+            }
+        }
+    }, { collisions, elastic });
+    graph.run();
+    if (m_forceExchange) {
+        m_forceExchange(system);
     }
 
+    Parallel::StageTimer timer(integrationStage);
+    vector<vector<Vector3f>> posVels(system.getParticlesMap().size());
+    Parallel::forRange(0, posVels.size(), PARTICLE_GRAIN, [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            const Particle *p = system.getParticlesMap().at(i).get();
+            posVels[i] = { p->getVelocity(), p->getForce() / p->getMass() };
+        }
+    });
+
     return posVels;
 }
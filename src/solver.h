@@ -1,7 +1,9 @@
 #ifndef SOLVER_H
 #define SOLVER_H
 
+#include <functional>
 #include "system.h"
+#include "broadphase.h"
 #include "collisionobject.h"
 
 class Solver
@@ -12,16 +14,65 @@ public:
      * Solves the force function given a system state and some amount of time
      * to step into the future.
      */
-    void midpointStep(System system, float seconds);
+    void midpointStep(System &system, float seconds);
 
-    vector<vector<Vector3f>> derivEval(System system, float seconds);
+    vector<vector<Vector3f>> derivEval(System &system, float seconds);
+
+    /**
+     * Particles that move further than threshold in one step are swept
+     * against the colliders and stopped where they first touch one, so fast
+     * particles can't step over a thin collider. Zero, the default, turns
+     * sweeping off.
+     */
+    void setSweepThreshold(float threshold);
+
+    /**
+     * Called in every evaluation once the forces on the particles are
+     * summed, before they're turned into accelerations, so a partitioned
+     * run can replace the forces on particles another process owns. None by
+     * default.
+     */
+    void setForceExchange(function<void(System &)> exchange);
 
 private:
+    /**
+     * Adds penalty times penetration depth to every surface particle inside
+     * a collider.
+     */
+    void applyColliders(System &system, float penalty);
+
+    /**
+     * Sweeps the surface particles that moved further than the threshold
+     * from their positions at the start of the step, given as the first of
+     * each particle's originalPosVel pair.
+     */
+    void sweepColliders(System &system, const vector<vector<Vector3f>> &originalPosVel);
+
     float m_incompressibility;
     float m_rigidity;
     float m_phi;
     float m_psi;
     float m_density;
+    float m_sweepThreshold;
+    function<void(System &)> m_forceExchange;
+
+    BroadPhase m_broadPhase;
+
+    /** Surface particles and their positions, reused across evaluations. */
+    vector<Particle *> m_collisionParticles;
+    vector<Vector3f> m_collisionPositions;
+
+    /** The same positions one coordinate per array, and the forces of the typed colliders. */
+    vector<float> m_collisionCoordinates[3];
+    vector<float> m_collisionForces[3];
+
+    /** One collider's query: indices into the above and their results. */
+    vector<int> m_queryIndices;
+    vector<Vector3f> m_queryPositions;
+    vector<Vector3f> m_penetrations;
+
+    /** Each tet's forces on its four nodes, before they're added to the nodes. */
+    vector<Vector3f> m_tetForces;
 
 };
 
@@ -0,0 +1,517 @@
+#include "surfacebvh.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#include "parallel.h"
+
+using namespace Eigen;
+using namespace std;
+
+namespace {
+
+const int MAX_DEPTH = 64;
+const float EPSILON = 0.0000001;
+
+// Smallest number of leaves refit by one thread at a time.
+const int REFIT_GRAIN = 64;
+
+}
+
+SurfaceBVH::SurfaceBVH()
+{
+}
+
+void SurfaceBVH::build(const vector<Vector3i> &faces, const vector<Vector3f> &positions)
+{
+    m_faces = faces;
+    m_nodes.clear();
+    m_blocks.clear();
+    m_leaves.clear();
+    vector<int> order(faces.size());
+    vector<Vector3f> centroids(faces.size());
+    for (unsigned int i = 0; i < faces.size(); i++) {
+        order[i] = i;
+        centroids[i] = (positions[faces[i][0]] + positions[faces[i][1]] + positions[faces[i][2]]) / 3.f;
+    }
+    if (!faces.empty()) {
+        m_nodes.reserve(2 * faces.size() / BLOCK_SIZE + 1);
+        m_blocks.reserve(faces.size() / (BLOCK_SIZE / 2) + 1);
+        buildNode(0, faces.size(), order, centroids);
+        refit(positions);
+    }
+}
+
+int SurfaceBVH::buildNode(int first, int count, vector<int> &order, vector<Vector3f> &centroids)
+{
+    int nodeIndex = m_nodes.size();
+    m_nodes.push_back(Node());
+
+    if (count <= BLOCK_SIZE) {
+        TriangleBlock block;
+        memset(&block, 0, sizeof(block));
+        for (int lane = 0; lane < BLOCK_SIZE; lane++) {
+            block.faces[lane] = lane < count ? order[first + lane] : -1;
+        }
+        m_nodes[nodeIndex].index = m_blocks.size();
+        m_nodes[nodeIndex].count = count;
+        m_blocks.push_back(block);
+        m_leaves.push_back(nodeIndex);
+        return nodeIndex;
+    }
+
+    // Split at the median centroid along the axis the centroids spread most.
+    Vector3f lo = centroids[order[first]];
+    Vector3f hi = lo;
+    for (int i = first; i < first + count; i++) {
+        lo = lo.cwiseMin(centroids[order[i]]);
+        hi = hi.cwiseMax(centroids[order[i]]);
+    }
+    int axis;
+    (hi - lo).maxCoeff(&axis);
+
+    int half = count / 2;
+    nth_element(order.begin() + first, order.begin() + first + half, order.begin() + first + count,
+                [&centroids, axis](int a, int b) { return centroids[a][axis] < centroids[b][axis]; });
+
+    buildNode(first, half, order, centroids);
+    int right = buildNode(first + half, count - half, order, centroids);
+    m_nodes[nodeIndex].index = right;
+    m_nodes[nodeIndex].count = 0;
+    return nodeIndex;
+}
+
+void SurfaceBVH::refit(const vector<Vector3f> &positions)
+{
+    // Each leaf only writes its own node and block, so the leaves are refit
+    // in parallel.
+    Parallel::forRange(0, m_leaves.size(), REFIT_GRAIN, [&](int begin, int end) {
+        for (int l = begin; l < end; l++) {
+            Node &node = m_nodes[m_leaves[l]];
+            TriangleBlock &block = m_blocks[node.index];
+            node.lo = Vector3f::Constant(numeric_limits<float>::max());
+            node.hi = Vector3f::Constant(-numeric_limits<float>::max());
+            for (int lane = 0; lane < node.count; lane++) {
+                const Vector3i &face = m_faces[block.faces[lane]];
+                const Vector3f &v0 = positions[face[0]];
+                const Vector3f &v1 = positions[face[1]];
+                const Vector3f &v2 = positions[face[2]];
+                for (int c = 0; c < 3; c++) {
+                    block.v0[c][lane] = v0[c];
+                    block.e1[c][lane] = v1[c] - v0[c];
+                    block.e2[c][lane] = v2[c] - v0[c];
+                }
+                node.lo = node.lo.cwiseMin(v0).cwiseMin(v1).cwiseMin(v2);
+                node.hi = node.hi.cwiseMax(v0).cwiseMax(v1).cwiseMax(v2);
+            }
+        }
+    });
+
+    // Children always come after their parent, so walking backwards visits
+    // both children before the parent.
+    for (int n = static_cast<int>(m_nodes.size()) - 1; n >= 0; n--) {
+        Node &node = m_nodes[n];
+        if (node.count == 0) {
+            const Node &left = m_nodes[n + 1];
+            const Node &right = m_nodes[node.index];
+            node.lo = left.lo.cwiseMin(right.lo);
+            node.hi = left.hi.cwiseMax(right.hi);
+        }
+    }
+}
+
+AlignedBox3f SurfaceBVH::bounds() const
+{
+    if (m_nodes.empty()) {
+        return AlignedBox3f();
+    }
+    return AlignedBox3f(m_nodes[0].lo, m_nodes[0].hi);
+}
+
+int SurfaceBVH::numBlocks() const
+{
+    return m_blocks.size();
+}
+
+const SurfaceBVH::TriangleBlock &SurfaceBVH::block(int index) const
+{
+    return m_blocks[index];
+}
+
+void SurfaceBVH::overlappingBlocks(const SurfaceBVH &other, float margin, vector<pair<int, int>> &pairs) const
+{
+    if (m_nodes.empty() || other.m_nodes.empty()) {
+        return;
+    }
+
+    // Each step replaces a pair by two pairs one level deeper on one side,
+    // so the stack never holds more than the two depths added together.
+    pair<int, int> stack[2 * MAX_DEPTH];
+    int stackSize = 0;
+    stack[stackSize++] = make_pair(0, 0);
+    while (stackSize > 0) {
+        const pair<int, int> nodes = stack[--stackSize];
+        const Node &a = m_nodes[nodes.first];
+        const Node &b = other.m_nodes[nodes.second];
+        if (((a.lo.array() - margin) > b.hi.array()).any() || ((b.lo.array() - margin) > a.hi.array()).any()) {
+            continue;
+        }
+        if (a.count > 0 && b.count > 0) {
+            pairs.push_back(make_pair(a.index, b.index));
+            continue;
+        }
+
+        // Open the internal node with the larger box, so both sides shrink
+        // at about the same rate.
+        bool openA = b.count > 0 || (a.count == 0 && (a.hi - a.lo).sum() >= (b.hi - b.lo).sum());
+        if (openA) {
+            stack[stackSize++] = make_pair(a.index, nodes.second);
+            stack[stackSize++] = make_pair(nodes.first + 1, nodes.second);
+        } else {
+            stack[stackSize++] = make_pair(nodes.first, b.index);
+            stack[stackSize++] = make_pair(nodes.first, nodes.second + 1);
+        }
+    }
+}
+
+bool SurfaceBVH::hitsBox(const Node &node, const Vector3f &origin, const Vector3f &invDirection, float maxDist, float &entry)
+{
+    // Slab test; infinities from zero direction components fall out right.
+    Vector3f t0 = (node.lo - origin).cwiseProduct(invDirection);
+    Vector3f t1 = (node.hi - origin).cwiseProduct(invDirection);
+    float tNear = t0.cwiseMin(t1).maxCoeff();
+    float tFar = t0.cwiseMax(t1).minCoeff();
+    entry = tNear;
+    return tNear <= tFar && tFar >= 0 && tNear < maxDist;
+}
+
+int SurfaceBVH::intersectBlock(const Vector3f &origin, const Vector3f &direction,
+                               const TriangleBlock &block, float maxDist, float &t)
+{
+    // Möller–Trumbore on every lane at once, with the same operation order as
+    // intersectTriangle (Eigen sums a 3 term dot product as a0 + (a1 + a2))
+    // so both give bit identical distances. Every lane
+    // computes everything and the tests are folded into a mask with
+    // non short circuiting operators, which keeps the loop free of branches.
+    const float ox = origin[0], oy = origin[1], oz = origin[2];
+    const float dx = direction[0], dy = direction[1], dz = direction[2];
+    float laneT[BLOCK_SIZE];
+    for (int i = 0; i < BLOCK_SIZE; i++) {
+        float e1x = block.e1[0][i], e1y = block.e1[1][i], e1z = block.e1[2][i];
+        float e2x = block.e2[0][i], e2y = block.e2[1][i], e2z = block.e2[2][i];
+        float hx = dy * e2z - dz * e2y;
+        float hy = dz * e2x - dx * e2z;
+        float hz = dx * e2y - dy * e2x;
+        float a = e1x * hx + (e1y * hy + e1z * hz);
+        bool parallel = (a > -EPSILON) & (a < EPSILON);
+        // Parallel lanes divide by about zero; the mask below drops them.
+        float f = 1.f / a;
+        float sx = ox - block.v0[0][i], sy = oy - block.v0[1][i], sz = oz - block.v0[2][i];
+        float u = f * (sx * hx + (sy * hy + sz * hz));
+        float qx = sy * e1z - sz * e1y;
+        float qy = sz * e1x - sx * e1z;
+        float qz = sx * e1y - sy * e1x;
+        float v = f * (dx * qx + (dy * qy + dz * qz));
+        float hitT = f * (e2x * qx + (e2y * qy + e2z * qz));
+        bool hit = !parallel & (u >= 0.f) & (u <= 1.f) & (v >= 0.f) & (u + v <= 1.f) & (hitT > EPSILON) & (hitT < maxDist);
+        laneT[i] = hit ? hitT : numeric_limits<float>::infinity();
+    }
+
+    int lane = -1;
+    float closest = maxDist;
+    for (int i = 0; i < BLOCK_SIZE; i++) {
+        if (laneT[i] < closest) {
+            closest = laneT[i];
+            lane = i;
+        }
+    }
+    if (lane >= 0) {
+        t = closest;
+    }
+    return lane;
+}
+
+bool SurfaceBVH::intersect(const Vector3f &origin, const Vector3f &direction, int &face, float &dist) const
+{
+    if (m_nodes.empty()) {
+        return false;
+    }
+    const Vector3f invDirection = direction.cwiseInverse();
+    float closest = numeric_limits<float>::max();
+    int closestFace = -1;
+
+    float entry;
+    if (!hitsBox(m_nodes[0], origin, invDirection, closest, entry)) {
+        return false;
+    }
+    int stack[MAX_DEPTH];
+    int stackSize = 0;
+    stack[stackSize++] = 0;
+    while (stackSize > 0) {
+        int nodeIndex = stack[--stackSize];
+        const Node &node = m_nodes[nodeIndex];
+        if (node.count > 0) {
+            const TriangleBlock &block = m_blocks[node.index];
+            float t;
+            int lane = intersectBlock(origin, direction, block, closest, t);
+            if (lane >= 0) {
+                closest = t;
+                closestFace = block.faces[lane];
+            }
+            continue;
+        }
+
+        // Push the far child first so the near one is searched first and
+        // tightens closest sooner.
+        int left = nodeIndex + 1;
+        int right = node.index;
+        float leftEntry, rightEntry;
+        bool hitLeft = hitsBox(m_nodes[left], origin, invDirection, closest, leftEntry);
+        bool hitRight = hitsBox(m_nodes[right], origin, invDirection, closest, rightEntry);
+        if (hitLeft && hitRight) {
+            if (leftEntry < rightEntry) {
+                stack[stackSize++] = right;
+                stack[stackSize++] = left;
+            } else {
+                stack[stackSize++] = left;
+                stack[stackSize++] = right;
+            }
+        } else if (hitLeft) {
+            stack[stackSize++] = left;
+        } else if (hitRight) {
+            stack[stackSize++] = right;
+        }
+    }
+
+    if (closestFace < 0) {
+        return false;
+    }
+    face = closestFace;
+    dist = closest;
+    return true;
+}
+
+void SurfaceBVH::intersectPacket(const Vector3f *origins, const Vector3f *directions, int count,
+                                 int *faces, float *dists) const
+{
+    for (int first = 0; first < count; first += MAX_PACKET) {
+        const int packetSize = min(MAX_PACKET, count - first);
+        const Vector3f *packetOrigins = origins + first;
+        const Vector3f *packetDirections = directions + first;
+
+        // Rays structure-of-arrays so each box is tested against the whole
+        // packet in one vectorized loop. Padding rays have a negative
+        // closest distance, which no box passes.
+        alignas(32) float origin[3][MAX_PACKET];
+        alignas(32) float invDirection[3][MAX_PACKET];
+        alignas(32) float closest[MAX_PACKET];
+        for (int r = 0; r < MAX_PACKET; r++) {
+            bool used = r < packetSize;
+            for (int c = 0; c < 3; c++) {
+                origin[c][r] = used ? packetOrigins[r][c] : 0.f;
+                invDirection[c][r] = used ? 1.f / packetDirections[r][c] : 1.f;
+            }
+            closest[r] = used ? numeric_limits<float>::max() : -1.f;
+        }
+        for (int r = 0; r < packetSize; r++) {
+            faces[first + r] = -1;
+        }
+        if (m_nodes.empty()) {
+            continue;
+        }
+
+        // Each stack entry carries the mask of rays still interested in it,
+        // so the tree is walked once for the packet and only rays that reached
+        // a node go on to its children.
+        int stack[MAX_DEPTH];
+        uint64_t stackMasks[MAX_DEPTH];
+        int stackSize = 0;
+        stack[stackSize] = 0;
+        stackMasks[stackSize++] = ~uint64_t(0);
+        while (stackSize > 0) {
+            --stackSize;
+            int nodeIndex = stack[stackSize];
+            const Node &node = m_nodes[nodeIndex];
+            uint8_t hits[MAX_PACKET];
+            for (int r = 0; r < MAX_PACKET; r++) {
+                float tNear = 0.f;
+                float tFar = closest[r];
+                for (int c = 0; c < 3; c++) {
+                    float t0 = (node.lo[c] - origin[c][r]) * invDirection[c][r];
+                    float t1 = (node.hi[c] - origin[c][r]) * invDirection[c][r];
+                    tNear = max(tNear, min(t0, t1));
+                    tFar = min(tFar, max(t0, t1));
+                }
+                hits[r] = tNear <= tFar;
+            }
+            uint64_t active = 0;
+            for (int r = 0; r < MAX_PACKET; r++) {
+                active |= uint64_t(hits[r]) << r;
+            }
+            active &= stackMasks[stackSize];
+            if (!active) {
+                continue;
+            }
+            if (node.count > 0) {
+                const TriangleBlock &block = m_blocks[node.index];
+                for (uint64_t rays = active; rays; rays &= rays - 1) {
+                    int r = __builtin_ctzll(rays);
+                    float t;
+                    int lane = intersectBlock(packetOrigins[r], packetDirections[r], block, closest[r], t);
+                    if (lane >= 0) {
+                        closest[r] = t;
+                        faces[first + r] = block.faces[lane];
+                    }
+                }
+                continue;
+            }
+            // Visit first the child nearer along the first active ray, so
+            // coherent packets tighten closest as early as a single ray would.
+            int left = nodeIndex + 1;
+            int right = node.index;
+            int r = __builtin_ctzll(active);
+            Vector3f between = (m_nodes[right].lo + m_nodes[right].hi) - (m_nodes[left].lo + m_nodes[left].hi);
+            bool leftNearer = between.dot(packetDirections[r]) > 0;
+            stack[stackSize] = leftNearer ? right : left;
+            stackMasks[stackSize++] = active;
+            stack[stackSize] = leftNearer ? left : right;
+            stackMasks[stackSize++] = active;
+        }
+        for (int r = 0; r < packetSize; r++) {
+            dists[first + r] = closest[r];
+        }
+    }
+}
+
+bool SurfaceBVH::closestPoint(const Vector3f &point, float maxDist, Vector3f &closest, int &face, float &dist) const
+{
+    if (m_nodes.empty()) {
+        return false;
+    }
+    float best = maxDist * maxDist;
+    int bestFace = -1;
+    Vector3f bestPoint = Vector3f::Zero();
+
+    int stack[MAX_DEPTH];
+    int stackSize = 0;
+    stack[stackSize++] = 0;
+    while (stackSize > 0) {
+        const int nodeIndex = stack[--stackSize];
+        const Node &node = m_nodes[nodeIndex];
+        if (node.count > 0) {
+            const TriangleBlock &block = m_blocks[node.index];
+            for (int lane = 0; lane < node.count; lane++) {
+                Vector3f v0(block.v0[0][lane], block.v0[1][lane], block.v0[2][lane]);
+                Vector3f e1(block.e1[0][lane], block.e1[1][lane], block.e1[2][lane]);
+                Vector3f e2(block.e2[0][lane], block.e2[1][lane], block.e2[2][lane]);
+                Vector3f candidate = closestPointOnTriangle(point, v0, v0 + e1, v0 + e2);
+                float squaredDist = (candidate - point).squaredNorm();
+                if (squaredDist < best) {
+                    best = squaredDist;
+                    bestFace = block.faces[lane];
+                    bestPoint = candidate;
+                }
+            }
+            continue;
+        }
+
+        // Push the farther child first so the nearer one shrinks best first.
+        int left = nodeIndex + 1;
+        int right = node.index;
+        float leftDist = AlignedBox3f(m_nodes[left].lo, m_nodes[left].hi).squaredExteriorDistance(point);
+        float rightDist = AlignedBox3f(m_nodes[right].lo, m_nodes[right].hi).squaredExteriorDistance(point);
+        if (leftDist > rightDist) {
+            swap(left, right);
+            swap(leftDist, rightDist);
+        }
+        if (rightDist < best) {
+            stack[stackSize++] = right;
+        }
+        if (leftDist < best) {
+            stack[stackSize++] = left;
+        }
+    }
+
+    if (bestFace < 0) {
+        return false;
+    }
+    closest = bestPoint;
+    face = bestFace;
+    dist = sqrtf(best);
+    return true;
+}
+
+// From Ericson, Real-Time Collision Detection, section 5.1.5: find the
+// Voronoi region of the triangle p lies in and project onto that feature.
+Vector3f SurfaceBVH::closestPointOnTriangle(const Vector3f &p, const Vector3f &a, const Vector3f &b, const Vector3f &c)
+{
+    Vector3f ab = b - a;
+    Vector3f ac = c - a;
+    Vector3f ap = p - a;
+    float d1 = ab.dot(ap);
+    float d2 = ac.dot(ap);
+    if (d1 <= 0 && d2 <= 0) {
+        return a;
+    }
+
+    Vector3f bp = p - b;
+    float d3 = ab.dot(bp);
+    float d4 = ac.dot(bp);
+    if (d3 >= 0 && d4 <= d3) {
+        return b;
+    }
+
+    float vc = d1 * d4 - d3 * d2;
+    if (vc <= 0 && d1 >= 0 && d3 <= 0) {
+        return a + ab * (d1 / (d1 - d3));
+    }
+
+    Vector3f cp = p - c;
+    float d5 = ab.dot(cp);
+    float d6 = ac.dot(cp);
+    if (d6 >= 0 && d5 <= d6) {
+        return c;
+    }
+
+    float vb = d5 * d2 - d1 * d6;
+    if (vb <= 0 && d2 >= 0 && d6 <= 0) {
+        return a + ac * (d2 / (d2 - d6));
+    }
+
+    float va = d3 * d6 - d5 * d4;
+    if (va <= 0 && (d4 - d3) >= 0 && (d5 - d6) >= 0) {
+        return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+    }
+
+    float denom = 1 / (va + vb + vc);
+    return a + ab * (vb * denom) + ac * (vc * denom);
+}
+
+// This is from this wikipedia article: https://en.wikipedia.org/wiki/M%C3%B6ller%E2%80%93Trumbore_intersection_algorithm.
+bool SurfaceBVH::intersectTriangle(const Vector3f &origin, const Vector3f &direction,
+                                   const Vector3f &v0, const Vector3f &v1, const Vector3f &v2,
+                                   float &t)
+{
+    Vector3f edge1 = v1 - v0;
+    Vector3f edge2 = v2 - v0;
+    Vector3f h = direction.cross(edge2);
+    float a = edge1.dot(h);
+    if (a > -EPSILON && a < EPSILON) {
+        return false;    // This ray is parallel to this triangle.
+    }
+    float f = 1.0 / a;
+    Vector3f s = origin - v0;
+    float u = f * s.dot(h);
+    if (u < 0.0 || u > 1.0) {
+        return false;
+    }
+    Vector3f q = s.cross(edge1);
+    float v = f * direction.dot(q);
+    if (v < 0.0 || u + v > 1.0) {
+        return false;
+    }
+    t = f * edge2.dot(q);
+    return t > EPSILON;
+}
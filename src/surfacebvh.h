@@ -0,0 +1,138 @@
+#ifndef SURFACEBVH_H
+#define SURFACEBVH_H
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include <Eigen/Dense>
+#include <Eigen/Geometry>
+#include <Eigen/StdVector>
+
+/**
+ * Bounding volume hierarchy over the triangles of a deforming surface. The
+ * tree topology is built once; as the surface moves only the boxes are
+ * refit, which is a single linear pass over the nodes. Static surfaces just
+ * never refit.
+ *
+ * Every leaf holds up to BLOCK_SIZE triangles stored structure-of-arrays in a
+ * TriangleBlock, so one ray is tested against a whole leaf with straight
+ * line lane loops the compiler turns into SIMD.
+ */
+class SurfaceBVH
+{
+public:
+    static const int BLOCK_SIZE = 8;
+
+    /** Largest number of rays traversed together by intersectPacket. */
+    static const int MAX_PACKET = 64;
+
+    SurfaceBVH();
+
+    /**
+     * Builds the tree over faces, indexing into positions.
+     */
+    void build(const std::vector<Eigen::Vector3i> &faces, const std::vector<Eigen::Vector3f> &positions);
+
+    /**
+     * Recomputes the triangle blocks and every box bottom up from new
+     * positions of the same vertices.
+     */
+    void refit(const std::vector<Eigen::Vector3f> &positions);
+
+    /**
+     * Box around the whole surface as of the last build or refit. Empty for
+     * an empty surface.
+     */
+    Eigen::AlignedBox3f bounds() const;
+
+    /**
+     * Appends to pairs every pair of leaves, one of this tree and one of
+     * other, whose boxes come within margin of each other, as indices of
+     * their blocks. Both trees are descended together, so only node pairs
+     * that overlap are ever visited.
+     */
+    void overlappingBlocks(const SurfaceBVH &other, float margin, std::vector<std::pair<int, int>> &pairs) const;
+
+    /**
+     * Finds the closest triangle hit by the ray. On a hit, returns true and
+     * sets face to the index of the face passed to build and dist to the
+     * distance along direction.
+     */
+    bool intersect(const Eigen::Vector3f &origin, const Eigen::Vector3f &direction, int &face, float &dist) const;
+
+    /**
+     * Closest hits for count rays, traversing the tree once per group of up to
+     * MAX_PACKET rays. faces[i] is -1 for rays that miss.
+     */
+    void intersectPacket(const Eigen::Vector3f *origins, const Eigen::Vector3f *directions, int count,
+                         int *faces, float *dists) const;
+
+    /**
+     * Finds the point on the surface closest to point, if it is nearer than
+     * maxDist. On success sets closest, the face it lies on and its distance.
+     */
+    bool closestPoint(const Eigen::Vector3f &point, float maxDist,
+                      Eigen::Vector3f &closest, int &face, float &dist) const;
+
+    /**
+     * Closest point to p on the triangle a, b, c.
+     */
+    static Eigen::Vector3f closestPointOnTriangle(const Eigen::Vector3f &p, const Eigen::Vector3f &a,
+                                                  const Eigen::Vector3f &b, const Eigen::Vector3f &c);
+
+    /**
+     * Möller–Trumbore ray triangle intersection that doesn't allocate. Returns
+     * true and sets t if the ray hits the triangle in front of its origin.
+     */
+    static bool intersectTriangle(const Eigen::Vector3f &origin, const Eigen::Vector3f &direction,
+                                  const Eigen::Vector3f &v0, const Eigen::Vector3f &v1, const Eigen::Vector3f &v2,
+                                  float &t);
+
+    /**
+     * Up to BLOCK_SIZE triangles as a first vertex and two edges per lane.
+     * Unused lanes have zero edges, which the kernel rejects as parallel.
+     */
+    struct TriangleBlock
+    {
+        alignas(32) float v0[3][BLOCK_SIZE];
+        alignas(32) float e1[3][BLOCK_SIZE];
+        alignas(32) float e2[3][BLOCK_SIZE];
+        int faces[BLOCK_SIZE];
+    };
+
+    /**
+     * Tests one ray against every lane of a block. Returns the lane of the
+     * closest hit nearer than maxDist and sets t, or returns -1.
+     */
+    static int intersectBlock(const Eigen::Vector3f &origin, const Eigen::Vector3f &direction,
+                              const TriangleBlock &block, float maxDist, float &t);
+
+    /** Leaf blocks, in the same order across refits. */
+    int numBlocks() const;
+    const TriangleBlock &block(int index) const;
+
+private:
+    struct Node
+    {
+        Eigen::Vector3f lo;
+        Eigen::Vector3f hi;
+        /** Leaf: index of its block. Internal: index of the right child;
+         *  the left child always directly follows its parent. */
+        int index;
+        /** Number of triangles in a leaf, 0 for internal nodes. */
+        int count;
+    };
+
+    int buildNode(int first, int count, std::vector<int> &order, std::vector<Eigen::Vector3f> &centroids);
+
+    static bool hitsBox(const Node &node, const Eigen::Vector3f &origin, const Eigen::Vector3f &invDirection,
+                        float maxDist, float &entry);
+
+    std::vector<Node> m_nodes;
+    std::vector<TriangleBlock, Eigen::aligned_allocator<TriangleBlock>> m_blocks;
+    std::vector<Eigen::Vector3i> m_faces;
+    /** Indices of the leaf nodes. */
+    std::vector<int> m_leaves;
+};
+
+#endif // SURFACEBVH_H
@@ -0,0 +1,123 @@
+#include "surfaceextractor.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <unordered_map>
+
+#include "parallel.h"
+
+using namespace Eigen;
+using namespace std;
+
+namespace {
+
+// Below this many tets the thread startup costs more than the extraction.
+const int PARALLEL_MIN_TETS = 20000;
+
+struct FaceKey
+{
+    int a, b, c;
+
+    bool operator==(const FaceKey &other) const
+    {
+        return a == other.a && b == other.b && c == other.c;
+    }
+};
+
+struct FaceKeyHash
+{
+    size_t operator()(const FaceKey &key) const
+    {
+        uint64_t h = static_cast<uint32_t>(key.a);
+        h = h * 0x9E3779B97F4A7C15ull + static_cast<uint32_t>(key.b);
+        h = h * 0x9E3779B97F4A7C15ull + static_cast<uint32_t>(key.c);
+        return static_cast<size_t>(h ^ (h >> 29));
+    }
+};
+
+struct FaceCount
+{
+    int firstFace;
+    int count;
+};
+
+FaceKey canonicalKey(const Vector3i &face)
+{
+    int a = face[0], b = face[1], c = face[2];
+    if (a > b) swap(a, b);
+    if (b > c) swap(b, c);
+    if (a > b) swap(a, b);
+    return FaceKey{ a, b, c };
+}
+
+}
+
+Vector3i SurfaceExtractor::tetFace(const Vector4i &tet, int face)
+{
+    switch (face) {
+    case 0: return Vector3i(tet[0], tet[2], tet[1]);
+    case 1: return Vector3i(tet[0], tet[1], tet[3]);
+    case 2: return Vector3i(tet[0], tet[3], tet[2]);
+    default: return Vector3i(tet[1], tet[2], tet[3]);
+    }
+}
+
+vector<Vector3i> SurfaceExtractor::extractSurface(const vector<Vector4i> &tets)
+{
+    const int numTets = static_cast<int>(tets.size());
+    const int numFaces = numTets * 4;
+    const unsigned int numThreads = numTets < PARALLEL_MIN_TETS ? 1 : Parallel::threadCount();
+    const unsigned int numShards = numThreads;
+    const FaceKeyHash hasher;
+
+    // Face ids (tet * 4 + face) bucketed by producing thread, then by shard.
+    vector<vector<vector<int>>> buckets(numThreads, vector<vector<int>>(numShards));
+    const int tetsPerThread = (numTets + numThreads - 1) / numThreads;
+
+    Parallel::forEachThread(numThreads, [&](unsigned int t) {
+        int begin = min(numTets, static_cast<int>(t) * tetsPerThread);
+        int end = min(numTets, begin + tetsPerThread);
+        vector<vector<int>> &mine = buckets[t];
+        for (vector<int> &bucket : mine) {
+            bucket.reserve((end - begin) * 4 / numShards + 16);
+        }
+        for (int i = begin; i < end; i++) {
+            for (int f = 0; f < 4; f++) {
+                size_t shard = numShards == 1 ? 0 : hasher(canonicalKey(tetFace(tets[i], f))) % numShards;
+                mine[shard].push_back(i * 4 + f);
+            }
+        }
+    });
+
+    // Each shard counts its faces in its own table. Face ids are disjoint
+    // across shards so the boundary flags can be written without locking.
+    vector<char> isBoundary(numFaces, 0);
+    Parallel::forEachThread(numShards, [&](unsigned int s) {
+        size_t shardSize = 0;
+        for (unsigned int t = 0; t < numThreads; t++) {
+            shardSize += buckets[t][s].size();
+        }
+        unordered_map<FaceKey, FaceCount, FaceKeyHash> counts;
+        counts.reserve(shardSize / 2 + 1);
+        for (unsigned int t = 0; t < numThreads; t++) {
+            for (int id : buckets[t][s]) {
+                FaceKey key = canonicalKey(tetFace(tets[id / 4], id % 4));
+                auto inserted = counts.emplace(key, FaceCount{ id, 0 });
+                inserted.first->second.count++;
+            }
+        }
+        for (const auto &entry : counts) {
+            if (entry.second.count == 1) {
+                isBoundary[entry.second.firstFace] = 1;
+            }
+        }
+    });
+
+    vector<Vector3i> faces;
+    for (int id = 0; id < numFaces; id++) {
+        if (isBoundary[id]) {
+            faces.push_back(tetFace(tets[id / 4], id % 4));
+        }
+    }
+    return faces;
+}
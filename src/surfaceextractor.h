@@ -0,0 +1,34 @@
+#ifndef SURFACEEXTRACTOR_H
+#define SURFACEEXTRACTOR_H
+
+#include <vector>
+#include <Eigen/Dense>
+#include <Eigen/StdVector>
+
+class SurfaceExtractor
+{
+public:
+    /**
+     * Finds the boundary faces of a tet mesh. A boundary face is a face that
+     * belongs to exactly one tet. Faces keep the winding they have in their
+     * tet (see tetFace) and are returned in the order they are first seen.
+     * The mesh is expected to be manifold, with every face in one or two
+     * tets. A face in three or more tets is never a boundary face here.
+     *
+     * Each face is keyed by its sorted vertex indices and counted in a hash
+     * table. Large meshes are split across threads, with faces sharded by
+     * hash so each thread owns its own table.
+     */
+    static std::vector<Eigen::Vector3i> extractSurface(const std::vector<Eigen::Vector4i> &tets);
+
+    /**
+     * Gets face number face (0-3) of a tet, wound the way the simulation has
+     * always wound surface faces.
+     */
+    static Eigen::Vector3i tetFace(const Eigen::Vector4i &tet, int face);
+
+private:
+    SurfaceExtractor();
+};
+
+#endif // SURFACEEXTRACTOR_H
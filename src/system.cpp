@@ -2,7 +2,6 @@
 
 System::System()
 {
-    m_colliders = std::vector<shared_ptr<CollisionObject>>();
     m_tets = std::vector<Tet>();
     m_time = 0;
     m_particles = unordered_map<int, shared_ptr<Particle>>();
@@ -16,15 +15,19 @@ void System::setTets(std::vector<Tet> particles)
 
 void System::setPushForce(shared_ptr<Particle> v1, shared_ptr<Particle> v2, shared_ptr<Particle> v3, Vector3f force)
 {
-    m_pushVert1 = v1;
-    m_pushVert2 = v2;
-    m_pushVert3 = v3;
+    m_pushNodes = vector<shared_ptr<Particle>>{ v1, v2, v3 };
+    m_pushForce = force;
+}
+
+void System::setPushForce(vector<shared_ptr<Particle>> nodes, Vector3f force)
+{
+    m_pushNodes = nodes;
     m_pushForce = force;
 }
 
 vector<shared_ptr<Particle>> System::getPushNodes()
 {
-    return vector<shared_ptr<Particle>>{ m_pushVert1, m_pushVert2, m_pushVert3 };
+    return m_pushNodes;
 }
 
 Vector3f System::getPushForce()
@@ -32,7 +35,7 @@ Vector3f System::getPushForce()
     return m_pushForce;
 }
 
-unordered_map<int, shared_ptr<Particle>> System::getParticlesMap()
+unordered_map<int, shared_ptr<Particle>> &System::getParticlesMap()
 {
     return m_particles;
 }
@@ -56,17 +59,62 @@ shared_ptr<Particle> System::getParticle(int index)
     return m_particles[index];
 }
 
-std::vector<Tet> System::getTets()
+std::vector<Tet> &System::getTets()
 {
     return m_tets;
 }
 
+void System::setSurfaceParticles(vector<int> indices)
+{
+    m_surfaceParticles = indices;
+}
+
+const vector<int> &System::getSurfaceParticles() const
+{
+    return m_surfaceParticles;
+}
+
+void System::setSelfCollision(shared_ptr<SelfCollision> selfCollision)
+{
+    m_selfCollision = selfCollision;
+}
+
+shared_ptr<SelfCollision> System::getSelfCollision()
+{
+    return m_selfCollision;
+}
+
+void System::setBodyContacts(shared_ptr<BodyContacts> bodyContacts)
+{
+    m_bodyContacts = bodyContacts;
+}
+
+shared_ptr<BodyContacts> System::getBodyContacts()
+{
+    return m_bodyContacts;
+}
+
+void System::setSleepIslands(shared_ptr<SleepIslands> sleepIslands)
+{
+    m_sleepIslands = sleepIslands;
+}
+
+shared_ptr<SleepIslands> System::getSleepIslands()
+{
+    return m_sleepIslands;
+}
+
 std::vector<shared_ptr<CollisionObject>> System::getColliders()
+{
+    return m_colliders.all();
+}
+
+const ColliderSet &System::getColliderSet() const
 {
     return m_colliders;
 }
 
 void System::addCollider(shared_ptr<CollisionObject> shape)
 {
-    m_colliders.push_back(shape);
+    m_colliders.add(shape);
 }
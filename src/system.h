@@ -5,7 +5,11 @@
 #include <unordered_map>
 #include <memory>
 #include "tet.h"
+#include "bodycontacts.h"
 #include "collisionobject.h"
+#include "colliderset.h"
+#include "selfcollision.h"
+#include "sleepislands.h"
 
 using namespace Eigen;
 using namespace std;
@@ -19,31 +23,77 @@ public:
 
     void setPushForce(shared_ptr<Particle> v1, shared_ptr<Particle> v2, shared_ptr<Particle> v3, Vector3f force);
 
+    /**
+     * Pushes every node in nodes with force, for brushes covering more than
+     * one triangle.
+     */
+    void setPushForce(vector<shared_ptr<Particle>> nodes, Vector3f force);
+
     vector<shared_ptr<Particle>> getPushNodes();
     Vector3f getPushForce();
 
-    unordered_map<int, shared_ptr<Particle>> getParticlesMap();
+    /**
+     * The particles by index. A reference, since the solver looks particles
+     * up in it once per particle and a copy each time made steps quadratic.
+     */
+    unordered_map<int, shared_ptr<Particle>> &getParticlesMap();
 
     vector<Particle> getParticleListCopy();
 
     void setParticle(int index, shared_ptr<Particle> particle);
     shared_ptr<Particle> getParticle(int index);
 
-    vector<Tet> getTets();
+    /** The tets, by reference so the solver can run over ranges of them. */
+    vector<Tet> &getTets();
+
+    /**
+     * Indices of the particles on the surface, the only ones that are tested
+     * against colliders. If never set, every particle is.
+     */
+    void setSurfaceParticles(vector<int> indices);
+    const vector<int> &getSurfaceParticles() const;
+
+    /**
+     * Collision of the surface with itself, or null to let it pass through
+     * itself. Shared with the Scene that sets it up, and its buffers are
+     * kept from step to step.
+     */
+    void setSelfCollision(shared_ptr<SelfCollision> selfCollision);
+    shared_ptr<SelfCollision> getSelfCollision();
+
+    /**
+     * Collision between the separate bodies the particles make up, or null
+     * when there is only one.
+     */
+    void setBodyContacts(shared_ptr<BodyContacts> bodyContacts);
+    shared_ptr<BodyContacts> getBodyContacts();
+
+    /**
+     * Bodies at rest that the solver skips, or null to step everything.
+     * Shared with the Scene that sets it up and with the body contacts,
+     * which read each other's state from step to step.
+     */
+    void setSleepIslands(shared_ptr<SleepIslands> sleepIslands);
+    shared_ptr<SleepIslands> getSleepIslands();
 
     vector<shared_ptr<CollisionObject>> getColliders();
 
+    /** The colliders partitioned by type for evaluation. */
+    const ColliderSet &getColliderSet() const;
+
     void addCollider(shared_ptr<CollisionObject> shape);
 
 private:
     float m_time;
     vector<Tet> m_tets;
     unordered_map<int, shared_ptr<Particle>> m_particles;
-    vector<shared_ptr<CollisionObject>> m_colliders;
+    vector<int> m_surfaceParticles;
+    ColliderSet m_colliders;
+    shared_ptr<SelfCollision> m_selfCollision;
+    shared_ptr<BodyContacts> m_bodyContacts;
+    shared_ptr<SleepIslands> m_sleepIslands;
 
-    shared_ptr<Particle> m_pushVert1;
-    shared_ptr<Particle> m_pushVert2;
-    shared_ptr<Particle> m_pushVert3;
+    vector<shared_ptr<Particle>> m_pushNodes;
 
     Vector3f m_pushForce;
 };
@@ -83,34 +83,151 @@ void Particle::addMass(float mass)
     _mass += mass;
 }
 
+namespace {
+
+Vector3f restFaceNormal(const Vector3f nodes[4], int oppositeNodeIndex)
+{
+    assert(oppositeNodeIndex >= 0 && oppositeNodeIndex <= 3);
+
+    Vector3f n = nodes[0];
+    Vector3f adj1 = nodes[1];
+    Vector3f adj2 = nodes[2];
+    Vector3f adj3 = nodes[3];
+    if (oppositeNodeIndex == 1) {
+        n = nodes[1];
+        adj1 = nodes[0];
+    }
+    if (oppositeNodeIndex == 2) {
+        n = nodes[2];
+        adj2 = nodes[0];
+    }
+    if (oppositeNodeIndex == 3) {
+        n = nodes[3];
+        adj3 = nodes[0];
+    }
+
+    Vector3f e1 = adj2 - adj1;
+    Vector3f e2 = adj3 - adj2;
+
+    // Anyone's guess whether this is facing the right way, use
+    // the opposite node to determine proper normal direction.
+    Vector3f norm = -e1.cross(e2).normalized();
+    // Any vector from adjacent vert on the face of the normal to
+    // the off-face node should have angle > 90 degrees to normal.
+    Vector3f toAdj = n - adj1;
+
+    if (norm.dot(toAdj) >= 0) {
+        return -norm;
+    } else {
+        return norm;
+    }
+}
+
+float restFaceArea(const Vector3f nodes[4], int oppositeNodeIndex)
+{
+    assert(oppositeNodeIndex >= 0 && oppositeNodeIndex <= 3);
+    Vector3f a = nodes[1];
+    Vector3f b = nodes[2];
+    Vector3f c = nodes[3];
+    if (oppositeNodeIndex == 1) {
+        a = nodes[0];
+    }
+    if (oppositeNodeIndex == 2) {
+        b = nodes[0];
+    }
+    if (oppositeNodeIndex == 3) {
+        c = nodes[0];
+    }
+
+    //https://math.stackexchange.com/questions/507496/how-do-you-find-the-area-of-a-triangle-in-a-3d-graph
+    return (b - a).cross(c - a).norm() * 0.5;
+}
+
+}
+
+TetRestData TetRestData::compute(const Vector3f &m1, const Vector3f &m2, const Vector3f &m3, const Vector3f &m4)
+{
+    const Vector3f nodes[4] = { m1, m2, m3, m4 };
+
+    Matrix3f mat = Matrix3f();
+    mat.col(0) = m1 - m4;
+    mat.col(1) = m2 - m4;
+    mat.col(2) = m3 - m4;
+
+    TetRestData rest;
+    rest.beta = mat.inverse();
+    rest.volume = abs(mat.determinant()) / 6.f;
+    for (int i = 0; i < 4; i++) {
+        rest.normals[i] = restFaceNormal(nodes, i);
+        rest.areas[i] = restFaceArea(nodes, i);
+    }
+    return rest;
+}
+
+void TetRestData::toFloats(float *out) const
+{
+    Map<Matrix3f> betaOut(out);
+    betaOut = beta;
+    out[9] = volume;
+    for (int i = 0; i < 4; i++) {
+        Map<Vector3f> normalOut(out + 10 + i * 3);
+        normalOut = normals[i];
+        out[22 + i] = areas[i];
+    }
+}
+
+TetRestData TetRestData::fromFloats(const float *in)
+{
+    TetRestData rest;
+    rest.beta = Map<const Matrix3f>(in);
+    rest.volume = in[9];
+    for (int i = 0; i < 4; i++) {
+        rest.normals[i] = Map<const Vector3f>(in + 10 + i * 3);
+        rest.areas[i] = in[22 + i];
+    }
+    return rest;
+}
+
 Tet::Tet(shared_ptr<Particle> node1, shared_ptr<Particle> node2, shared_ptr<Particle> node3, shared_ptr<Particle> node4, float density):
     _node1(node1),
     _node2(node2),
     _node3(node3),
     _node4(node4)
 {
-    Matrix3f beta = Matrix3f();
-    beta.col(0) = _node1->getMaterialPosition() - _node4->getMaterialPosition();
-    beta.col(1) = _node2->getMaterialPosition() - _node4->getMaterialPosition();
-    beta.col(2) = _node3->getMaterialPosition() - _node4->getMaterialPosition();
-    _Beta = beta.inverse();
-
-    _volume = tetVolume();
+    setRestData(TetRestData::compute(_node1->getMaterialPosition(),
+                                     _node2->getMaterialPosition(),
+                                     _node3->getMaterialPosition(),
+                                     _node4->getMaterialPosition()));
 
     _node1->addMass(density * _volume / 4.f);
     _node2->addMass(density * _volume / 4.f);
     _node3->addMass(density * _volume / 4.f);
     _node4->addMass(density * _volume / 4.f);
+}
+
+Tet::Tet(shared_ptr<Particle> node1, shared_ptr<Particle> node2, shared_ptr<Particle> node3, shared_ptr<Particle> node4, const TetRestData &rest):
+    _node1(node1),
+    _node2(node2),
+    _node3(node3),
+    _node4(node4)
+{
+    setRestData(rest);
+}
+
+void Tet::setRestData(const TetRestData &rest)
+{
+    _Beta = rest.beta;
+    _volume = rest.volume;
 
-    _normal1 = faceNormal(0);
-    _normal2 = faceNormal(1);
-    _normal3 = faceNormal(2);
-    _normal4 = faceNormal(3);
+    _normal1 = rest.normals[0];
+    _normal2 = rest.normals[1];
+    _normal3 = rest.normals[2];
+    _normal4 = rest.normals[3];
 
-    _area1 = faceArea(0);
-    _area2 = faceArea(1);
-    _area3 = faceArea(2);
-    _area4 = faceArea(3);
+    _area1 = rest.areas[0];
+    _area2 = rest.areas[1];
+    _area3 = rest.areas[2];
+    _area4 = rest.areas[3];
 }
 
 void Tet::applyForce(Vector3f force)
@@ -137,50 +254,34 @@ void Tet::zeroForces()
     _node4->setForce(Vector3f::Zero());
 }
 
-void Tet::applyColliders(vector<shared_ptr<CollisionObject>> colliders, float collisionCoeff)
+void Tet::applyNodeForces(float incompressibility, float rigidity, float phi, float psi)
 {
+    Vector3f forces[4];
+    nodeForces(incompressibility, rigidity, phi, psi, forces);
 
-    for (shared_ptr<CollisionObject> c : colliders) {
-        Vector3f col1 = c->pointIntersection(_node1->getWorldPosition());
-        Vector3f col2 = c->pointIntersection(_node2->getWorldPosition());
-        Vector3f col3 = c->pointIntersection(_node3->getWorldPosition());
-        Vector3f col4 = c->pointIntersection(_node4->getWorldPosition());
-
-        Vector3f greatestForce = col1;
-        float greatestNorm = col1.norm();
-        if (col2.norm() > greatestNorm) {
-            greatestForce = col2;
-            greatestNorm = col2.norm();
-        }
-        if (col3.norm() > greatestNorm) {
-            greatestForce = col3;
-            greatestNorm = col3.norm();
-        }
-        if (col4.norm() > greatestNorm) {
-            greatestForce = col4;
-            greatestNorm = col4.norm();
-        }
-
-        applyForce(greatestForce * collisionCoeff);
-    }
+    _node1->addForce(forces[0]);
+    _node2->addForce(forces[1]);
+    _node3->addForce(forces[2]);
+    _node4->addForce(forces[3]);
 }
 
-void Tet::applyNodeForces(float incompressibility, float rigidity, float phi, float psi)
+void Tet::nodeForces(float incompressibility, float rigidity, float phi, float psi, Vector3f forces[4])
 {
     // Get face opposite node, calculate normal and area.
 
     Matrix3f F = deformationGradient();
     Matrix3f stress = totalStress(incompressibility, rigidity, phi, psi);
 
-    Vector3f force1 = F * stress * _area1 * _normal1;
-    Vector3f force2 = F * stress * _area2 * _normal2;
-    Vector3f force3 = F * stress * _area3 * _normal3;
-    Vector3f force4 = F * stress * _area4 * _normal4;
+    forces[0] = F * stress * _area1 * _normal1;
+    forces[1] = F * stress * _area2 * _normal2;
+    forces[2] = F * stress * _area3 * _normal3;
+    forces[3] = F * stress * _area4 * _normal4;
+}
 
-    _node1->addForce(force1);
-    _node2->addForce(force2);
-    _node3->addForce(force3);
-    _node4->addForce(force4);
+Particle *Tet::node(int i) const
+{
+    const shared_ptr<Particle> *nodes[4] = { &_node1, &_node2, &_node3, &_node4 };
+    return nodes[i]->get();
 }
 
 vector<shared_ptr<Particle>> Tet::getNodes()
@@ -200,70 +301,16 @@ Vector3f Tet::x_dot_u(Vector3f u)
 
 Vector3f Tet::faceNormal(int oppositeNodeIndex)
 {
-    assert(oppositeNodeIndex >= 0 || oppositeNodeIndex <= 3);
-
-    shared_ptr<Particle> n = _node1;
-    shared_ptr<Particle> adj1 = _node2;
-    shared_ptr<Particle> adj2 = _node3;
-    shared_ptr<Particle> adj3 = _node4;
-    if (oppositeNodeIndex == 1) {
-        n = _node2;
-        adj1 = _node1;
-    }
-    if (oppositeNodeIndex == 2) {
-        n = _node3;
-        adj2 = _node1;
-    }
-    if (oppositeNodeIndex == 3) {
-        n = _node4;
-        adj3 = _node1;
-    }
-
-    Vector3f e1 = adj2->getMaterialPosition() - adj1->getMaterialPosition();
-    Vector3f e2 = adj3->getMaterialPosition() - adj2->getMaterialPosition();
-
-    // Anyone's guess whether this is facing the right way, use
-    // the opposite node to determine proper normal direction.
-    Vector3f norm = -e1.cross(e2).normalized();
-    // Any vector from adjacent vert on the face of the normal to
-    // the off-face node should have angle > 90 degrees to normal.
-    Vector3f toAdj = n->getMaterialPosition() - adj1->getMaterialPosition();
-
-    if (norm.dot(toAdj) >= 0) {
-        return -norm;
-    } else {
-        return norm;
-    }
+    const Vector3f nodes[4] = { _node1->getMaterialPosition(), _node2->getMaterialPosition(),
+                                _node3->getMaterialPosition(), _node4->getMaterialPosition() };
+    return restFaceNormal(nodes, oppositeNodeIndex);
 }
 
 float Tet::faceArea(int oppositeNodeIndex)
 {
-    assert(oppositeNodeIndex >= 0 && oppositeNodeIndex <= 3);
-    Vector3f a = _node2->getMaterialPosition();
-    Vector3f b = _node3->getMaterialPosition();
-    Vector3f c = _node4->getMaterialPosition();
-    if (oppositeNodeIndex == 1) {
-        a = _node1->getMaterialPosition();
-    }
-    if (oppositeNodeIndex == 2) {
-        b = _node1->getMaterialPosition();
-    }
-    if (oppositeNodeIndex == 3) {
-        c = _node1->getMaterialPosition();
-    }
-
-    //https://math.stackexchange.com/questions/507496/how-do-you-find-the-area-of-a-triangle-in-a-3d-graph
-    return (b - a).cross(c - a).norm() * 0.5;
-}
-
-float Tet::tetVolume()
-{
-    Matrix3f mat = Matrix3f();
-    mat.col(0) = _node1->getMaterialPosition() - _node4->getMaterialPosition();
-    mat.col(1) = _node2->getMaterialPosition() - _node4->getMaterialPosition();
-    mat.col(2) = _node3->getMaterialPosition() - _node4->getMaterialPosition();
-
-    return abs(mat.determinant()) / 6.f;
+    const Vector3f nodes[4] = { _node1->getMaterialPosition(), _node2->getMaterialPosition(),
+                                _node3->getMaterialPosition(), _node4->getMaterialPosition() };
+    return restFaceArea(nodes, oppositeNodeIndex);
 }
 
 Matrix3f Tet::deformationGradient()
@@ -58,11 +58,48 @@ private:
     float _mass;
 };
 
+/**
+ * Everything about a tet that only depends on its rest (material space)
+ * shape. Computing this is most of the cost of building a tet, so it can be
+ * stored with a mesh and handed straight to the Tet constructor.
+ */
+struct TetRestData
+{
+    /** Number of floats written by toFloats. */
+    static const int NUM_FLOATS = 26;
+
+    /** Inverse of the material space edge matrix. */
+    Matrix3f beta;
+
+    float volume;
+
+    /** Outward normal and area of the face opposite each node. */
+    Vector3f normals[4];
+    float areas[4];
+
+    static TetRestData compute(const Vector3f &m1, const Vector3f &m2, const Vector3f &m3, const Vector3f &m4);
+
+    /**
+     * Packs as beta (column major), volume, normals, areas.
+     */
+    void toFloats(float *out) const;
+    static TetRestData fromFloats(const float *in);
+};
+
 class Tet
 {
 public:
+    /**
+     * Builds a tet from the material positions of its nodes and adds its
+     * share of mass (density * volume / 4) to each node.
+     */
     Tet(shared_ptr<Particle> node1, shared_ptr<Particle> node2, shared_ptr<Particle> node3, shared_ptr<Particle> node4, float density);
 
+    /**
+     * Builds a tet from precomputed rest data. Node masses are left alone.
+     */
+    Tet(shared_ptr<Particle> node1, shared_ptr<Particle> node2, shared_ptr<Particle> node3, shared_ptr<Particle> node4, const TetRestData &rest);
+
     /**
      * Applies a force to all particles in the tet uniformly.
      */
@@ -76,14 +113,18 @@ public:
     void zeroForces();
 
     /**
-     * Called per step to apply appropriate forces to the tet for collision.
+     * Accumulates forces on each node due to stress.
      */
-    void applyColliders(vector<shared_ptr<CollisionObject>> colliders, float collisionCoeff);
+    void applyNodeForces(float incompressibility, float rigidity, float phi, float psi);
 
     /**
-     * Accumulates forces on each node due to stress.
+     * The forces applyNodeForces adds to each node, without adding them, so
+     * many tets can be evaluated at once.
      */
-    void applyNodeForces(float incompressibility, float rigidity, float phi, float psi);
+    void nodeForces(float incompressibility, float rigidity, float phi, float psi, Vector3f forces[4]);
+
+    /** Node i of the four, from 0. */
+    Particle *node(int i) const;
 
     vector<shared_ptr<Particle>> getNodes();
 
@@ -105,7 +146,7 @@ private:
      */
     Vector3f x_dot_u(Vector3f u);
 
-    float tetVolume();
+    void setRestData(const TetRestData &rest);
 
     Matrix3f deformationGradient();
     Matrix3f velocityGradient();
@@ -0,0 +1,177 @@
+#include "transport.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <thread>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+using namespace std;
+
+Transport::~Transport()
+{
+}
+
+bool Transport::exchange(int peer, const void *sendData, size_t sendBytes, void *receiveData, size_t receiveBytes)
+{
+    if (rank() < peer) {
+        return send(peer, sendData, sendBytes) && receive(peer, receiveData, receiveBytes);
+    }
+    return receive(peer, receiveData, receiveBytes) && send(peer, sendData, sendBytes);
+}
+
+SharedMemoryTransport::SharedMemoryTransport(const string &name, int rank, int size, void *region, size_t regionBytes):
+    m_name(name),
+    m_rank(rank),
+    m_size(size),
+    m_region(region),
+    m_regionBytes(regionBytes),
+    m_header(static_cast<Header *>(region))
+{
+}
+
+SharedMemoryTransport::~SharedMemoryTransport()
+{
+    munmap(m_region, m_regionBytes);
+}
+
+size_t SharedMemoryTransport::regionBytes(int size)
+{
+    return sizeof(Header) + sizeof(Mailbox) * size * size;
+}
+
+unique_ptr<SharedMemoryTransport> SharedMemoryTransport::create(const string &name, int size)
+{
+    int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0) {
+        cerr << "Error: could not create shared memory " << name << ": " << strerror(errno) << endl;
+        return nullptr;
+    }
+    const size_t bytes = regionBytes(size);
+    void *region = ftruncate(fd, bytes) == 0 ? mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (region == MAP_FAILED) {
+        cerr << "Error: could not map shared memory " << name << ": " << strerror(errno) << endl;
+        shm_unlink(name.c_str());
+        return nullptr;
+    }
+
+    // The region starts zeroed, but the flags are built in place so they
+    // are proper atomics.
+    Header *header = new (region) Header;
+    header->opened = 1;
+    header->aborted = 0;
+    Mailbox *mailboxes = reinterpret_cast<Mailbox *>(header + 1);
+    for (int i = 0; i < size * size; i++) {
+        new (&mailboxes[i].full) atomic<uint32_t>(0);
+    }
+    return unique_ptr<SharedMemoryTransport>(new SharedMemoryTransport(name, 0, size, region, bytes));
+}
+
+unique_ptr<SharedMemoryTransport> SharedMemoryTransport::open(const string &name, int rank, int size)
+{
+    int fd = shm_open(name.c_str(), O_RDWR, 0600);
+    if (fd < 0) {
+        cerr << "Error: could not open shared memory " << name << ": " << strerror(errno) << endl;
+        return nullptr;
+    }
+    const size_t bytes = regionBytes(size);
+    void *region = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (region == MAP_FAILED) {
+        cerr << "Error: could not map shared memory " << name << ": " << strerror(errno) << endl;
+        return nullptr;
+    }
+    unique_ptr<SharedMemoryTransport> transport(new SharedMemoryTransport(name, rank, size, region, bytes));
+    transport->m_header->opened++;
+    return transport;
+}
+
+bool SharedMemoryTransport::waitForRanks(const function<bool()> &keepWaiting)
+{
+    while (m_header->opened.load() < m_size) {
+        if (m_header->aborted.load() || !keepWaiting()) {
+            shm_unlink(m_name.c_str());
+            return false;
+        }
+        this_thread::yield();
+    }
+    shm_unlink(m_name.c_str());
+    return true;
+}
+
+int SharedMemoryTransport::rank() const
+{
+    return m_rank;
+}
+
+int SharedMemoryTransport::size() const
+{
+    return m_size;
+}
+
+SharedMemoryTransport::Mailbox &SharedMemoryTransport::mailbox(int from, int to)
+{
+    Mailbox *mailboxes = reinterpret_cast<Mailbox *>(m_header + 1);
+    return mailboxes[from * m_size + to];
+}
+
+bool SharedMemoryTransport::waitFor(const atomic<uint32_t> &flag, uint32_t value)
+{
+    while (flag.load(memory_order_acquire) != value) {
+        if (m_header->aborted.load(memory_order_relaxed)) {
+            return false;
+        }
+        this_thread::yield();
+    }
+    return true;
+}
+
+bool SharedMemoryTransport::send(int peer, const void *data, size_t bytes)
+{
+    Mailbox &box = mailbox(m_rank, peer);
+    const char *next = static_cast<const char *>(data);
+    // An empty message still goes through, so the receiver isn't left waiting.
+    do {
+        size_t piece = min(bytes, MAILBOX_BYTES);
+        if (!waitFor(box.full, 0)) {
+            return false;
+        }
+        if (piece > 0) {
+            memcpy(box.data, next, piece);
+        }
+        box.bytes = piece;
+        box.full.store(1, memory_order_release);
+        next += piece;
+        bytes -= piece;
+    } while (bytes > 0);
+    return true;
+}
+
+bool SharedMemoryTransport::receive(int peer, void *data, size_t bytes)
+{
+    Mailbox &box = mailbox(peer, m_rank);
+    char *next = static_cast<char *>(data);
+    do {
+        if (!waitFor(box.full, 1)) {
+            return false;
+        }
+        size_t piece = min<size_t>(bytes, box.bytes);
+        if (piece > 0) {
+            memcpy(next, box.data, piece);
+        }
+        box.full.store(0, memory_order_release);
+        next += piece;
+        bytes -= piece;
+    } while (bytes > 0);
+    return true;
+}
+
+void SharedMemoryTransport::abort()
+{
+    m_header->aborted = 1;
+}
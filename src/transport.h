@@ -0,0 +1,117 @@
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+/**
+ * Moves bytes between the processes of a partitioned run, each known by its
+ * rank from 0 to size() - 1. Messages between two ranks arrive whole and in
+ * order. Transports only need send and receive, so one that goes between
+ * machines can stand in for the shared memory one below.
+ */
+class Transport
+{
+public:
+    virtual ~Transport();
+
+    virtual int rank() const = 0;
+    virtual int size() const = 0;
+
+    /**
+     * Sends bytes to peer, waiting for room if the peer hasn't taken what
+     * was sent before. Returns false if the run was aborted.
+     */
+    virtual bool send(int peer, const void *data, size_t bytes) = 0;
+
+    /** Waits for bytes from peer. Returns false if the run was aborted. */
+    virtual bool receive(int peer, void *data, size_t bytes) = 0;
+
+    /**
+     * Tells every rank to give up, such as when this one can't go on, so
+     * none waits forever on it.
+     */
+    virtual void abort() = 0;
+
+    /**
+     * Sends to and receives from peer. The lower rank sends first, so when
+     * every rank exchanges with its peers in increasing rank order no two
+     * wait on each other, however large the messages.
+     */
+    bool exchange(int peer, const void *sendData, size_t sendBytes, void *receiveData, size_t receiveBytes);
+};
+
+/**
+ * A transport between processes on one machine through a shared memory
+ * region, with a one message mailbox for each direction between each pair
+ * of ranks. Larger messages go through in mailbox sized pieces. Waiting is
+ * spinning that yields the processor, since messages come once or twice a
+ * step and the wait is short.
+ */
+class SharedMemoryTransport : public Transport
+{
+public:
+    ~SharedMemoryTransport() override;
+
+    /**
+     * Makes the region for size ranks under name, as rank 0. Returns null
+     * and prints why if it can't.
+     */
+    static std::unique_ptr<SharedMemoryTransport> create(const std::string &name, int size);
+
+    /** Opens the region rank 0 made, as rank. */
+    static std::unique_ptr<SharedMemoryTransport> open(const std::string &name, int rank, int size);
+
+    /**
+     * Waits until every other rank has opened the region and removes its
+     * name, so it goes away with the last process to close it. Gives up,
+     * returning false, if keepWaiting returns false, such as when a rank's
+     * process has died. Rank 0 only.
+     */
+    bool waitForRanks(const std::function<bool()> &keepWaiting);
+
+    int rank() const override;
+    int size() const override;
+    bool send(int peer, const void *data, size_t bytes) override;
+    bool receive(int peer, void *data, size_t bytes) override;
+    void abort() override;
+
+private:
+    static const size_t MAILBOX_BYTES = 1 << 16;
+
+    struct Mailbox
+    {
+        /** Set while it holds a message the receiver hasn't taken. */
+        std::atomic<uint32_t> full;
+        uint32_t bytes;
+        char data[MAILBOX_BYTES];
+    };
+
+    struct Header
+    {
+        std::atomic<int32_t> opened;
+        std::atomic<int32_t> aborted;
+    };
+
+    SharedMemoryTransport(const std::string &name, int rank, int size, void *region, size_t regionBytes);
+
+    static size_t regionBytes(int size);
+
+    Mailbox &mailbox(int from, int to);
+
+    /** Spins until flag holds value. Returns false if the run was aborted. */
+    bool waitFor(const std::atomic<uint32_t> &flag, uint32_t value);
+
+    std::string m_name;
+    int m_rank;
+    int m_size;
+    void *m_region;
+    size_t m_regionBytes;
+    Header *m_header;
+};
+
+#endif // TRANSPORT_H
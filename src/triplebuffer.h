@@ -0,0 +1,70 @@
+#ifndef TRIPLEBUFFER_H
+#define TRIPLEBUFFER_H
+
+#include <atomic>
+
+/**
+ * Hands the newest of a stream of values from one writer thread to one
+ * reader thread without locks. The writer and the reader each own one of
+ * three slots, and the third holds the newest value published and not yet
+ * taken. Publishing and taking swap a slot with that third one, so neither
+ * side ever waits for the other, and values the reader was too slow for
+ * are overwritten rather than queued.
+ */
+template <typename T>
+class TripleBuffer
+{
+public:
+    TripleBuffer():
+        m_write(0),
+        m_shared(1),
+        m_read(2)
+    {
+    }
+
+    /** The writer's slot, to fill in before publish. */
+    T &writeSlot()
+    {
+        return m_slots[m_write];
+    }
+
+    /**
+     * Makes the writer's slot the newest value. The writer gets back
+     * whichever slot that replaces, holding an older value.
+     */
+    void publish()
+    {
+        m_write = m_shared.exchange(m_write | FRESH, std::memory_order_acq_rel) & INDEX;
+    }
+
+    /**
+     * Takes the newest value into the reader's slot, if one was published
+     * since the last call. Returns whether it did.
+     */
+    bool take()
+    {
+        if (!(m_shared.load(std::memory_order_acquire) & FRESH)) {
+            return false;
+        }
+        m_read = m_shared.exchange(m_read, std::memory_order_acq_rel) & INDEX;
+        return true;
+    }
+
+    /** The reader's slot, holding the value last taken. */
+    const T &readSlot() const
+    {
+        return m_slots[m_read];
+    }
+
+private:
+    /** The shared index carries this bit while it holds a value not yet taken. */
+    static const int FRESH = 4;
+    static const int INDEX = 3;
+
+    T m_slots[3];
+    int m_write;
+    std::atomic<int> m_shared;
+    int m_read;
+};
+
+#endif // TRIPLEBUFFER_H
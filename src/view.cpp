@@ -16,7 +16,8 @@ View::View(QWidget *parent) : QGLWidget(ViewFormat(), parent),
     m_lastX(), m_lastY(),
     m_capture(false),
     m_paused(true),
-    m_castPushForce(0)
+    m_castPushForce(0),
+    m_brush(false)
 {
     // View needs all mouse move events, not just mouse drag events
     setMouseTracking(true);
@@ -155,6 +156,10 @@ void View::keyPressEvent(QKeyEvent *event)
     else if(event->key() == Qt::Key_3) {
         m_castPushForce = 20;
     }
+    else if(event->key() == Qt::Key_4) {
+        m_castPushForce = 10;
+        m_brush = true;
+    }
 }
 
 void View::keyRepeatEvent(QKeyEvent *)
@@ -198,11 +203,16 @@ void View::keyReleaseEvent(QKeyEvent *event)
     else if(event->key() == Qt::Key_3) {
         m_castPushForce = 0;
     }
+    else if(event->key() == Qt::Key_4) {
+        m_castPushForce = 0;
+        m_brush = false;
+    }
 }
 
 void View::tick()
 {
     float seconds = m_time.restart() * 0.00001f;
+    m_sim.setPaused(m_paused);
     if (!m_paused) {
         if (m_castPushForce != 0){
             Vector3f p(0, 0, 0);
@@ -218,14 +228,17 @@ void View::tick()
             Vector3f op = (hp / hp.w()).head<3>();
             Vector3f od = (hd).head<3>().normalized();
 
-            m_sim.castClickRay(Vector3f(op[0], op[1], op[2]), Vector3f(od[0], od[1], od[2]), m_castPushForce);
+            if (m_brush) {
+                m_sim.castBrushRays(Vector3f(op[0], op[1], op[2]), Vector3f(od[0], od[1], od[2]), 0.25f, m_castPushForce);
+            } else {
+                m_sim.castClickRay(Vector3f(op[0], op[1], op[2]), Vector3f(od[0], od[1], od[2]), m_castPushForce);
+            }
         }
         else {
             m_sim.zeroPush();
         }
-
-        m_sim.update(seconds);
     }
+    m_sim.update();
 
     auto look = m_camera.getLook();
     look.y() = 0;
@@ -60,6 +60,9 @@ private:
 
     bool m_paused;
 
+    /** Push with the area brush instead of the single center ray. */
+    bool m_brush;
+
 private slots:
     void tick();
 };
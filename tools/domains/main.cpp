@@ -0,0 +1,229 @@
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+
+#include "domain.h"
+#include "graphics/BinaryMesh.h"
+#include "meshcache.h"
+#include "meshconverter.h"
+#include "meshpartition.h"
+#include "scene.h"
+#include "settings.h"
+#include "transport.h"
+
+using namespace Eigen;
+using namespace std;
+
+/**
+ * Starts a process for each rank but 0, running this program with the same
+ * arguments and the rank and shared memory to join. Returns their ids, or
+ * as many as started.
+ */
+vector<pid_t> startWorkers(const vector<string> &args, int numRanks, const string &shmName)
+{
+    vector<pid_t> workers;
+    for (int rank = 1; rank < numRanks; rank++) {
+        vector<string> workerArgs = args;
+        workerArgs.insert(workerArgs.end(), { "--worker", to_string(rank), "--shm", shmName });
+        vector<char *> argv;
+        for (string &arg : workerArgs) {
+            argv.push_back(&arg[0]);
+        }
+        argv.push_back(nullptr);
+        pid_t pid = fork();
+        if (pid == 0) {
+            execvp(argv[0], argv.data());
+            _exit(127);
+        }
+        if (pid < 0) {
+            cerr << "Error: could not start worker " << rank << endl;
+            break;
+        }
+        workers.push_back(pid);
+    }
+    return workers;
+}
+
+/**
+ * Returns whether a worker has exited with an error, leaving it to be
+ * waited for. A worker whose domain is empty can finish and exit cleanly
+ * before the others have even joined.
+ */
+bool anyWorkerFailed(const vector<pid_t> &workers)
+{
+    for (pid_t pid : workers) {
+        siginfo_t info;
+        info.si_pid = 0;
+        if (waitid(P_PID, pid, &info, WEXITED | WNOHANG | WNOWAIT) != 0) {
+            return true;
+        }
+        if (info.si_pid == pid && (info.si_code != CLD_EXITED || info.si_status != 0)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/** Waits for the workers and returns whether they all succeeded. */
+bool waitForWorkers(const vector<pid_t> &workers)
+{
+    bool succeeded = true;
+    for (pid_t pid : workers) {
+        int status;
+        if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            succeeded = false;
+        }
+    }
+    return succeeded;
+}
+
+int main(int argc, char *argv[])
+{
+    const vector<string> args(argv, argv + argc);
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Splits the mesh into parts and steps each in a process of its own, exchanging the forces on the particles they share through shared memory.");
+    parser.addHelpOption();
+    addSceneArguments(parser);
+    QCommandLineOption domainsOption("domains", "Number of parts and processes", "count", "2");
+    parser.addOption(domainsOption);
+    QCommandLineOption stepsOption("steps", "Number of steps to take", "count", "1000");
+    parser.addOption(stepsOption);
+    QCommandLineOption dtOption("dt", "Seconds per step. The window takes steps of 0.00016", "seconds", "0.00016");
+    parser.addOption(dtOption);
+    QCommandLineOption outputOption("output", "Write the final state as a .mesh file in world space", "file");
+    parser.addOption(outputOption);
+    QCommandLineOption workerOption("worker", "Used by the tool itself: run as this rank of a run another process started", "rank");
+    parser.addOption(workerOption);
+    QCommandLineOption shmOption("shm", "Used by the tool itself: shared memory of the run to join", "name");
+    parser.addOption(shmOption);
+
+    parser.process(app);
+
+    if (!readSceneArguments(parser)) {
+        return 1;
+    }
+    const int numRanks = parser.value(domainsOption).toInt();
+    const int steps = parser.value(stepsOption).toInt();
+    const float dt = parser.value(dtOption).toFloat();
+    if (numRanks < 1 || steps < 1 || !(dt > 0)) {
+        cerr << "Error: --domains, --steps and --dt need to be positive" << endl;
+        return 1;
+    }
+    // Contacts and sleep reach across the whole body, and swept particles
+    // move where their ghosts wouldn't, so none can be split up.
+    if (bodyCount > 1 || selfCollision || sweepCollisions || sleepThreshold > 0) {
+        cerr << "Error: only a single body can be split, without --self-collision, --ccd or --sleep" << endl;
+        return 1;
+    }
+    const bool isWorker = parser.isSet(workerOption);
+    const int rank = isWorker ? parser.value(workerOption).toInt() : 0;
+
+    // Rank 0 sets up first, so the caches of the mesh and of any --sdf
+    // obstacle are written before the workers read them, then starts them.
+    auto loadStart = chrono::steady_clock::now();
+    BinaryMesh mesh;
+    if (!MeshCache::load(meshFile.toStdString(), mesh, reorderMesh)) {
+        cerr << "Error: could not load " << meshFile.toStdString() << endl;
+        return 1;
+    }
+    if (numRanks > mesh.numTets()) {
+        cerr << "Error: " << meshFile.toStdString() << " has only " << mesh.numTets() << " tets to split" << endl;
+        return 1;
+    }
+
+    // Every rank partitions the same way, so none needs to be told its part.
+    vector<Vector4i> tets;
+    mesh.copyTets(tets);
+    const vector<int> parts = MeshPartition::partitionTets(tets, mesh.numVertices(), numRanks);
+    Domain domain;
+    if (!domain.init(mesh, parts, numRanks, rank)) {
+        return 1;
+    }
+    // More domains than a small mesh has room for can leave one owning
+    // nothing. It has nothing to step or exchange, but still loads the
+    // obstacles and joins the gather.
+    const bool empty = domain.numParticles() == 0;
+    Scene scene;
+    if (!scene.init(domain.mesh()) && !empty) {
+        return 1;
+    }
+
+    unique_ptr<SharedMemoryTransport> transport;
+    vector<pid_t> workers;
+    if (isWorker) {
+        transport = SharedMemoryTransport::open(parser.value(shmOption).toStdString(), rank, numRanks);
+        if (!transport) {
+            return 1;
+        }
+    } else {
+        const string shmName = "/tetsim-" + to_string(getpid());
+        transport = SharedMemoryTransport::create(shmName, numRanks);
+        if (!transport) {
+            return 1;
+        }
+        workers = startWorkers(args, numRanks, shmName);
+        bool started = workers.size() == static_cast<size_t>(numRanks - 1) && transport->waitForRanks([&]() {
+            return !anyWorkerFailed(workers);
+        });
+        if (!started) {
+            cerr << "Error: not every worker started" << endl;
+            transport->abort();
+            waitForWorkers(workers);
+            return 1;
+        }
+    }
+    bool aborted = false;
+    scene.setForceExchange([&](System &system) {
+        aborted = aborted || !domain.exchangeForces(system, *transport);
+    });
+    double loadSeconds = chrono::duration<double>(chrono::steady_clock::now() - loadStart).count();
+    cout << "domain " << rank << ": particles " << domain.numParticles() << ", ghosts " << domain.numGhosts()
+         << ", tets " << domain.numTets() << ", ready in " << loadSeconds * 1e3 << " ms" << endl;
+
+    auto start = chrono::steady_clock::now();
+    for (int step = 1; step <= steps && !aborted && !empty; step++) {
+        scene.update(dt);
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    vector<Vector3f> positions;
+    vector<Vector3f> velocities;
+    if (aborted || !domain.gather(scene.getVertices(), scene.getSystem(), *transport, positions, velocities)) {
+        cerr << "Error: domain " << rank << " stopped, another domain failed" << endl;
+        transport->abort();
+        waitForWorkers(workers);
+        return 1;
+    }
+    if (isWorker) {
+        return 0;
+    }
+    const bool workersSucceeded = waitForWorkers(workers);
+
+    cout << "steps " << steps << " of " << dt << " s in " << seconds << " s: " << seconds * 1e3 / steps
+         << " ms/step, " << steps / seconds << " steps/s, " << numRanks << " domains" << endl;
+    double energy = 0;
+    for (unsigned int i = 0; i < velocities.size(); i++) {
+        float mass = 1 + density * mesh.masses()[i];
+        energy += 0.5 * mass * velocities[i].squaredNorm();
+    }
+    cout << "kinetic energy " << energy << endl;
+
+    const QString output = parser.value(outputOption);
+    if (!output.isEmpty()) {
+        vector<int> ids;
+        mesh.copyExternalIds(ids);
+        if (!MeshConverter::writeTextMesh(output.toStdString(), positions, tets, ids, shapeTranslation.vector())) {
+            cerr << "Error: could not write " << output.toStdString() << endl;
+            return 1;
+        }
+    }
+    return workersSucceeded ? 0 : 1;
+}
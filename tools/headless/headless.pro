@@ -0,0 +1,67 @@
+QT += core
+QT -= gui
+
+TARGET = headless
+TEMPLATE = app
+CONFIG += console c++14 thread
+CONFIG -= app_bundle
+
+QMAKE_CXXFLAGS += -std=c++14 -mstackrealign
+
+ROOT = ../..
+
+SOURCES += \
+    main.cpp \
+    $$ROOT/src/bodycontacts.cpp \
+    $$ROOT/src/broadphase.cpp \
+    $$ROOT/src/colliderset.cpp \
+    $$ROOT/src/collisionobject.cpp \
+    $$ROOT/src/collisionsdf.cpp \
+    $$ROOT/src/collisiontrimesh.cpp \
+    $$ROOT/src/meshcache.cpp \
+    $$ROOT/src/meshconverter.cpp \
+    $$ROOT/src/meshreorder.cpp \
+    $$ROOT/src/parallel.cpp \
+    $$ROOT/src/scene.cpp \
+    $$ROOT/src/selfcollision.cpp \
+    $$ROOT/src/settings.cpp \
+    $$ROOT/src/sleepislands.cpp \
+    $$ROOT/src/solver.cpp \
+    $$ROOT/src/surfacebvh.cpp \
+    $$ROOT/src/surfaceextractor.cpp \
+    $$ROOT/src/system.cpp \
+    $$ROOT/src/tet.cpp \
+    $$ROOT/src/graphics/BinaryMesh.cpp \
+    $$ROOT/src/graphics/MeshLoader.cpp \
+    $$ROOT/src/graphics/MeshParser.cpp
+
+HEADERS += \
+    $$ROOT/src/bodycontacts.h \
+    $$ROOT/src/broadphase.h \
+    $$ROOT/src/colliderset.h \
+    $$ROOT/src/collisionobject.h \
+    $$ROOT/src/collisionsdf.h \
+    $$ROOT/src/collisiontrimesh.h \
+    $$ROOT/src/meshcache.h \
+    $$ROOT/src/meshconverter.h \
+    $$ROOT/src/meshreorder.h \
+    $$ROOT/src/parallel.h \
+    $$ROOT/src/scene.h \
+    $$ROOT/src/selfcollision.h \
+    $$ROOT/src/settings.h \
+    $$ROOT/src/sleepislands.h \
+    $$ROOT/src/solver.h \
+    $$ROOT/src/surfacebvh.h \
+    $$ROOT/src/surfaceextractor.h \
+    $$ROOT/src/system.h \
+    $$ROOT/src/tet.h \
+    $$ROOT/src/graphics/BinaryMesh.h \
+    $$ROOT/src/graphics/MeshLoader.h \
+    $$ROOT/src/graphics/MeshParser.h
+
+INCLUDEPATH += $$ROOT/src $$ROOT/libs
+DEPENDPATH += $$ROOT/src $$ROOT/libs
+
+QMAKE_CXXFLAGS_RELEASE -= -O2
+QMAKE_CXXFLAGS_RELEASE += -O3
+QMAKE_CXXFLAGS += -fno-math-errno
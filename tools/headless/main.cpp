@@ -0,0 +1,88 @@
+#include <chrono>
+#include <iostream>
+#include <string>
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+
+#include "meshconverter.h"
+#include "parallel.h"
+#include "scene.h"
+#include "settings.h"
+
+using namespace Eigen;
+using namespace std;
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Steps the simulation without a window, as fast as it goes, and reports the time taken.");
+    parser.addHelpOption();
+    addSceneArguments(parser);
+    QCommandLineOption stepsOption("steps", "Number of steps to take", "count", "1000");
+    parser.addOption(stepsOption);
+    QCommandLineOption dtOption("dt", "Seconds per step. The window takes steps of 0.00016", "seconds", "0.00016");
+    parser.addOption(dtOption);
+    QCommandLineOption reportOption("report", "Print the time taken so far every this many steps", "steps", "0");
+    parser.addOption(reportOption);
+    QCommandLineOption outputOption("output", "Write the final state as a .mesh file in world space", "file");
+    parser.addOption(outputOption);
+    QCommandLineOption statsOption("stats", "Print the time each stage of the step took and how busy it kept the threads");
+    parser.addOption(statsOption);
+
+    parser.process(app);
+
+    if (!readSceneArguments(parser)) {
+        return 1;
+    }
+    const int steps = parser.value(stepsOption).toInt();
+    const float dt = parser.value(dtOption).toFloat();
+    const int report = parser.value(reportOption).toInt();
+    if (steps < 1 || !(dt > 0) || report < 0) {
+        cerr << "Error: --steps and --dt need to be positive, and --report at least 0" << endl;
+        return 1;
+    }
+
+    auto loadStart = chrono::steady_clock::now();
+    Scene scene;
+    if (!scene.init()) {
+        cerr << "Error: could not load " << meshFile.toStdString() << endl;
+        return 1;
+    }
+    double loadSeconds = chrono::duration<double>(chrono::steady_clock::now() - loadStart).count();
+    System &system = scene.getSystem();
+    cout << "particles " << system.getParticlesMap().size() << ", tets " << scene.getTets().size()
+         << ", bodies " << bodyCount << ", loaded in " << loadSeconds * 1e3 << " ms" << endl;
+
+    Parallel::resetStats();
+    auto start = chrono::steady_clock::now();
+    for (int step = 1; step <= steps; step++) {
+        scene.update(dt);
+        if (report > 0 && step % report == 0) {
+            double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            cout << "step " << step << ", " << seconds * 1e3 / step << " ms/step, kinetic energy "
+                 << scene.kineticEnergy() << endl;
+        }
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    cout << "steps " << steps << " of " << dt << " s in " << seconds << " s: " << seconds * 1e3 / steps
+         << " ms/step, " << steps / seconds << " steps/s" << endl;
+    cout << "kinetic energy " << scene.kineticEnergy() << endl;
+    if (shared_ptr<SleepIslands> sleepIslands = system.getSleepIslands()) {
+        cout << "asleep " << sleepIslands->numAsleep() << " of " << sleepIslands->numBodies() << " bodies" << endl;
+    }
+    if (parser.isSet(statsOption)) {
+        Parallel::printStats(cout);
+    }
+
+    const QString output = parser.value(outputOption);
+    if (!output.isEmpty() && !MeshConverter::writeTextMesh(output.toStdString(), scene.getVertices(), scene.getTets(),
+                                                           scene.getExternalVertexIds(), shapeTranslation.vector())) {
+        cerr << "Error: could not write " << output.toStdString() << endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,461 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <limits>
+#include <numeric>
+#include <random>
+#include <string>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "meshreorder.h"
+#include "parallel.h"
+#include "surfacebvh.h"
+#include "surfaceextractor.h"
+#include "graphics/MeshParser.h"
+
+using namespace Eigen;
+using namespace std;
+
+/**
+ * Builds a text .mesh of roughly targetBytes: an n^3 grid of jittered
+ * vertices split into six tets per cell.
+ */
+string generateMesh(size_t targetBytes)
+{
+    // About 30 bytes per vertex line and 6 * 28 bytes of tet lines per vertex.
+    int n = 2;
+    while (static_cast<size_t>(n) * n * n * 200 < targetBytes) {
+        n++;
+    }
+    mt19937 rng(1);
+    uniform_real_distribution<float> jitter(-0.25f, 0.25f);
+
+    string text;
+    text.reserve(targetBytes + targetBytes / 4);
+    char line[96];
+    for (int x = 0; x <= n; x++) {
+        for (int y = 0; y <= n; y++) {
+            for (int z = 0; z <= n; z++) {
+                int len = snprintf(line, sizeof(line), "v %.6f %.6f %.6f\n", x + jitter(rng), y + jitter(rng), z + jitter(rng));
+                text.append(line, len);
+            }
+        }
+    }
+    auto id = [n](int x, int y, int z) { return (x * (n + 1) + y) * (n + 1) + z; };
+    const int cellTets[6][2] = { { 1, 3 }, { 1, 5 }, { 2, 3 }, { 2, 6 }, { 4, 5 }, { 4, 6 } };
+    for (int x = 0; x < n; x++) {
+        for (int y = 0; y < n; y++) {
+            for (int z = 0; z < n; z++) {
+                int corner[8];
+                for (int c = 0; c < 8; c++) {
+                    corner[c] = id(x + (c & 1), y + ((c >> 1) & 1), z + ((c >> 2) & 1));
+                }
+                for (const auto &t : cellTets) {
+                    int len = snprintf(line, sizeof(line), "t %d %d %d %d\n", corner[0], corner[t[0]], corner[t[1]], corner[7]);
+                    text.append(line, len);
+                }
+            }
+        }
+    }
+    return text;
+}
+
+#ifdef __linux__
+/**
+ * Hardware cache miss counter for the calling thread, read through
+ * perf_event_open. Unavailable (valid() is false) on other platforms or when
+ * the kernel doesn't expose counters, e.g. in most VMs.
+ */
+class MissCounter
+{
+public:
+    MissCounter(uint32_t type, uint64_t config)
+    {
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = type;
+        attr.config = config;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        m_fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+    ~MissCounter() { if (m_fd >= 0) close(m_fd); }
+    bool valid() const { return m_fd >= 0; }
+    void start() { if (valid()) { ioctl(m_fd, PERF_EVENT_IOC_RESET, 0); ioctl(m_fd, PERF_EVENT_IOC_ENABLE, 0); } }
+    long long stop()
+    {
+        long long count = -1;
+        if (valid()) {
+            ioctl(m_fd, PERF_EVENT_IOC_DISABLE, 0);
+            if (read(m_fd, &count, sizeof(count)) != sizeof(count)) count = -1;
+        }
+        return count;
+    }
+private:
+    int m_fd;
+};
+#else
+class MissCounter
+{
+public:
+    MissCounter(uint32_t, uint64_t) {}
+    bool valid() const { return false; }
+    void start() {}
+    long long stop() { return -1; }
+};
+const uint32_t PERF_TYPE_HARDWARE = 0, PERF_TYPE_HW_CACHE = 0;
+const uint64_t PERF_COUNT_HW_CACHE_MISSES = 0, PERF_COUNT_HW_CACHE_L1D = 0,
+               PERF_COUNT_HW_CACHE_OP_READ = 0, PERF_COUNT_HW_CACHE_RESULT_MISS = 0;
+#endif
+
+/**
+ * One sweep with the memory access pattern of Tet::applyNodeForces: gather
+ * the positions and velocities of each tet's nodes, do a little math with
+ * the tet's rest matrix and scatter a force to every node.
+ */
+void forceSweep(const vector<Vector4i> &tets, const vector<Matrix3f> &betas,
+                const vector<Vector3f> &positions, const vector<Vector3f> &velocities,
+                vector<Vector3f> &forces)
+{
+    for (unsigned int t = 0; t < tets.size(); t++) {
+        const Vector4i &tet = tets[t];
+        Matrix3f P, V;
+        for (int c = 0; c < 3; c++) {
+            P.col(c) = positions[tet[c]] - positions[tet[3]];
+            V.col(c) = velocities[tet[c]] - velocities[tet[3]];
+        }
+        Matrix3f F = P * betas[t];
+        Matrix3f stress = F.transpose() * F - Matrix3f::Identity() + (V * betas[t]).transpose();
+        Matrix3f G = F * stress;
+        forces[tet[0]] += G.col(0);
+        forces[tet[1]] += G.col(1);
+        forces[tet[2]] += G.col(2);
+        forces[tet[3]] -= G.col(0) + G.col(1) + G.col(2);
+    }
+}
+
+void measureOrder(const string &label, const vector<Vector3f> &vertices, const vector<Vector4i> &tets)
+{
+    const int sweeps = 10;
+    vector<Matrix3f> betas(tets.size(), Matrix3f::Identity());
+    vector<Vector3f> velocities(vertices.size(), Vector3f::Zero());
+    vector<Vector3f> forces(vertices.size(), Vector3f::Zero());
+
+    MissCounter l1(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                       (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+    MissCounter llc(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+
+    forceSweep(tets, betas, vertices, velocities, forces);
+    l1.start();
+    llc.start();
+    auto start = chrono::steady_clock::now();
+    for (int s = 0; s < sweeps; s++) {
+        forceSweep(tets, betas, vertices, velocities, forces);
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    long long l1Misses = l1.stop();
+    long long llcMisses = llc.stop();
+
+    cout << label << "," << seconds / sweeps * 1e3 << ",";
+    if (l1Misses >= 0) cout << double(l1Misses) / sweeps / tets.size(); else cout << "n/a";
+    cout << ",";
+    if (llcMisses >= 0) cout << double(llcMisses) / sweeps / tets.size(); else cout << "n/a";
+    cout << endl;
+}
+
+/**
+ * Compares the force sweep over the mesh in file order, in random order (a
+ * stand in for meshes exported in arbitrary order) and after MeshReorder.
+ */
+int reorderBenchmark(const vector<Vector3f> &vertices, const vector<Vector4i> &tets)
+{
+    mt19937 rng(2);
+    vector<int> vertexShuffle(vertices.size());
+    iota(vertexShuffle.begin(), vertexShuffle.end(), 0);
+    shuffle(vertexShuffle.begin(), vertexShuffle.end(), rng);
+    vector<Vector3f> shuffledVertices(vertices.size());
+    for (unsigned int i = 0; i < vertices.size(); i++) {
+        shuffledVertices[vertexShuffle[i]] = vertices[i];
+    }
+    vector<Vector4i> shuffledTets(tets);
+    for (Vector4i &tet : shuffledTets) {
+        for (int n = 0; n < 4; n++) {
+            tet[n] = vertexShuffle[tet[n]];
+        }
+    }
+    shuffle(shuffledTets.begin(), shuffledTets.end(), rng);
+
+    vector<Vector3f> reorderedVertices(shuffledVertices);
+    vector<Vector4i> reorderedTets(shuffledTets);
+    auto start = chrono::steady_clock::now();
+    MeshReorder::reorder(reorderedVertices, reorderedTets);
+    double reorderMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    cout << "Reordering took " << reorderMs << " ms" << endl;
+
+    cout << "order,ms/sweep,L1D read misses/tet,LLC misses/tet" << endl;
+    measureOrder("file", vertices, tets);
+    measureOrder("shuffled", shuffledVertices, shuffledTets);
+    measureOrder("reordered", reorderedVertices, reorderedTets);
+    return 0;
+}
+
+/**
+ * Closest hit over every face with the scalar kernel, the reference the
+ * packed kernels are checked against.
+ */
+bool bruteForcePick(const Vector3f &origin, const Vector3f &direction, const vector<Vector3i> &faces,
+                    const vector<Vector3f> &positions, int &face, float &dist)
+{
+    face = -1;
+    dist = numeric_limits<float>::max();
+    for (unsigned int i = 0; i < faces.size(); i++) {
+        float t;
+        if (SurfaceBVH::intersectTriangle(origin, direction, positions[faces[i][0]], positions[faces[i][1]],
+                                          positions[faces[i][2]], t) && t < dist) {
+            dist = t;
+            face = i;
+        }
+    }
+    return face >= 0;
+}
+
+/**
+ * Checks the 8-wide triangle kernel, BVH picking and packet picking against
+ * the scalar Möller–Trumbore kernel on a deformed surface, then times them.
+ */
+int pickBenchmark(vector<Vector3f> vertices, const vector<Vector4i> &tets)
+{
+    vector<Vector3i> faces = SurfaceExtractor::extractSurface(tets);
+    Vector3f lo = vertices[0];
+    Vector3f hi = vertices[0];
+    for (const Vector3f &v : vertices) {
+        lo = lo.cwiseMin(v);
+        hi = hi.cwiseMax(v);
+    }
+    SurfaceBVH bvh;
+    bvh.build(faces, vertices);
+    // Bend the mesh after building so the refit path is what gets checked.
+    float size = (hi - lo).maxCoeff();
+    for (Vector3f &v : vertices) {
+        v.y() += 0.1f * size * sinf(3 * v.x() / size);
+    }
+    bvh.refit(vertices);
+    cout << faces.size() << " surface triangles" << endl;
+
+    // Brush-like packets: parallel rays scattered over a small disc, aimed
+    // from outside the mesh at a random point inside its box, so most hit and
+    // some graze or miss.
+    mt19937 rng(3);
+    uniform_real_distribution<float> unit(0, 1);
+    const int numRays = 1 << 14;
+    vector<Vector3f> origins(numRays);
+    vector<Vector3f> directions(numRays);
+    for (int first = 0; first < numRays; first += SurfaceBVH::MAX_PACKET) {
+        Vector3f target = lo + Vector3f(unit(rng), unit(rng), unit(rng)).cwiseProduct(hi - lo);
+        Vector3f away = Vector3f(unit(rng) - 0.5f, unit(rng) - 0.5f, unit(rng) - 0.5f).normalized();
+        Vector3f direction = -away;
+        Vector3f side = direction.unitOrthogonal();
+        Vector3f up = direction.cross(side);
+        for (int i = first; i < first + SurfaceBVH::MAX_PACKET; i++) {
+            Vector2f offset = 0.05f * size * Vector2f(unit(rng) - 0.5f, unit(rng) - 0.5f);
+            origins[i] = target + away * size * 2 + offset.x() * side + offset.y() * up;
+            directions[i] = direction;
+        }
+    }
+
+    // Kernel: every face in blocks of eight against the scalar kernel lane by lane.
+    vector<SurfaceBVH::TriangleBlock, aligned_allocator<SurfaceBVH::TriangleBlock>> blocks((faces.size() + 7) / 8);
+    for (unsigned int b = 0; b < blocks.size(); b++) {
+        SurfaceBVH::TriangleBlock &block = blocks[b];
+        memset(&block, 0, sizeof(block));
+        for (int lane = 0; lane < SurfaceBVH::BLOCK_SIZE; lane++) {
+            unsigned int f = b * SurfaceBVH::BLOCK_SIZE + lane;
+            block.faces[lane] = f < faces.size() ? static_cast<int>(f) : -1;
+            if (f < faces.size()) {
+                for (int c = 0; c < 3; c++) {
+                    block.v0[c][lane] = vertices[faces[f][0]][c];
+                    block.e1[c][lane] = vertices[faces[f][1]][c] - vertices[faces[f][0]][c];
+                    block.e2[c][lane] = vertices[faces[f][2]][c] - vertices[faces[f][0]][c];
+                }
+            }
+        }
+    }
+    const int kernelRays = 256;
+    long mismatches = 0;
+    long hits = 0;
+    double scalarSeconds = 0;
+    double blockSeconds = 0;
+    for (int k = 0; k < kernelRays; k++) {
+        // One ray from each packet, so every ray has a different direction.
+        int r = k * numRays / kernelRays;
+        auto start = chrono::steady_clock::now();
+        vector<int> scalarFace(blocks.size(), -1);
+        vector<float> scalarT(blocks.size(), numeric_limits<float>::max());
+        for (unsigned int b = 0; b < blocks.size(); b++) {
+            for (int lane = 0; lane < SurfaceBVH::BLOCK_SIZE; lane++) {
+                int f = blocks[b].faces[lane];
+                float t;
+                if (f >= 0 && SurfaceBVH::intersectTriangle(origins[r], directions[r], vertices[faces[f][0]],
+                                                            vertices[faces[f][1]], vertices[faces[f][2]], t)
+                        && t < scalarT[b]) {
+                    scalarT[b] = t;
+                    scalarFace[b] = f;
+                }
+            }
+        }
+        auto middle = chrono::steady_clock::now();
+        vector<int> blockFace(blocks.size(), -1);
+        vector<float> blockT(blocks.size(), numeric_limits<float>::max());
+        for (unsigned int b = 0; b < blocks.size(); b++) {
+            float t;
+            int lane = SurfaceBVH::intersectBlock(origins[r], directions[r], blocks[b], numeric_limits<float>::max(), t);
+            if (lane >= 0) {
+                blockT[b] = t;
+                blockFace[b] = blocks[b].faces[lane];
+            }
+        }
+        auto end = chrono::steady_clock::now();
+        scalarSeconds += chrono::duration<double>(middle - start).count();
+        blockSeconds += chrono::duration<double>(end - middle).count();
+        for (unsigned int b = 0; b < blocks.size(); b++) {
+            hits += scalarFace[b] >= 0;
+            mismatches += scalarFace[b] != blockFace[b] || scalarT[b] != blockT[b];
+        }
+    }
+    double tests = double(kernelRays) * blocks.size() * SurfaceBVH::BLOCK_SIZE;
+    cout << "kernel,ns/triangle" << endl;
+    cout << "scalar," << scalarSeconds * 1e9 / tests << endl;
+    cout << "block," << blockSeconds * 1e9 / tests << endl;
+    if (mismatches) {
+        cerr << "Error: " << mismatches << " of " << kernelRays * blocks.size()
+             << " blocks differ from the scalar kernel" << endl;
+        return 1;
+    }
+
+    // Picking: brute force on a subset, then BVH and packets on every ray.
+    const int checkedRays = min<int>(numRays, max<int>(64, (1 << 24) / max<size_t>(1, faces.size())));
+    vector<int> referenceFaces(checkedRays);
+    vector<float> referenceDists(checkedRays);
+    for (int r = 0; r < checkedRays; r++) {
+        bruteForcePick(origins[r], directions[r], faces, vertices, referenceFaces[r], referenceDists[r]);
+    }
+
+    vector<int> singleFaces(numRays);
+    vector<float> singleDists(numRays);
+    auto start = chrono::steady_clock::now();
+    for (int r = 0; r < numRays; r++) {
+        if (!bvh.intersect(origins[r], directions[r], singleFaces[r], singleDists[r])) {
+            singleFaces[r] = -1;
+        }
+    }
+    double singleSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    vector<int> packetFaces(numRays);
+    vector<float> packetDists(numRays);
+    start = chrono::steady_clock::now();
+    bvh.intersectPacket(origins.data(), directions.data(), numRays, packetFaces.data(), packetDists.data());
+    double packetSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    // Rays through a shared edge can report either face at the same distance.
+    long pickMismatches = 0;
+    for (int r = 0; r < numRays; r++) {
+        if (r < checkedRays) {
+            pickMismatches += (referenceFaces[r] >= 0) != (singleFaces[r] >= 0)
+                    || (referenceFaces[r] >= 0 && referenceDists[r] != singleDists[r]);
+        }
+        pickMismatches += singleFaces[r] != packetFaces[r]
+                || (singleFaces[r] >= 0 && singleDists[r] != packetDists[r]);
+    }
+    cout << "pick,rays/s" << endl;
+    cout << "bvh," << numRays / singleSeconds << endl;
+    cout << "packet," << numRays / packetSeconds << endl;
+    if (pickMismatches) {
+        cerr << "Error: " << pickMismatches << " picks differ from the scalar reference" << endl;
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * meshbench [parse] [megabytes] [max threads]
+ *     Parse throughput of a synthetic mesh at 1..max threads.
+ * meshbench reorder [megabytes | .mesh file]
+ *     Gather/scatter cost and cache misses before and after reordering.
+ * meshbench pick [megabytes | .mesh file]
+ *     Checks the packed ray triangle kernels against the scalar one and
+ *     times picking.
+ */
+int main(int argc, char *argv[])
+{
+    vector<string> args(argv + 1, argv + argc);
+    bool reorder = !args.empty() && args[0] == "reorder";
+    bool pick = !args.empty() && args[0] == "pick";
+    if (!args.empty() && (args[0] == "parse" || reorder || pick)) {
+        args.erase(args.begin());
+    }
+
+    if ((reorder || pick) && !args.empty() && args[0].find_first_not_of("0123456789") != string::npos) {
+        ifstream file(args[0], ios::binary);
+        if (!file) {
+            cerr << "Error opening file: " << args[0] << endl;
+            return 1;
+        }
+        string text((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+        vector<Vector3f> vertices;
+        vector<Vector4i> tets;
+        MeshParser::parse(text.data(), text.data() + text.size(), vertices, tets);
+        return pick ? pickBenchmark(vertices, tets) : reorderBenchmark(vertices, tets);
+    }
+
+    size_t megabytes = args.size() > 0 ? strtoul(args[0].c_str(), nullptr, 10) : 256;
+    unsigned int maxThreads = args.size() > 1 ? strtoul(args[1].c_str(), nullptr, 10) : Parallel::threadCount();
+    const int repeats = 3;
+
+    string text = generateMesh(megabytes << 20);
+    const double mb = text.size() / double(1 << 20);
+    cout << "Synthetic mesh: " << mb << " MB" << endl;
+
+    vector<Vector3f> reference;
+    vector<Vector4i> referenceTets;
+    MeshParser::parse(text.data(), text.data() + text.size(), reference, referenceTets);
+    cout << reference.size() << " vertices, " << referenceTets.size() << " tets" << endl;
+
+    if (reorder) {
+        return reorderBenchmark(reference, referenceTets);
+    }
+    if (pick) {
+        return pickBenchmark(reference, referenceTets);
+    }
+
+    cout << "threads,MB/s" << endl;
+    for (unsigned int threads = 1; threads <= maxThreads; threads++) {
+        double best = 1e30;
+        for (int r = 0; r < repeats; r++) {
+            vector<Vector3f> vertices;
+            vector<Vector4i> tets;
+            auto start = chrono::steady_clock::now();
+            MeshParser::parseParallel(text.data(), text.data() + text.size(), vertices, tets, threads);
+            double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            best = min(best, seconds);
+            if (vertices != reference || tets != referenceTets) {
+                cerr << "Error: parse with " << threads << " threads does not match the serial parse" << endl;
+                return 1;
+            }
+        }
+        cout << threads << "," << mb / best << endl;
+    }
+    return 0;
+}
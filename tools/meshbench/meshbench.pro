@@ -0,0 +1,31 @@
+QT -= core gui
+
+TARGET = meshbench
+TEMPLATE = app
+CONFIG += console c++14 thread
+CONFIG -= app_bundle qt
+
+QMAKE_CXXFLAGS += -std=c++14 -mstackrealign
+
+ROOT = ../..
+
+SOURCES += \
+    main.cpp \
+    $$ROOT/src/meshreorder.cpp \
+    $$ROOT/src/parallel.cpp \
+    $$ROOT/src/surfacebvh.cpp \
+    $$ROOT/src/surfaceextractor.cpp \
+    $$ROOT/src/graphics/MeshParser.cpp
+
+HEADERS += \
+    $$ROOT/src/meshreorder.h \
+    $$ROOT/src/parallel.h \
+    $$ROOT/src/surfacebvh.h \
+    $$ROOT/src/surfaceextractor.h \
+    $$ROOT/src/graphics/MeshParser.h
+
+INCLUDEPATH += $$ROOT/src $$ROOT/libs
+DEPENDPATH += $$ROOT/src $$ROOT/libs
+
+QMAKE_CXXFLAGS_RELEASE -= -O2
+QMAKE_CXXFLAGS_RELEASE += -O3
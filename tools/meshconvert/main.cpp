@@ -0,0 +1,22 @@
+#include <iostream>
+#include <string>
+
+#include "meshconverter.h"
+
+using namespace std;
+
+int main(int argc, char *argv[])
+{
+    bool reorder = argc == 4 && string(argv[1]) == "--reorder";
+    if (argc != 3 && !reorder) {
+        cerr << "Usage: meshconvert [--reorder] <input .mesh file> <output binary mesh file>" << endl;
+        return 1;
+    }
+    const char *input = argv[argc - 2];
+    const char *output = argv[argc - 1];
+    if (!MeshConverter::convert(input, output, reorder)) {
+        cerr << "Error: could not convert " << input << endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,39 @@
+QT += core
+QT -= gui
+
+TARGET = meshconvert
+TEMPLATE = app
+CONFIG += console c++14
+CONFIG -= app_bundle
+
+QMAKE_CXXFLAGS += -std=c++14 -mstackrealign
+
+ROOT = ../..
+
+SOURCES += \
+    main.cpp \
+    $$ROOT/src/collisionobject.cpp \
+    $$ROOT/src/meshconverter.cpp \
+    $$ROOT/src/meshreorder.cpp \
+    $$ROOT/src/parallel.cpp \
+    $$ROOT/src/surfaceextractor.cpp \
+    $$ROOT/src/tet.cpp \
+    $$ROOT/src/graphics/BinaryMesh.cpp \
+    $$ROOT/src/graphics/MeshLoader.cpp \
+    $$ROOT/src/graphics/MeshParser.cpp
+
+HEADERS += \
+    $$ROOT/src/meshconverter.h \
+    $$ROOT/src/meshreorder.h \
+    $$ROOT/src/parallel.h \
+    $$ROOT/src/surfaceextractor.h \
+    $$ROOT/src/tet.h \
+    $$ROOT/src/graphics/BinaryMesh.h \
+    $$ROOT/src/graphics/MeshLoader.h \
+    $$ROOT/src/graphics/MeshParser.h
+
+INCLUDEPATH += $$ROOT/src $$ROOT/libs $$ROOT/libs/glew-1.10.0/include
+DEPENDPATH += $$ROOT/src $$ROOT/libs $$ROOT/libs/glew-1.10.0/include
+
+QMAKE_CXXFLAGS_RELEASE -= -O2
+QMAKE_CXXFLAGS_RELEASE += -O3
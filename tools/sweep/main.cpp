@@ -0,0 +1,423 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+
+#include "ensemble.h"
+#include "graphics/BinaryMesh.h"
+#include "meshcache.h"
+#include "parallel.h"
+#include "scene.h"
+#include "settings.h"
+
+using namespace Eigen;
+using namespace std;
+
+namespace {
+
+// A variant has blown up once its particles stop being finite or spread
+// over this many times the size they started at.
+const float BLOWUP_SCALE = 10;
+
+}
+
+/** One set of material parameters, in the order the window takes them. */
+struct Material
+{
+    float incompressibility;
+    float rigidity;
+    float phi;
+    float psi;
+    float density;
+};
+
+/** What running one variant measured. */
+struct Result
+{
+    bool stable;
+    /** Steps taken; fewer than asked for if the variant blew up. */
+    int steps;
+    double kineticEnergy;
+    /** Simulated seconds until a particle first touched a collider, or -1 if none did. */
+    double firstContact;
+    /** Simulated seconds during which some particle touched a collider. */
+    double contactSeconds;
+    double msPerStep;
+};
+
+/**
+ * Parses a comma separated list of values, each either a number or
+ * first:last:count for count values spaced evenly from first to last.
+ */
+bool parseValues(const string &text, vector<float> &values)
+{
+    stringstream list(text);
+    string item;
+    while (getline(list, item, ',')) {
+        float first, last;
+        int count;
+        char end;
+        if (sscanf(item.c_str(), "%f:%f:%d%c", &first, &last, &count, &end) == 3 && count > 0) {
+            for (int i = 0; i < count; i++) {
+                values.push_back(count == 1 ? first : first + (last - first) * i / (count - 1));
+            }
+        } else if (sscanf(item.c_str(), "%f%c", &first, &end) == 1) {
+            values.push_back(first);
+        } else {
+            return false;
+        }
+    }
+    return !values.empty();
+}
+
+/**
+ * Reads one variant per line, as incompressibility, rigidity, phi, psi and
+ * density separated by commas or spaces. Blank lines and lines starting with
+ * # are skipped.
+ */
+bool readList(const string &path, vector<Material> &materials)
+{
+    ifstream in(path);
+    if (!in) {
+        cerr << "Error: could not open " << path << endl;
+        return false;
+    }
+    string line;
+    int lineNumber = 0;
+    while (getline(in, line)) {
+        lineNumber++;
+        replace(line.begin(), line.end(), ',', ' ');
+        stringstream fields(line);
+        string first;
+        if (!(fields >> first) || first[0] == '#') {
+            continue;
+        }
+        fields.seekg(0);
+        Material m;
+        string rest;
+        if (!(fields >> m.incompressibility >> m.rigidity >> m.phi >> m.psi >> m.density) || (fields >> rest)) {
+            cerr << "Error: " << path << ":" << lineNumber << " needs five numbers" << endl;
+            return false;
+        }
+        materials.push_back(m);
+    }
+    return true;
+}
+
+AlignedBox3f particleBounds(System &system)
+{
+    AlignedBox3f box;
+    box.setEmpty();
+    for (unsigned int i = 0; i < system.getParticlesMap().size(); i++) {
+        box.extend(system.getParticle(i)->getWorldPosition());
+    }
+    return box;
+}
+
+/** Whether any surface particle is inside a collider. */
+bool touching(System &system, const AlignedBox3f &bounds)
+{
+    const vector<int> &surface = system.getSurfaceParticles();
+    for (const shared_ptr<CollisionObject> &collider : system.getColliders()) {
+        if (!collider->mayIntersect(bounds)) {
+            continue;
+        }
+        for (int i : surface) {
+            if (collider->pointIntersection(system.getParticle(i)->getWorldPosition()) != Vector3f::Zero()) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+Result run(const BinaryMesh &mesh, const Scene &obstacles, const Material &m, int steps, float dt)
+{
+    Scene scene(m.incompressibility, m.rigidity, m.phi, m.psi, m.density);
+    scene.shareObstacles(obstacles);
+    scene.init(mesh);
+    System &system = scene.getSystem();
+    const float restSize = particleBounds(system).sizes().norm();
+
+    Result result;
+    result.stable = true;
+    result.steps = 0;
+    result.firstContact = -1;
+    result.contactSeconds = 0;
+    auto start = chrono::steady_clock::now();
+    for (int step = 1; step <= steps; step++) {
+        scene.update(dt);
+        result.steps = step;
+        AlignedBox3f bounds = particleBounds(system);
+        Vector3f size = bounds.sizes();
+        if (!size.allFinite() || size.norm() > BLOWUP_SCALE * restSize) {
+            result.stable = false;
+            break;
+        }
+        if (touching(system, bounds)) {
+            if (result.firstContact < 0) {
+                result.firstContact = step * static_cast<double>(dt);
+            }
+            result.contactSeconds += dt;
+        }
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    result.msPerStep = seconds * 1e3 / result.steps;
+    result.kineticEnergy = scene.kineticEnergy();
+    return result;
+}
+
+/**
+ * Runs count variants, from first, in the lanes of one ensemble, writing
+ * their results from results[first]. Spare lanes repeat the last variant.
+ * The time per step is the ensemble's, shared out over the variants.
+ */
+void runEnsemble(const BinaryMesh &mesh, const ColliderSet &colliders, const vector<Material> &materials,
+                 int first, int count, int steps, float dt, vector<Result> &results)
+{
+    Ensemble ensemble;
+    ensemble.init(mesh, colliders);
+    for (int l = 0; l < Ensemble::LANES; l++) {
+        const Material &m = materials[first + min(l, count - 1)];
+        ensemble.setMaterial(l, m.incompressibility, m.rigidity, m.phi, m.psi, m.density);
+    }
+    AlignedBox3f bounds[Ensemble::LANES];
+    ensemble.bounds(bounds);
+    const float restSize = bounds[0].sizes().norm();
+
+    Result *result = &results[first];
+    bool running[Ensemble::LANES];
+    for (int l = 0; l < Ensemble::LANES; l++) {
+        running[l] = true;
+    }
+    for (int l = 0; l < count; l++) {
+        result[l].stable = true;
+        result[l].steps = 0;
+        result[l].firstContact = -1;
+        result[l].contactSeconds = 0;
+    }
+    double energies[Ensemble::LANES];
+    bool touching[Ensemble::LANES];
+    int stepsTaken = 0;
+    int numRunning = count;
+    auto start = chrono::steady_clock::now();
+    for (int step = 1; step <= steps && numRunning > 0; step++) {
+        ensemble.update(dt);
+        stepsTaken = step;
+        ensemble.bounds(bounds);
+        ensemble.touching(touching);
+        // Spare lanes are checked too, so copies of a variant that blew up
+        // are put back to rest along with it.
+        for (int l = 0; l < Ensemble::LANES; l++) {
+            if (!running[l]) {
+                continue;
+            }
+            Vector3f size = bounds[l].sizes();
+            if (!size.allFinite() || size.norm() > BLOWUP_SCALE * restSize) {
+                // Its energy as it blew up, as a scene of its own would
+                // report, then back to rest so it can't slow the others.
+                if (l < count) {
+                    ensemble.kineticEnergies(energies);
+                    result[l].steps = step;
+                    result[l].kineticEnergy = energies[l];
+                    result[l].stable = false;
+                    numRunning--;
+                }
+                running[l] = false;
+                ensemble.resetLane(l);
+                continue;
+            }
+            if (l >= count) {
+                continue;
+            }
+            result[l].steps = step;
+            if (touching[l]) {
+                if (result[l].firstContact < 0) {
+                    result[l].firstContact = step * static_cast<double>(dt);
+                }
+                result[l].contactSeconds += dt;
+            }
+        }
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    ensemble.kineticEnergies(energies);
+    for (int l = 0; l < count; l++) {
+        result[l].msPerStep = seconds * 1e3 / stepsTaken / count;
+        if (running[l]) {
+            result[l].kineticEnergy = energies[l];
+        }
+    }
+}
+
+bool writeCsv(const string &path, const vector<Material> &materials, const vector<Result> &results)
+{
+    ofstream out(path);
+    if (!out) {
+        return false;
+    }
+    out << "incompressibility,rigidity,phi,psi,density,stable,steps,kinetic_energy,first_contact,contact_time,ms_per_step\n";
+    char line[256];
+    for (unsigned int i = 0; i < materials.size(); i++) {
+        const Material &m = materials[i];
+        const Result &r = results[i];
+        char firstContact[32] = "";
+        if (r.firstContact >= 0) {
+            snprintf(firstContact, sizeof(firstContact), "%.9g", r.firstContact);
+        }
+        int len = snprintf(line, sizeof(line), "%.9g,%.9g,%.9g,%.9g,%.9g,%d,%d,%.9g,%s,%.9g,%.6g\n",
+                           m.incompressibility, m.rigidity, m.phi, m.psi, m.density, r.stable ? 1 : 0, r.steps,
+                           r.kineticEnergy, firstContact, r.contactSeconds, r.msPerStep);
+        out.write(line, len);
+    }
+    return static_cast<bool>(out);
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Runs one mesh with many sets of material parameters side by side and writes what each did to a CSV file.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("mesh", "Mesh file");
+    addSceneOptions(parser);
+    const char *valuesHelp = " values, comma separated, each a number or first:last:count";
+    QCommandLineOption incompressibilityOption("incompressibility", QString("Elastic incompressibility") + valuesHelp, "values");
+    QCommandLineOption rigidityOption("rigidity", QString("Elastic rigidity") + valuesHelp, "values");
+    QCommandLineOption phiOption("phi", QString("Phi (viscous incompressibility)") + valuesHelp, "values");
+    QCommandLineOption psiOption("psi", QString("Psi (viscous rigidity)") + valuesHelp, "values");
+    QCommandLineOption densityOption("density", QString("Uniform mesh density") + valuesHelp, "values");
+    const QCommandLineOption *gridOptions[] = { &incompressibilityOption, &rigidityOption, &phiOption, &psiOption, &densityOption };
+    for (const QCommandLineOption *option : gridOptions) {
+        parser.addOption(*option);
+    }
+    QCommandLineOption listOption("list", "Run the variants listed in a file, one per line as incompressibility, rigidity, phi, psi and density, instead of a grid", "file");
+    parser.addOption(listOption);
+    QCommandLineOption stepsOption("steps", "Number of steps to run each variant for", "count", "1000");
+    parser.addOption(stepsOption);
+    QCommandLineOption dtOption("dt", "Seconds per step. The window takes steps of 0.00016", "seconds", "0.00016");
+    parser.addOption(dtOption);
+    QCommandLineOption csvOption("csv", "File to write the results to", "file", "sweep.csv");
+    parser.addOption(csvOption);
+    QCommandLineOption ensembleOption("ensemble", "Step the variants eight at a time as the lanes of one ensemble, which shares the mesh between them. Not with --bodies, --self-collision, --ccd or --sleep");
+    parser.addOption(ensembleOption);
+
+    parser.process(app);
+
+    const QStringList args = parser.positionalArguments();
+    if (args.size() < 1) {
+        cerr << "Error: Wrong number of arguments" << endl;
+        return 1;
+    }
+    meshFile = args[0];
+    if (!readSceneOptions(parser)) {
+        return 1;
+    }
+    const bool useEnsemble = parser.isSet(ensembleOption);
+    if (useEnsemble && (bodyCount > 1 || selfCollision || sweepCollisions || sleepThreshold > 0)) {
+        cerr << "Error: --ensemble only runs a single body, without --self-collision, --ccd or --sleep" << endl;
+        return 1;
+    }
+    const int steps = parser.value(stepsOption).toInt();
+    const float dt = parser.value(dtOption).toFloat();
+    if (steps < 1 || !(dt > 0)) {
+        cerr << "Error: --steps and --dt need to be positive" << endl;
+        return 1;
+    }
+
+    // Either every variant in the list, or every combination of the grid's
+    // values, the last parameter changing fastest.
+    vector<Material> materials;
+    if (parser.isSet(listOption)) {
+        if (!readList(parser.value(listOption).toStdString(), materials)) {
+            return 1;
+        }
+    } else {
+        vector<float> values[5];
+        for (int p = 0; p < 5; p++) {
+            if (!parseValues(parser.value(*gridOptions[p]).toStdString(), values[p])) {
+                cerr << "Error: --incompressibility, --rigidity, --phi, --psi and --density each need values, or pass --list" << endl;
+                return 1;
+            }
+        }
+        for (float incompressibility : values[0]) {
+            for (float rigidity : values[1]) {
+                for (float phi : values[2]) {
+                    for (float psi : values[3]) {
+                        for (float density : values[4]) {
+                            materials.push_back(Material{ incompressibility, rigidity, phi, psi, density });
+                        }
+                    }
+                }
+            }
+        }
+    }
+    if (materials.empty()) {
+        cerr << "Error: no variants to run" << endl;
+        return 1;
+    }
+
+    // Every variant builds its bodies from the one loaded mesh and collides
+    // with the same obstacles, loaded once through a scene of their own.
+    auto loadStart = chrono::steady_clock::now();
+    BinaryMesh mesh;
+    if (!MeshCache::load(meshFile.toStdString(), mesh, reorderMesh)) {
+        cerr << "Error: could not load " << meshFile.toStdString() << endl;
+        return 1;
+    }
+    Scene obstacles;
+    obstacles.init(mesh);
+    double loadSeconds = chrono::duration<double>(chrono::steady_clock::now() - loadStart).count();
+    const int count = materials.size();
+    const int perRun = useEnsemble ? Ensemble::LANES : 1;
+    const int numRuns = (count + perRun - 1) / perRun;
+    cout << count << " variants of " << steps << " steps, " << Parallel::threadCount() * perRun
+         << " at a time, loaded in " << loadSeconds * 1e3 << " ms" << endl;
+
+    // Variants, or ensembles of them, run whole on one thread each, the next
+    // free thread taking the next, since there are more of them than threads.
+    auto start = chrono::steady_clock::now();
+    vector<Result> results(count);
+    atomic<int> next(0);
+    atomic<int> finished(0);
+    mutex printMutex;
+    Parallel::forEachThread(Parallel::threadCount(), [&](unsigned int) {
+        Parallel::SerialScope serial;
+        for (int r = next++; r < numRuns; r = next++) {
+            int first = r * perRun;
+            int runCount = min(perRun, count - first);
+            if (useEnsemble) {
+                runEnsemble(mesh, obstacles.getSystem().getColliderSet(), materials, first, runCount, steps, dt, results);
+            } else {
+                results[first] = run(mesh, obstacles, materials[first], steps, dt);
+            }
+            int done = finished += runCount;
+            if (done * 10 / count != (done - runCount) * 10 / count) {
+                lock_guard<mutex> lock(printMutex);
+                cout << done << " of " << count << " done" << endl;
+            }
+        }
+    });
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    int stable = count_if(results.begin(), results.end(), [](const Result &r) { return r.stable; });
+    cout << stable << " of " << count << " stable, in " << seconds << " s, " << seconds / count << " s per variant" << endl;
+
+    const string csv = parser.value(csvOption).toStdString();
+    if (!writeCsv(csv, materials, results)) {
+        cerr << "Error: could not write " << csv << endl;
+        return 1;
+    }
+    return 0;
+}